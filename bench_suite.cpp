@@ -0,0 +1,492 @@
+/* bench_suite.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+// Benchmark suite comparing memory resources on container workloads:
+// `slist` push, traverse and erase; `pmr::vector<pmr::string>` build and
+// destroy; and `pmr::string` append, each at several sizes.  The
+// `std::allocator` rows run the same workloads on `std::forward_list`,
+// `std::vector<std::string>` and `std::string`.  For each workload, size
+// and resource, the suite reports ns/op, heap allocations (calls to the
+// global `operator new`) per op and the peak resident set size.  Each
+// combination runs in its own child process, so that peak RSS is not
+// inherited from earlier runs.
+//
+// Usage: bench_suite [--threads N] [--ops N] [FILTER...]
+//
+// With `--threads N`, N threads run each workload at once.  Thread-safe
+// resources (`new_delete` and `sync_pool`) are shared by the threads; the
+// others are per thread.  ns/op is then per thread, so that it stays flat
+// if throughput scales.  `--ops N` sets the number of ops per thread for
+// each combination (default 2^21).  A FILTER naming a resource restricts
+// the runs to the named resources; any other FILTER restricts them to the
+// workloads whose names contain it.
+//
+// Resources are long-lived, as in a server, except that the monotonic
+// resource is released after each repetition.
+
+#include <polymorphic_allocator.h>
+#include <pool_resource.h>
+#include <pmr_string.h>
+#include <pmr_vector.h>
+#include <slist.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <forward_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// Number of calls to the global `operator new` by this thread.
+thread_local std::size_t t_heap_allocs = 0;
+
+}
+
+// The replacement functions are not inlined, so that g++ does not mistake
+// `free` of a pointer from the replacement `operator new` for a mismatched
+// deallocation.
+__attribute__((noinline)) void *operator new(std::size_t bytes)
+{
+    ++t_heap_allocs;
+    if (void *p = std::malloc(bytes ? bytes : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+namespace pmr = cpp17::pmr;
+using pmr::memory_resource;
+
+enum resource_kind {
+    std_alloc, new_delete, monotonic, unsync_pool, sync_pool, node_pool,
+    num_resource_kinds
+};
+
+const char *const resource_names[] = {
+    "std::allocator", "new_delete", "monotonic", "unsync_pool",
+    "sync_pool", "node_pool"
+};
+
+enum workload_kind { slist_workload, vector_workload, string_workload };
+
+struct workload {
+    workload_kind  m_kind;
+    const char    *m_phases[3];  // Null-terminated if fewer than three
+};
+
+const workload workloads[] = {
+    { slist_workload,  { "slist push", "slist traverse", "slist erase" } },
+    { vector_workload, { "vector<string> build/destroy", nullptr } },
+    { string_workload, { "string append", nullptr } }
+};
+
+const std::size_t sizes[] = { 16, 1024, 65536 };
+
+// Length of the strings in the vector workload; long enough to defeat
+// the short-string optimization.
+const std::size_t string_length = 40;
+
+// Totals for one phase of a workload.
+struct phase_result {
+    double      m_ns;
+    std::size_t m_ops;
+    std::size_t m_heap_allocs;
+};
+
+// One thread's view of the resource used by a benchmark run.  Null for
+// `std_alloc`.
+class bench_resource
+{
+    resource_kind                    m_kind;
+    std::unique_ptr<memory_resource> m_owned;
+    memory_resource                 *m_resource;
+
+  public:
+    bench_resource(resource_kind kind, memory_resource *shared)
+        : m_kind(kind), m_resource(shared)
+    {
+        switch (kind) {
+          case std_alloc:   break;
+          case new_delete:
+            m_resource = pmr::new_delete_resource_singleton();
+            break;
+          case monotonic:
+            m_owned.reset(new pmr::monotonic_buffer_resource());
+            break;
+          case unsync_pool:
+            m_owned.reset(new pmr::unsynchronized_pool_resource());
+            break;
+          case sync_pool:
+            if (! shared)
+                m_owned.reset(new pmr::synchronized_pool_resource());
+            break;
+          case node_pool:
+            m_owned.reset(new slist_node_resource<int>());
+            break;
+          default:          break;
+        }
+        if (m_owned)
+            m_resource = m_owned.get();
+    }
+
+    memory_resource *get() const { return m_resource; }
+
+    void end_repetition()
+    {
+        if (m_kind == monotonic)
+            static_cast<pmr::monotonic_buffer_resource*>(
+                m_owned.get())->release();
+    }
+};
+
+// Adapters giving `std::forward_list` and `slist` a common interface.
+class std_list
+{
+    std::forward_list<int>           m_list;
+    std::forward_list<int>::iterator m_tail;
+
+  public:
+    explicit std_list(memory_resource *) : m_tail(m_list.before_begin()) { }
+
+    void push_back(int v) { m_tail = m_list.insert_after(m_tail, v); }
+
+    long sum() const
+    {
+        long ret = 0;
+        for (int v : m_list)
+            ret += v;
+        return ret;
+    }
+
+    std::size_t erase_every_other()
+    {
+        std::size_t erased = 0;
+        for (auto it = m_list.before_begin();
+             std::next(it) != m_list.end(); ++erased) {
+            m_list.erase_after(it);
+            if (std::next(it) == m_list.end())
+                break;
+            ++it;
+        }
+        return erased;
+    }
+};
+
+class pmr_list
+{
+    slist<int> m_list;
+
+  public:
+    explicit pmr_list(memory_resource *r) : m_list(r) { }
+
+    void push_back(int v) { m_list.push_back(v); }
+
+    long sum() const
+    {
+        long ret = 0;
+        for (int v : m_list)
+            ret += v;
+        return ret;
+    }
+
+    std::size_t erase_every_other()
+    {
+        std::size_t erased = 0;
+        for (auto it = m_list.begin(); it != m_list.end(); ++erased) {
+            it = m_list.erase(it);
+            if (it != m_list.end())
+                ++it;
+        }
+        return erased;
+    }
+};
+
+struct std_containers {
+    typedef std_list                 list;
+    typedef std::vector<std::string> vector;
+    typedef std::string              string;
+
+    static vector make_vector(memory_resource *) { return vector(); }
+    static string make_string(memory_resource *) { return string(); }
+};
+
+struct pmr_containers {
+    typedef pmr_list                        list;
+    typedef pmr::vector<pmr::string>        vector;
+    typedef pmr::string                     string;
+
+    static vector make_vector(memory_resource *r) { return vector(r); }
+    static string make_string(memory_resource *r) { return string(r); }
+};
+
+// Sink that keeps the optimizer from discarding the benchmarked work.
+volatile long sink;
+
+// Times a phase and counts its heap allocations.
+class phase_timer
+{
+    typedef std::chrono::steady_clock clock;
+
+    phase_result&     m_result;
+    clock::time_point m_start;
+    std::size_t       m_start_allocs;
+
+  public:
+    explicit phase_timer(phase_result& result)
+        : m_result(result), m_start(clock::now())
+        , m_start_allocs(t_heap_allocs) { }
+
+    void stop(std::size_t ops)
+    {
+        m_result.m_ns += std::chrono::duration<double, std::nano>(
+            clock::now() - m_start).count();
+        m_result.m_ops += ops;
+        m_result.m_heap_allocs += t_heap_allocs - m_start_allocs;
+    }
+};
+
+template <class Containers>
+void run_workload(workload_kind kind, std::size_t size, std::size_t ops,
+                  bench_resource& resource, phase_result *results)
+{
+    const std::size_t reps = ops > size ? ops / size : 1;
+    const char text[string_length + 1] =
+        "0123456789012345678901234567890123456789";
+
+    for (std::size_t rep = 0; rep < reps; ++rep) {
+        memory_resource *r = resource.get();
+        switch (kind) {
+          case slist_workload: {
+            typename Containers::list list(r);
+            phase_timer push(results[0]);
+            for (std::size_t i = 0; i < size; ++i)
+                list.push_back(int(i));
+            push.stop(size);
+
+            phase_timer traverse(results[1]);
+            sink = list.sum();
+            traverse.stop(size);
+
+            phase_timer erase(results[2]);
+            erase.stop(list.erase_every_other());
+          } break;
+
+          case vector_workload: {
+            phase_timer build(results[0]);
+            {
+                typename Containers::vector v =
+                    Containers::make_vector(r);
+                for (std::size_t i = 0; i < size; ++i)
+                    v.emplace_back(text, string_length);
+                sink = long(v.back().size());
+            }
+            build.stop(size);
+          } break;
+
+          case string_workload: {
+            phase_timer append(results[0]);
+            {
+                typename Containers::string s = Containers::make_string(r);
+                for (std::size_t i = 0; i < size; ++i)
+                    s.push_back(char('a' + i % 26));
+                sink = long(s.size());
+            }
+            append.stop(size);
+          } break;
+        }
+        resource.end_repetition();
+    }
+}
+
+// Run one combination on `threads` threads and write, to `results`, the
+// per-thread average of each phase's time and the totals of its ops and
+// heap allocations.
+void run_combination(workload_kind kind, std::size_t size,
+                     resource_kind rkind, int threads, std::size_t ops,
+                     phase_result *results)
+{
+    std::unique_ptr<memory_resource> shared;
+    if (threads > 1 && rkind == sync_pool)
+        shared.reset(new pmr::synchronized_pool_resource());
+
+    std::vector<phase_result> per_thread(3 * threads, phase_result());
+    auto body = [&](int t) {
+        bench_resource resource(rkind, shared.get());
+        phase_result *out = &per_thread[3 * t];
+        if (rkind == std_alloc)
+            run_workload<std_containers>(kind, size, ops, resource, out);
+        else
+            run_workload<pmr_containers>(kind, size, ops, resource, out);
+    };
+
+    if (threads == 1)
+        body(0);
+    else {
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t)
+            pool.emplace_back(body, t);
+        for (std::thread& th : pool)
+            th.join();
+    }
+
+    for (int p = 0; p < 3; ++p) {
+        results[p] = phase_result();
+        for (int t = 0; t < threads; ++t) {
+            results[p].m_ns          += per_thread[3 * t + p].m_ns;
+            results[p].m_ops         += per_thread[3 * t + p].m_ops;
+            results[p].m_heap_allocs += per_thread[3 * t + p].m_heap_allocs;
+        }
+        results[p].m_ns /= threads;
+    }
+}
+
+// What a child process reports to its parent.
+struct child_report {
+    phase_result m_phases[3];
+    long         m_peak_rss_kb;
+};
+
+// Return true if `w` should run, given the workload filters.
+bool workload_selected(const workload&                 w,
+                       const std::vector<const char*>& filters)
+{
+    if (filters.empty())
+        return true;
+    for (const char *f : filters)
+        for (int p = 0; p < 3 && w.m_phases[p]; ++p)
+            if (std::strstr(w.m_phases[p], f))
+                return true;
+    return false;
+}
+
+} // close unnamed namespace
+
+int main(int argc, char *argv[])
+{
+    int         threads = 1;
+    std::size_t ops     = std::size_t(1) << 21;
+    int         arg     = 1;
+    for ( ; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if (0 == std::strcmp(argv[arg], "--threads"))
+            threads = std::max(1, std::atoi(argv[arg + 1]));
+        else if (0 == std::strcmp(argv[arg], "--ops"))
+            ops = std::max(1L, std::atol(argv[arg + 1]));
+        else
+            break;
+    }
+    if (arg < argc && argv[arg][0] == '-') {
+        std::fprintf(stderr,
+                     "usage: %s [--threads N] [--ops N] [FILTER...]\n",
+                     argv[0]);
+        return 2;
+    }
+    std::vector<const char*> workload_filters;
+    bool                     resource_selected[num_resource_kinds];
+    bool                     any_resource_filter = false;
+    for (int rk = 0; rk < num_resource_kinds; ++rk)
+        resource_selected[rk] = false;
+    for ( ; arg < argc; ++arg) {
+        int rk = 0;
+        while (rk < num_resource_kinds &&
+               std::strcmp(argv[arg], resource_names[rk]))
+            ++rk;
+        if (rk < num_resource_kinds)
+            resource_selected[rk] = any_resource_filter = true;
+        else
+            workload_filters.push_back(argv[arg]);
+    }
+
+    std::printf("%d thread(s), %zu ops per thread per run\n", threads, ops);
+    std::printf("%-28s %6s  %-14s %9s %14s %13s\n", "workload", "size",
+                "resource", "ns/op", "heap allocs/op", "peak RSS KiB");
+
+    for (const workload& w : workloads) {
+        if (! workload_selected(w, workload_filters))
+            continue;
+        for (std::size_t size : sizes) {
+            for (int rk = 0; rk < num_resource_kinds; ++rk) {
+                // Other sizes are not pooled by `node_pool_resource`.
+                if (rk == node_pool && w.m_kind != slist_workload)
+                    continue;
+                if (any_resource_filter && ! resource_selected[rk])
+                    continue;
+
+                int fds[2];
+                if (::pipe(fds) != 0) {
+                    std::perror("pipe");
+                    return 1;
+                }
+                std::fflush(stdout);
+                pid_t pid = ::fork();
+                if (pid < 0) {
+                    std::perror("fork");
+                    return 1;
+                }
+                if (0 == pid) {
+                    ::close(fds[0]);
+                    child_report report = child_report();
+                    run_combination(w.m_kind, size, resource_kind(rk),
+                                    threads, ops, report.m_phases);
+                    struct rusage usage;
+                    ::getrusage(RUSAGE_SELF, &usage);
+                    report.m_peak_rss_kb = usage.ru_maxrss;
+                    ssize_t n = ::write(fds[1], &report, sizeof(report));
+                    ::_exit(n == ssize_t(sizeof(report)) ? 0 : 1);
+                }
+
+                ::close(fds[1]);
+                child_report report;
+                ssize_t n = ::read(fds[0], &report, sizeof(report));
+                ::close(fds[0]);
+                int status = 0;
+                ::waitpid(pid, &status, 0);
+                if (n != ssize_t(sizeof(report)) || status != 0) {
+                    std::fprintf(stderr, "%s/%zu/%s: run failed\n",
+                                 w.m_phases[0], size, resource_names[rk]);
+                    continue;
+                }
+
+                for (int p = 0; p < 3 && w.m_phases[p]; ++p) {
+                    const phase_result& r = report.m_phases[p];
+                    double per_thread_ops = double(r.m_ops) / threads;
+                    std::printf("%-28s %6zu  %-14s %9.2f %14.4f %13ld\n",
+                                w.m_phases[p], size, resource_names[rk],
+                                r.m_ns / per_thread_ops,
+                                double(r.m_heap_allocs) / r.m_ops,
+                                report.m_peak_rss_kb);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* End bench_suite.cpp */
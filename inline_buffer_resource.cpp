@@ -0,0 +1,15 @@
+/* inline_buffer_resource.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include "inline_buffer_resource.h"
+
+// If there is any non-template code in `inline_buffer_resource`, it would
+// go here.  If not, then this file remains empty, but nevertheless
+// validates that the header file has no syntax errors.
+
+/* End inline_buffer_resource.cpp */
@@ -0,0 +1,142 @@
+/* inline_buffer_resource.h                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#ifndef INCLUDED_INLINE_BUFFER_RESOURCE_DOT_H
+#define INCLUDED_INLINE_BUFFER_RESOURCE_DOT_H
+
+#include <polymorphic_allocator.h>
+
+namespace cpp17 {
+namespace pmr {
+
+// Memory resource that allocates from a buffer of `N` bytes embedded in the
+// resource itself and, once that is full, from an upstream resource.
+// Declared as a local variable, it gives any pmr container a small-buffer
+// optimization: a container that stays small never touches the heap.
+// Blocks in the buffer are allocated by bumping a pointer.  Freeing the
+// most recent block returns its space to the buffer, and freeing the last
+// live block empties the buffer, so a container that grows by reallocating
+// can reuse the buffer.  Other freed space in the buffer is not reused.
+// Blocks from upstream are returned to upstream when freed.  The most recent
+// block in the buffer can be resized in place with `try_expand`.  Not thread
+// safe.
+template <size_t N>
+class inline_buffer_resource : public memory_resource
+{
+    static_assert(N > 0, "inline_buffer_resource needs a buffer");
+
+    alignas(max_align_t) char m_buffer[N];
+    char                     *m_next;      // Next free byte of the buffer
+    size_t                    m_live;      // Live blocks in the buffer
+    memory_resource          *m_upstream;
+
+  public:
+    static constexpr size_t buffer_size = N;
+
+    explicit inline_buffer_resource(memory_resource *upstream =
+                                        get_default_resource())
+        : m_next(m_buffer), m_live(0), m_upstream(upstream) { }
+
+    inline_buffer_resource(const inline_buffer_resource&) = delete;
+    inline_buffer_resource& operator=(const inline_buffer_resource&) =
+        delete;
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+
+    // Return true if `p` points into the inline buffer.
+    bool is_inline(const void *p) const;
+
+    // Return the number of bytes of the buffer not yet handed out.
+    size_t inline_bytes_left() const { return m_buffer + N - m_next; }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const memory_resource& other) const noexcept override
+        { return this == &other; }
+
+    // The most recent block in the buffer can grow into the rest of the
+    // buffer or shrink; any other block in the buffer can only shrink.
+    // Blocks from upstream are resized by upstream.
+    bool  do_try_expand(void *p, size_t old_bytes, size_t new_bytes,
+                        size_t alignment) override;
+
+    template <class, class> friend class static_polymorphic_allocator;
+};
+
+}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// INLINE AND TEMPLATE FUNCTION IMPLEMENTATIONS
+///////////////////////////////////////////////////////////////////////////////
+
+template <size_t N>
+constexpr size_t cpp17::pmr::inline_buffer_resource<N>::buffer_size;
+
+template <size_t N>
+inline
+bool cpp17::pmr::inline_buffer_resource<N>::is_inline(const void *p) const
+{
+    // Compare addresses as integers, since `p` may point anywhere.  The end
+    // of the buffer, where a zero-byte block may be, is inside `*this`, so
+    // no upstream block starts there.
+    return uintptr_t(p) - uintptr_t(m_buffer) <= N;
+}
+
+template <size_t N>
+void *cpp17::pmr::inline_buffer_resource<N>::do_allocate(size_t bytes,
+                                                        size_t alignment)
+{
+    if (0 == alignment)
+        alignment = 1;
+    uintptr_t p = (uintptr_t(m_next) + alignment - 1) & ~(alignment - 1);
+    uintptr_t end = uintptr_t(m_buffer + N);
+    if (p > end || end - p < bytes)
+        return m_upstream->allocate(bytes, alignment);
+
+    m_next = reinterpret_cast<char*>(p + bytes);
+    ++m_live;
+    return reinterpret_cast<void*>(p);
+}
+
+template <size_t N>
+void cpp17::pmr::inline_buffer_resource<N>::do_deallocate(void   *p,
+                                                          size_t  bytes,
+                                                          size_t  alignment)
+{
+    if (! is_inline(p)) {
+        m_upstream->deallocate(p, bytes, alignment);
+        return;
+    }
+
+    if (0 == --m_live)
+        m_next = m_buffer;
+    else if (static_cast<char*>(p) + bytes == m_next)
+        m_next = static_cast<char*>(p);
+}
+
+template <size_t N>
+bool cpp17::pmr::inline_buffer_resource<N>::do_try_expand(void   *p,
+                                                          size_t  old_bytes,
+                                                          size_t  new_bytes,
+                                                          size_t  alignment)
+{
+    if (! is_inline(p))
+        return m_upstream->try_expand(p, old_bytes, new_bytes, alignment);
+
+    char *block = static_cast<char*>(p);
+    if (block + old_bytes != m_next)
+        return new_bytes <= old_bytes;
+    if (new_bytes > size_t(m_buffer + N - block))
+        return false;
+    m_next = block + new_bytes;
+    return true;
+}
+
+#endif // ! defined(INCLUDED_INLINE_BUFFER_RESOURCE_DOT_H)
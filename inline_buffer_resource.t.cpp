@@ -0,0 +1,192 @@
+/* inline_buffer_resource.t.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <inline_buffer_resource.h>
+#include <test_resource.h>
+#include <slist.h>
+#include <pmr_string.h>
+#include <pmr_vector.h>
+
+#include <cstring>
+#include <iostream>
+
+//==========================================================================
+//                  ASSERT TEST MACRO
+//--------------------------------------------------------------------------
+static int testStatus = 0;
+
+static void aSsErT(int c, const char *s, int i) {
+    if (c) {
+        std::cout << __FILE__ << ":" << i << ": error: " << s
+                  << "    (failed)" << std::endl;
+        if (testStatus >= 0 && testStatus <= 100) ++testStatus;
+    }
+}
+
+# define ASSERT(X) { aSsErT(!(X), #X, __LINE__); }
+//--------------------------------------------------------------------------
+#define LOOP_ASSERT(I,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\n"; \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP2_ASSERT(I,J,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " \
+                          << J << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP3_ASSERT(I,J,K,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\n";           \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP4_ASSERT(I,J,K,L,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP5_ASSERT(I,J,K,L,M,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J    \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\t" << #M << ": " << M << "\n";         \
+               aSsErT(1, #X, __LINE__); } }
+
+#define LOOP6_ASSERT(I,J,K,L,M,N,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J     \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": "  \
+                         << L << "\t" << #M << ": " << M << "\t" << #N     \
+                         << ": " << N << "\n"; aSsErT(1, #X, __LINE__); } }
+
+int main(int argc, char *argv[])
+{
+    using namespace cpp17::pmr;
+
+    std::cout << "Testing inline allocation\n";
+    {
+        test_resource tr;
+        inline_buffer_resource<256> ibr(&tr);
+        ASSERT(&tr == ibr.upstream_resource());
+        ASSERT(256 == ibr.inline_bytes_left());
+        ASSERT(ibr == ibr);
+        inline_buffer_resource<256> other(&tr);
+        ASSERT(ibr != other);
+
+        char *p1 = static_cast<char*>(ibr.allocate(10, 1));
+        ASSERT(ibr.is_inline(p1));
+        ASSERT(0 == (size_t(p1) & (alignof(max_align_t) - 1)));
+        char *p2 = static_cast<char*>(ibr.allocate(16, 8));
+        ASSERT(p1 + 16 == p2);
+        char *p3 = static_cast<char*>(ibr.allocate(1, 64));
+        ASSERT(ibr.is_inline(p3));
+        ASSERT(0 == (size_t(p3) & 63));
+        std::memset(p1, 0xcc, 10);
+        std::memset(p2, 0xcc, 16);
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // Freeing the most recent block returns its space.
+        size_t left = ibr.inline_bytes_left();
+        ibr.deallocate(p3, 1, 64);
+        ASSERT(left + 1 == ibr.inline_bytes_left());
+        ASSERT(p3 == ibr.allocate(8, 8));
+        ibr.deallocate(p3, 8, 8);
+
+        // Other freed space is reused once the buffer is empty.
+        ibr.deallocate(p1, 10, 1);
+        ASSERT(left + 1 == ibr.inline_bytes_left());
+        ibr.deallocate(p2, 16, 8);
+        ASSERT(256 == ibr.inline_bytes_left());
+        ASSERT(p1 == ibr.allocate(8, 8));
+        ibr.deallocate(p1, 8, 8);
+
+        // Requests that do not fit go upstream.
+        char *p4 = static_cast<char*>(ibr.allocate(200, 8));
+        ASSERT(ibr.is_inline(p4));
+        char *p5 = static_cast<char*>(ibr.allocate(100, 8));
+        ASSERT(! ibr.is_inline(p5));
+        ASSERT(1 == tr.blocks_outstanding());
+        std::memset(p5, 0xcc, 100);
+        ibr.deallocate(p5, 100, 8);
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // Zero-byte blocks, even at the end of the buffer, stay inline.
+        void *p6 = ibr.allocate(56, 8);
+        ASSERT(ibr.is_inline(p6));
+        ASSERT(0 == ibr.inline_bytes_left());
+        void *p7 = ibr.allocate(0, 8);
+        ASSERT(ibr.is_inline(p7));
+        ASSERT(0 == tr.blocks_outstanding());
+        ibr.deallocate(p7, 0, 8);
+        ibr.deallocate(p6, 56, 8);
+        ibr.deallocate(p4, 200, 8);
+        ASSERT(256 == ibr.inline_bytes_left());
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing try_expand\n";
+    {
+        test_resource tr;
+        inline_buffer_resource<128> ibr(&tr);
+        char *p1 = static_cast<char*>(ibr.allocate(16, 8));
+        char *p2 = static_cast<char*>(ibr.allocate(16, 8));
+
+        // The most recent block grows and shrinks within the buffer.
+        ASSERT(ibr.try_expand(p2, 16, 100, 8));
+        ASSERT(! ibr.try_expand(p2, 100, 113, 8));
+        ASSERT(ibr.try_expand(p2, 100, 112, 8));
+        ASSERT(0 == ibr.inline_bytes_left());
+        std::memset(p2, 0xcc, 112);
+        ASSERT(ibr.try_expand(p2, 112, 8, 8));
+        ASSERT(p2 + 8 == ibr.allocate(8, 8));
+
+        // Earlier blocks can only shrink.
+        ASSERT(! ibr.try_expand(p1, 16, 17, 8));
+        ASSERT(ibr.try_expand(p1, 16, 8, 8));
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing containers on an inline_buffer_resource\n";
+    {
+        test_resource tr;
+        {
+            // Small containers do not touch upstream.
+            inline_buffer_resource<1024> ibr(&tr);
+            vector<int> v(&ibr);
+            for (int i = 0; i < 100; ++i)
+                v.push_back(i);
+            string s("a string too long for the short-string buffer", &ibr);
+            slist<int> lst(&ibr);
+            for (int i = 0; i < 10; ++i)
+                lst.push_back(i);
+            ASSERT(100 == v.size());
+            ASSERT(99 == v.back());
+            ASSERT(10 == lst.size());
+            ASSERT(ibr.is_inline(v.data()));
+            ASSERT(ibr.is_inline(s.data()));
+            ASSERT(ibr.is_inline(&lst.front()));
+            ASSERT(0 == tr.blocks_outstanding());
+        }
+        {
+            // A vector that grows beyond the buffer moves upstream, and
+            // then its old buffer space is reused.
+            inline_buffer_resource<256> ibr(&tr);
+            vector<int> v(&ibr);
+            for (int i = 0; i < 1000; ++i)
+                v.push_back(i);
+            ASSERT(! ibr.is_inline(v.data()));
+            ASSERT(1 == tr.blocks_outstanding());
+            ASSERT(256 == ibr.inline_bytes_left());
+            for (int i = 0; i < 1000; ++i)
+                LOOP_ASSERT(i, i == v[i]);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << (0 == testStatus ? "PASSED" : "FAILED") << std::endl;
+
+    return testStatus;
+}
+
+/* End inline_buffer_resource.t.cpp */
@@ -0,0 +1,235 @@
+/* latency_resource.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include "latency_resource.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+
+namespace {
+
+// Return the upper bound of the bucket in `counts` (which sum to
+// the nonzero `total`) holding the sample of rank `q * total`,
+// but no more than `max`.
+std::uint64_t find_percentile(const std::uint64_t *counts,
+                              std::uint64_t        total,
+                              std::uint64_t        max,
+                              double               q) {
+  std::uint64_t rank = std::uint64_t(q * total + 0.5);
+  rank = std::max(rank, std::uint64_t(1));
+  std::uint64_t seen = 0;
+  unsigned i = 0;
+  for ( ; i < latency_histogram::num_buckets - 1; ++i)
+    if ((seen += counts[i]) >= rank)
+      break;
+  return std::min(latency_histogram::bucket_upper(i), max);
+}
+
+}
+
+constexpr unsigned latency_histogram::num_buckets;
+constexpr unsigned latency_resource::num_size_classes;
+constexpr unsigned latency_resource::all_size_classes;
+
+latency_histogram::latency_histogram() {
+  clear();
+}
+
+void latency_histogram::clear() {
+  for (unsigned i = 0; i < num_buckets; ++i)
+    m_buckets[i].store(0, std::memory_order_relaxed);
+  m_max.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t latency_histogram::count() const {
+  std::uint64_t ret = 0;
+  for (unsigned i = 0; i < num_buckets; ++i)
+    ret += bucket_count(i);
+  return ret;
+}
+
+std::uint64_t latency_histogram::max() const {
+  return m_max.load(std::memory_order_relaxed);
+}
+
+std::uint64_t latency_histogram::bucket_count(unsigned i) const {
+  return m_buckets[i].load(std::memory_order_relaxed);
+}
+
+std::uint64_t latency_histogram::percentile(double q) const {
+  // Take a snapshot, so that the rank is computed over the same
+  // counts that are then searched.
+  std::uint64_t counts[num_buckets], total = 0;
+  for (unsigned i = 0; i < num_buckets; ++i)
+    total += counts[i] = bucket_count(i);
+  return total ? find_percentile(counts, total, max(), q) : 0;
+}
+
+std::uint64_t latency_histogram::bucket_lower(unsigned i) {
+  if (i < 16)
+    return i;
+  unsigned e = 4 + (i - 16) / 8, sub = (i - 16) % 8;
+  return std::uint64_t(8 + sub) << (e - 3);
+}
+
+std::uint64_t latency_histogram::bucket_upper(unsigned i) {
+  if (i == num_buckets - 1)
+    return ~std::uint64_t(0);
+  return bucket_lower(i + 1) - 1;
+}
+
+latency_resource::latency_resource(pmr::memory_resource *parent)
+  : m_parent(parent)
+  , m_histograms(nullptr)
+{
+  // The histograms are large (2 * 16 * 2.4 KB), so they are not
+  // embedded in the resource object.
+  const size_t n = 2 * num_size_classes;
+  m_histograms = static_cast<latency_histogram*>(
+    m_parent->allocate(n * sizeof(latency_histogram),
+                       alignof(latency_histogram)));
+  for (size_t i = 0; i < n; ++i)
+    ::new(&m_histograms[i]) latency_histogram();
+}
+
+latency_resource::~latency_resource() {
+  const size_t n = 2 * num_size_classes;
+  for (size_t i = 0; i < n; ++i)
+    m_histograms[i].~latency_histogram();
+  m_parent->deallocate(m_histograms, n * sizeof(latency_histogram),
+                       alignof(latency_histogram));
+}
+
+pmr::memory_resource *latency_resource::parent() const {
+  return m_parent;
+}
+
+const latency_histogram&
+latency_resource::histogram(operation op,
+                            unsigned  size_class) const {
+  return m_histograms[op * num_size_classes + size_class];
+}
+
+std::uint64_t latency_resource::count(operation op,
+                                      unsigned  size_class) const {
+  if (size_class != all_size_classes)
+    return histogram(op, size_class).count();
+
+  std::uint64_t ret = 0;
+  for (unsigned c = 0; c < num_size_classes; ++c)
+    ret += histogram(op, c).count();
+  return ret;
+}
+
+double latency_resource::percentile_ns(operation op, double q,
+                                       unsigned size_class) const {
+  if (size_class != all_size_classes)
+    return histogram(op, size_class).percentile(q) * ns_per_tick();
+
+  // Merge the size classes' buckets, then search the merged
+  // counts.
+  std::uint64_t counts[latency_histogram::num_buckets] = { };
+  std::uint64_t total = 0, max = 0;
+  for (unsigned c = 0; c < num_size_classes; ++c) {
+    const latency_histogram& h = histogram(op, c);
+    for (unsigned i = 0; i < latency_histogram::num_buckets; ++i) {
+      std::uint64_t n = h.bucket_count(i);
+      counts[i] += n;
+      total     += n;
+    }
+    max = std::max(max, h.max());
+  }
+  return total ? find_percentile(counts, total, max, q) *
+    ns_per_tick() : 0;
+}
+
+void latency_resource::dump(std::ostream& os) const {
+  static const char *const op_names[] = { "allocate", "deallocate" };
+
+  os << "op          bytes<=       count     p50 ns     p99 ns"
+        "    p999 ns     max ns\n";
+  for (int op = allocate_op; op <= deallocate_op; ++op) {
+    for (unsigned c = 0; c < num_size_classes; ++c) {
+      const latency_histogram& h = histogram(operation(op), c);
+      std::uint64_t n = h.count();
+      if (0 == n)
+        continue;
+      os << std::left << std::setw(10) << op_names[op] << std::right;
+      if (c == num_size_classes - 1)
+        os << std::setw(10) << "inf";
+      else
+        os << std::setw(10) << (size_t(16) << c);
+      os << std::setw(12) << n << std::fixed << std::setprecision(1)
+         << std::setw(11) << h.percentile(0.5)   * ns_per_tick()
+         << std::setw(11) << h.percentile(0.99)  * ns_per_tick()
+         << std::setw(11) << h.percentile(0.999) * ns_per_tick()
+         << std::setw(11) << h.max()             * ns_per_tick()
+         << '\n';
+      os.unsetf(std::ios::floatfield);
+    }
+  }
+}
+
+void latency_resource::clear() {
+  for (unsigned i = 0; i < 2 * num_size_classes; ++i)
+    m_histograms[i].clear();
+}
+
+double latency_resource::ns_per_tick() {
+#if defined(__x86_64__) || defined(__i386__)
+  // Calibrate the time-stamp counter against `steady_clock` once,
+  // over about 10 ms.
+  static const double ratio = [] {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start      = clock::now();
+    std::uint64_t     start_tick = now();
+    clock::time_point stop;
+    do
+      stop = clock::now();
+    while (stop - start < std::chrono::milliseconds(10));
+    std::uint64_t ticks = now() - start_tick;
+    return std::chrono::duration<double, std::nano>(stop - start)
+      .count() / ticks;
+  }();
+  return ratio;
+#else
+  return std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::duration(1)).count();
+#endif
+}
+
+void *latency_resource::do_allocate(size_t bytes,
+                                    size_t alignment) {
+  std::uint64_t start = now();
+  void *ret = m_parent->allocate(bytes, alignment);
+  hist(allocate_op, size_class(bytes)).record(now() - start);
+  return ret;
+}
+
+void latency_resource::do_deallocate(void *p, size_t bytes,
+                                     size_t alignment) {
+  std::uint64_t start = now();
+  m_parent->deallocate(p, bytes, alignment);
+  hist(deallocate_op, size_class(bytes)).record(now() - start);
+}
+
+bool latency_resource::do_is_equal(
+  const pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
+
+/* End latency_resource.cpp */
+
+// For best result when pasting into PowerPoint, set indent to 2
+// and right-most column to 64.
+//
+// Local Variables:
+// c-basic-offset: 2
+// fill-column: 64
+// End:
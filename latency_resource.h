@@ -0,0 +1,176 @@
+/* latency_resource.h                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#ifndef INCLUDED_LATENCY_RESOURCE_DOT_H
+#define INCLUDED_LATENCY_RESOURCE_DOT_H
+
+#include <polymorphic_allocator.h>
+#include <cstdint>
+#include <iosfwd>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+using std::size_t;
+namespace pmr = cpp17::pmr;
+
+// Histogram of durations, in clock ticks, with log-linear
+// buckets: values below 16 each have their own bucket; above
+// that, each power of 2 is split into 8 buckets, so that a
+// bucket's bounds are within 12.5% of each other.  Values of
+// 2^40 ticks or more share the last bucket.  Recording is
+// lock-free and may be done concurrently with reading.
+class latency_histogram
+{
+public:
+  static constexpr unsigned num_buckets = 16 + 36 * 8;
+
+  latency_histogram();
+  latency_histogram(const latency_histogram&) = delete;
+  latency_histogram& operator=(const latency_histogram&) = delete;
+
+  void record(std::uint64_t ticks);
+  void clear();
+
+  std::uint64_t count() const;
+  std::uint64_t max() const;
+  std::uint64_t bucket_count(unsigned i) const;
+
+  // Return the upper bound of the bucket holding the sample of
+  // rank `q * count()` (`0 <= q <= 1`), but no more than `max()`.
+  // Return 0 if there are no samples.
+  std::uint64_t percentile(double q) const;
+
+  static unsigned      bucket(std::uint64_t ticks);
+  static std::uint64_t bucket_lower(unsigned i);
+  static std::uint64_t bucket_upper(unsigned i);
+
+private:
+  std::atomic<std::uint64_t> m_buckets[num_buckets];
+  std::atomic<std::uint64_t> m_max;
+};
+
+// Resource that times each allocation and deallocation by its
+// parent and records the durations in a `latency_histogram` per
+// operation and size class.  Timing uses the time-stamp counter
+// where available (otherwise `steady_clock`); ticks are
+// converted to nanoseconds only when reading.  The parent must
+// be thread safe if this resource is shared by threads.
+class latency_resource : public pmr::memory_resource
+{
+public:
+  enum operation { allocate_op, deallocate_op };
+
+  // Size class `i` holds blocks of up to `16 << i` bytes; the
+  // last class holds all larger blocks.
+  static constexpr unsigned num_size_classes = 16;
+  static constexpr unsigned all_size_classes = num_size_classes;
+
+  explicit latency_resource(pmr::memory_resource *parent =
+                              pmr::get_default_resource());
+  latency_resource(const latency_resource&) = delete;
+  latency_resource& operator=(const latency_resource&) = delete;
+  ~latency_resource();
+
+  pmr::memory_resource *parent() const;
+
+  const latency_histogram& histogram(operation op,
+                                     unsigned  size_class) const;
+
+  // Number of operations `op` timed in `size_class`.
+  std::uint64_t count(operation op,
+                      unsigned  size_class = all_size_classes) const;
+
+  // Return the latency, in nanoseconds, not exceeded by fraction
+  // `q` of operations `op` in `size_class`.
+  double percentile_ns(operation op, double q,
+                       unsigned size_class = all_size_classes) const;
+
+  // Print count, p50, p99, p999 and max for each non-empty
+  // operation and size class.
+  void dump(std::ostream& os) const;
+
+  void clear();
+
+  static unsigned size_class(size_t bytes);
+
+  static std::uint64_t now();
+  static double ns_per_tick();
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes,
+                     size_t alignment) override;
+  bool do_is_equal(const pmr::memory_resource& other)
+                                        const noexcept override;
+
+  template <class, class>
+  friend class cpp17::pmr::static_polymorphic_allocator;
+
+private:
+  latency_histogram& hist(operation op, unsigned size_class);
+
+  pmr::memory_resource  *m_parent;
+  latency_histogram     *m_histograms;  // Allocated from parent
+};
+
+///////////////////////////////////////////////////////////////////
+// INLINE FUNCTION IMPLEMENTATIONS
+///////////////////////////////////////////////////////////////////
+
+inline unsigned latency_histogram::bucket(std::uint64_t ticks) {
+  if (ticks < 16)
+    return unsigned(ticks);
+  unsigned e = 63 - __builtin_clzll(ticks);
+  if (e >= 40)
+    return num_buckets - 1;
+  return 16 + (e - 4) * 8 + unsigned(ticks >> (e - 3)) - 8;
+}
+
+inline void latency_histogram::record(std::uint64_t ticks) {
+  m_buckets[bucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+  std::uint64_t m = m_max.load(std::memory_order_relaxed);
+  while (ticks > m &&
+         ! m_max.compare_exchange_weak(m, ticks,
+                                       std::memory_order_relaxed))
+    ;
+}
+
+inline std::uint64_t latency_resource::now() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+inline unsigned latency_resource::size_class(size_t bytes) {
+  if (bytes <= 16)
+    return 0;
+  unsigned c = 64 - __builtin_clzll((unsigned long long)(bytes - 1))
+    - 4;
+  return c < num_size_classes ? c : num_size_classes - 1;
+}
+
+inline latency_histogram&
+latency_resource::hist(operation op, unsigned size_class) {
+  return m_histograms[op * num_size_classes + size_class];
+}
+
+#endif // ! defined(INCLUDED_LATENCY_RESOURCE_DOT_H)
+
+// For best result when pasting into PowerPoint, set indent to 2
+// and right-most column to 64.
+//
+// Local Variables:
+// c-basic-offset: 2
+// fill-column: 64
+// End:
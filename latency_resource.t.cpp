@@ -0,0 +1,212 @@
+/* latency_resource.t.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <latency_resource.h>
+#include <test_resource.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//==========================================================================
+//                  ASSERT TEST MACRO
+//--------------------------------------------------------------------------
+static int testStatus = 0;
+
+static void aSsErT(int c, const char *s, int i) {
+    if (c) {
+        std::cout << __FILE__ << ":" << i << ": error: " << s
+                  << "    (failed)" << std::endl;
+        if (testStatus >= 0 && testStatus <= 100) ++testStatus;
+    }
+}
+
+# define ASSERT(X) { aSsErT(!(X), #X, __LINE__); }
+//--------------------------------------------------------------------------
+#define LOOP_ASSERT(I,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\n"; \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP2_ASSERT(I,J,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " \
+                          << J << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP3_ASSERT(I,J,K,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\n";           \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP4_ASSERT(I,J,K,L,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP5_ASSERT(I,J,K,L,M,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J    \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\t" << #M << ": " << M << "\n";         \
+               aSsErT(1, #X, __LINE__); } }
+
+#define LOOP6_ASSERT(I,J,K,L,M,N,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J     \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": "  \
+                         << L << "\t" << #M << ": " << M << "\t" << #N     \
+                         << ": " << N << "\n"; aSsErT(1, #X, __LINE__); } }
+
+// Force instantiation of whole classes
+template class cpp17::pmr::static_polymorphic_allocator<
+    double, latency_resource>;
+
+int main(int argc, char *argv[])
+{
+    std::cout << "Testing latency_histogram buckets\n";
+    {
+        ASSERT(0 == latency_histogram::bucket(0));
+        ASSERT(15 == latency_histogram::bucket(15));
+        ASSERT(16 == latency_histogram::bucket(16));
+        ASSERT(16 == latency_histogram::bucket(17));
+        ASSERT(17 == latency_histogram::bucket(18));
+        ASSERT(latency_histogram::num_buckets - 1 ==
+               latency_histogram::bucket(~std::uint64_t(0)));
+
+        // Buckets are contiguous and each holds the values mapped to it.
+        for (unsigned i = 0; i < latency_histogram::num_buckets - 1; ++i) {
+            std::uint64_t lo = latency_histogram::bucket_lower(i);
+            std::uint64_t hi = latency_histogram::bucket_upper(i);
+            LOOP_ASSERT(i, lo <= hi);
+            LOOP_ASSERT(i, latency_histogram::bucket_lower(i + 1) == hi + 1);
+            LOOP_ASSERT(i, i == latency_histogram::bucket(lo));
+            LOOP_ASSERT(i, i == latency_histogram::bucket(hi));
+            // Relative width no more than 1/8
+            LOOP_ASSERT(i, i < 16 || (hi - lo + 1) * 8 <= lo);
+        }
+    }
+
+    std::cout << "Testing latency_histogram percentiles\n";
+    {
+        latency_histogram h;
+        ASSERT(0 == h.count());
+        ASSERT(0 == h.percentile(0.5));
+
+        for (std::uint64_t v = 1; v <= 1000; ++v)
+            h.record(v);
+        ASSERT(1000 == h.count());
+        ASSERT(1000 == h.max());
+
+        std::uint64_t p50 = h.percentile(0.5);
+        std::uint64_t p99 = h.percentile(0.99);
+        LOOP_ASSERT(p50, 500 <= p50 && p50 <= 500 + 500 / 8);
+        LOOP_ASSERT(p99, 990 <= p99 && p99 <= 1000);
+        ASSERT(1000 == h.percentile(1.0));
+        ASSERT(1 == h.percentile(0.0));
+
+        // A single outlier shows up in the tail only.
+        h.record(1000000);
+        ASSERT(1000000 == h.max());
+        ASSERT(h.percentile(0.99) < 1024);
+        ASSERT(1000000 == h.percentile(1.0));
+
+        h.clear();
+        ASSERT(0 == h.count());
+        ASSERT(0 == h.max());
+    }
+
+    std::cout << "Testing size classes\n";
+    {
+        ASSERT(0 == latency_resource::size_class(0));
+        ASSERT(0 == latency_resource::size_class(16));
+        ASSERT(1 == latency_resource::size_class(17));
+        ASSERT(1 == latency_resource::size_class(32));
+        ASSERT(2 == latency_resource::size_class(33));
+        ASSERT(14 == latency_resource::size_class(16 << 14));
+        ASSERT(15 == latency_resource::size_class((16 << 14) + 1));
+        ASSERT(15 == latency_resource::size_class(size_t(1) << 40));
+    }
+
+    std::cout << "Testing latency_resource\n";
+    {
+        test_resource tr;
+        {
+            latency_resource lr(&tr);
+            ASSERT(&tr == lr.parent());
+            ASSERT(lr == lr);
+            ASSERT(0 < lr.ns_per_tick());
+            ASSERT(0 == lr.count(latency_resource::allocate_op));
+            ASSERT(0 == lr.percentile_ns(latency_resource::allocate_op,
+                                         0.5));
+
+            size_t tr_blocks = tr.blocks_outstanding();
+            void *blocks[100];
+            for (int i = 0; i < 100; ++i)
+                blocks[i] = lr.allocate(i < 90 ? 8 : 1000);
+            ASSERT(tr_blocks + 100 == tr.blocks_outstanding());
+
+            typedef latency_resource lr_t;
+            ASSERT(100 == lr.count(lr_t::allocate_op));
+            ASSERT(90  == lr.count(lr_t::allocate_op, 0));
+            ASSERT(10  == lr.count(lr_t::allocate_op,
+                                   lr_t::size_class(1000)));
+            ASSERT(0   == lr.count(lr_t::deallocate_op));
+
+            for (int i = 0; i < 100; ++i)
+                lr.deallocate(blocks[i], i < 90 ? 8 : 1000);
+            ASSERT(tr_blocks == tr.blocks_outstanding());
+            ASSERT(100 == lr.count(lr_t::deallocate_op));
+
+            double p50  = lr.percentile_ns(lr_t::allocate_op, 0.5);
+            double p99  = lr.percentile_ns(lr_t::allocate_op, 0.99);
+            double p999 = lr.percentile_ns(lr_t::allocate_op, 0.999);
+            double pmax = lr.histogram(lr_t::allocate_op, 0).max() *
+                lr.ns_per_tick();
+            LOOP2_ASSERT(p50, p99, 0 < p50 && p50 <= p99);
+            LOOP2_ASSERT(p99, p999, p99 <= p999);
+            LOOP2_ASSERT(p50, pmax,
+                         lr.percentile_ns(lr_t::allocate_op, 0.5, 0) <=
+                         pmax);
+
+            std::ostringstream os;
+            lr.dump(os);
+            std::string out = os.str();
+            ASSERT(std::string::npos != out.find("p999"));
+            ASSERT(std::string::npos != out.find("allocate          16"));
+            ASSERT(std::string::npos != out.find("deallocate      1024"));
+            ASSERT(std::string::npos == out.find("allocate          32"));
+
+            lr.clear();
+            ASSERT(0 == lr.count(lr_t::allocate_op));
+            ASSERT(0 == lr.count(lr_t::deallocate_op));
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing latency_resource with threads\n";
+    {
+        latency_resource lr(cpp17::pmr::new_delete_resource_singleton());
+        const int num_threads = 4, iterations = 10000;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t)
+            threads.emplace_back([&lr]{
+                for (int i = 0; i < iterations; ++i)
+                    lr.deallocate(lr.allocate(i % 200 + 1), i % 200 + 1);
+            });
+        for (std::thread& th : threads)
+            th.join();
+        ASSERT(num_threads * iterations ==
+               lr.count(latency_resource::allocate_op));
+        ASSERT(num_threads * iterations ==
+               lr.count(latency_resource::deallocate_op));
+    }
+
+    std::cout << (0 == testStatus ? "PASSED" : "FAILED") << std::endl;
+
+    return testStatus;
+}
+
+/* End latency_resource.t.cpp */
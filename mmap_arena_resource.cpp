@@ -0,0 +1,176 @@
+/* mmap_arena_resource.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include "mmap_arena_resource.h"
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+
+constexpr size_t mmap_arena_resource::huge_page_size;
+constexpr size_t mmap_arena_resource::default_reserve;
+
+namespace {
+
+inline std::uintptr_t align_up(std::uintptr_t n,
+                               size_t         alignment) {
+  return (n + alignment - 1) & ~std::uintptr_t(alignment - 1);
+}
+
+}
+
+mmap_arena_resource::mmap_arena_resource(size_t reserve_bytes,
+                                         bool   hugetlb)
+  : m_range(nullptr)
+  , m_next(nullptr)
+  , m_committed_end(nullptr)
+  , m_end(nullptr)
+  , m_reserve(reserve_bytes)
+  , m_hugetlb(hugetlb)
+  , m_reserved(0)
+  , m_committed(0)
+{
+}
+
+mmap_arena_resource::~mmap_arena_resource() {
+  release();
+}
+
+void mmap_arena_resource::release() {
+  while (m_range) {
+    range *prev = m_range->m_prev;
+    ::munmap(m_range, m_range->m_bytes);
+    m_range = prev;
+  }
+  m_next = m_committed_end = m_end = nullptr;
+  m_reserved = m_committed = 0;
+}
+
+bool mmap_arena_resource::uses_hugetlb() const {
+  return m_range && m_range->m_hugetlb;
+}
+
+void mmap_arena_resource::new_range(size_t bytes,
+                                    size_t alignment) {
+  const size_t header_bytes =
+    align_up(sizeof(range), alignof(cpp17::max_align_t));
+
+  // Leave room for the header, the block and its alignment,
+  // rounded up to whole huge pages.
+  const size_t max_bytes = ~size_t(0) / 4;
+  if (bytes > max_bytes || alignment > max_bytes)
+    throw std::bad_alloc();
+  size_t size = header_bytes + bytes + alignment;
+  if (size < m_reserve)
+    size = m_reserve;
+  size = align_up(size, huge_page_size);
+
+  void *base = MAP_FAILED;
+  bool  huge = false;
+#ifdef MAP_HUGETLB
+  // Huge pages for the whole range are reserved from the pool
+  // here, so this fails if the pool is too small.
+  if (m_hugetlb) {
+    base = ::mmap(nullptr, size, PROT_NONE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                  -1, 0);
+    huge = base != MAP_FAILED;
+  }
+#endif
+  if (! huge) {
+    // Over-reserve, then trim to a huge-page-aligned range.
+    size_t map_bytes = size + huge_page_size;
+    void  *raw = ::mmap(nullptr, map_bytes, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS |
+                        MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED)
+      throw std::bad_alloc();
+    char *first = static_cast<char*>(raw);
+    char *last  = first + map_bytes;
+    base = reinterpret_cast<void*>(
+      align_up(std::uintptr_t(first), huge_page_size));
+    char *end = static_cast<char*>(base) + size;
+    if (base != first)
+      ::munmap(first, static_cast<char*>(base) - first);
+    if (end != last)
+      ::munmap(end, last - end);
+#ifdef MADV_HUGEPAGE
+    // Fails harmlessly if transparent huge pages are disabled.
+    ::madvise(base, size, MADV_HUGEPAGE);
+#endif
+  }
+
+  // Commit the first huge page, which holds the header.
+  if (0 != ::mprotect(base, huge_page_size,
+                      PROT_READ | PROT_WRITE)) {
+    ::munmap(base, size);
+    throw std::bad_alloc();
+  }
+
+  char *first = static_cast<char*>(base);
+  m_range = new (base) range{ m_range, size, huge };
+  m_next          = first + header_bytes;
+  m_committed_end = first + huge_page_size;
+  m_end           = first + size;
+  m_reserved     += size;
+  m_committed    += huge_page_size;
+}
+
+void mmap_arena_resource::commit(char *end) {
+  char *new_end = reinterpret_cast<char*>(
+    align_up(std::uintptr_t(end), huge_page_size));
+  if (new_end > m_end)
+    new_end = m_end;
+  if (0 != ::mprotect(m_committed_end, new_end - m_committed_end,
+                      PROT_READ | PROT_WRITE))
+    throw std::bad_alloc();
+  m_committed    += new_end - m_committed_end;
+  m_committed_end = new_end;
+}
+
+void *mmap_arena_resource::do_allocate(size_t bytes,
+                                       size_t alignment) {
+  if (0 == alignment)
+    alignment = 1;
+  std::uintptr_t p   = align_up(std::uintptr_t(m_next),
+                                alignment);
+  std::uintptr_t end = std::uintptr_t(m_end);
+  if (! m_range || p > end || end - p < bytes) {
+    new_range(bytes, alignment);
+    p = align_up(std::uintptr_t(m_next), alignment);
+  }
+
+  char *ret = reinterpret_cast<char*>(p);
+  if (ret + bytes > m_committed_end)
+    commit(ret + bytes);
+  m_next = ret + bytes;
+  return ret;
+}
+
+void mmap_arena_resource::do_deallocate(void *, size_t, size_t) {
+  // Memory is reclaimed only by `release()` or the destructor.
+}
+
+bool mmap_arena_resource::do_is_equal(
+  const pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
+
+bool mmap_arena_resource::do_deallocate_is_noop() const noexcept {
+  return true;
+}
+
+/* End mmap_arena_resource.cpp */
+
+// For best result when pasting into PowerPoint, set indent to 2
+// and right-most column to 64.
+//
+// Local Variables:
+// c-basic-offset: 2
+// fill-column: 64
+// End:
@@ -0,0 +1,106 @@
+/* mmap_arena_resource.h                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#ifndef INCLUDED_MMAP_ARENA_RESOURCE_DOT_H
+#define INCLUDED_MMAP_ARENA_RESOURCE_DOT_H
+
+#include <polymorphic_allocator.h>
+
+using std::size_t;
+namespace pmr = cpp17::pmr;
+
+// Resource that hands out memory from large virtual address
+// ranges reserved directly from the operating system with
+// `mmap`, so that the blocks, and the data structures built from
+// them, can be backed by 2 MiB huge pages and need few TLB
+// entries.  A range is reserved without access and made usable
+// ("committed") one huge page at a time as allocation reaches
+// it; the kernel supplies the memory when it is first touched.
+// Ranges are aligned to the huge page size and advised to use
+// transparent huge pages (`MADV_HUGEPAGE`).  If `hugetlb` is
+// true, ranges are first mapped from the preallocated huge page
+// pool (`MAP_HUGETLB`), falling back to transparent huge pages
+// if the pool has too few pages.
+//
+// Like `monotonic_buffer_resource`, it is an arena: deallocation
+// does nothing, and memory is reclaimed only by `release()` or
+// the destructor, which unmap every range.  A request that does
+// not fit in the current range starts a new one of at least
+// `reserve_bytes` bytes.  It is meant as the upstream resource
+// of a pool or monotonic resource.  It is not thread safe.
+class mmap_arena_resource : public pmr::memory_resource
+{
+public:
+  static constexpr size_t huge_page_size  = size_t(2) << 20;
+  static constexpr size_t default_reserve = size_t(1) << 30;
+
+  explicit mmap_arena_resource(size_t reserve_bytes =
+                                 default_reserve,
+                               bool   hugetlb = false);
+  mmap_arena_resource(const mmap_arena_resource&) = delete;
+  mmap_arena_resource& operator=(const mmap_arena_resource&)
+                                                       = delete;
+  ~mmap_arena_resource();
+
+  // Unmap every range.
+  void release();
+
+  // Bytes of address space reserved and committed, including
+  // unused space at the end of earlier ranges.
+  size_t reserved() const { return m_reserved; }
+  size_t committed() const { return m_committed; }
+
+  // Return true if the current range comes from the huge page
+  // pool.
+  bool uses_hugetlb() const;
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes,
+                     size_t alignment) override;
+  bool do_is_equal(const pmr::memory_resource& other)
+                                        const noexcept override;
+  bool do_deallocate_is_noop() const noexcept override;
+
+  template <class, class>
+  friend class cpp17::pmr::static_polymorphic_allocator;
+
+private:
+  // Header at the start of each range.
+  struct range {
+    range  *m_prev;
+    size_t  m_bytes;
+    bool    m_hugetlb;
+  };
+
+  // Reserve a range with room for `bytes` bytes aligned to
+  // `alignment` and make it current.
+  void new_range(size_t bytes, size_t alignment);
+
+  // Commit the current range up to at least `end`.
+  void commit(char *end);
+
+  range  *m_range;          // Current range, or null
+  char   *m_next;           // Next free byte of current range
+  char   *m_committed_end;  // End of committed part of range
+  char   *m_end;            // End of current range
+  size_t  m_reserve;
+  bool    m_hugetlb;
+  size_t  m_reserved;
+  size_t  m_committed;
+};
+
+#endif // ! defined(INCLUDED_MMAP_ARENA_RESOURCE_DOT_H)
+
+// For best result when pasting into PowerPoint, set indent to 2
+// and right-most column to 64.
+//
+// Local Variables:
+// c-basic-offset: 2
+// fill-column: 64
+// End:
@@ -0,0 +1,161 @@
+/* mmap_arena_resource.t.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <mmap_arena_resource.h>
+#include <pool_resource.h>
+#include <slist.h>
+
+#include <cstring>
+#include <iostream>
+
+//==========================================================================
+//                  ASSERT TEST MACRO
+//--------------------------------------------------------------------------
+static int testStatus = 0;
+
+static void aSsErT(int c, const char *s, int i) {
+    if (c) {
+        std::cout << __FILE__ << ":" << i << ": error: " << s
+                  << "    (failed)" << std::endl;
+        if (testStatus >= 0 && testStatus <= 100) ++testStatus;
+    }
+}
+
+# define ASSERT(X) { aSsErT(!(X), #X, __LINE__); }
+//--------------------------------------------------------------------------
+#define LOOP_ASSERT(I,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\n"; \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP2_ASSERT(I,J,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " \
+                          << J << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP3_ASSERT(I,J,K,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\n";           \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP4_ASSERT(I,J,K,L,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP5_ASSERT(I,J,K,L,M,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J    \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\t" << #M << ": " << M << "\n";         \
+               aSsErT(1, #X, __LINE__); } }
+
+#define LOOP6_ASSERT(I,J,K,L,M,N,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J     \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": "  \
+
+// Force instantiation of whole classes
+template class cpp17::pmr::static_polymorphic_allocator<
+    double, mmap_arena_resource>;
+
+int main(int argc, char *argv[])
+{
+    using namespace cpp17::pmr;
+
+    const size_t huge = mmap_arena_resource::huge_page_size;
+
+    std::cout << "Testing allocation and lazy commit\n";
+    {
+        mmap_arena_resource ar(64 * huge);
+        ASSERT(0 == ar.reserved());
+        ASSERT(0 == ar.committed());
+        ASSERT(ar.deallocate_is_noop());
+        ASSERT(ar == ar);
+        mmap_arena_resource other;
+        ASSERT(ar != other);
+
+        // The range is reserved on first use and committed a huge
+        // page at a time.
+        char *p1 = static_cast<char*>(ar.allocate(100, 8));
+        ASSERT(p1);
+        ASSERT(64 * huge == ar.reserved());
+        ASSERT(huge == ar.committed());
+        std::memset(p1, 0xcc, 100);
+        char *p2 = static_cast<char*>(ar.allocate(100, 8));
+        ASSERT(p1 + 104 == p2);
+        std::memset(p2, 0xcc, 100);
+        ar.deallocate(p1, 100, 8);  // No-op
+
+        char *p3 = static_cast<char*>(ar.allocate(3 * huge, 64));
+        ASSERT(0 == (size_t(p3) & 63));
+        ASSERT(4 * huge == ar.committed());
+        std::memset(p3, 0xcc, 3 * huge);
+        ASSERT(64 * huge == ar.reserved());
+
+        // Alignments up to and beyond the huge page size
+        for (size_t align = 1; align <= 2 * huge; align *= 2) {
+            char *p = static_cast<char*>(ar.allocate(10, align));
+            LOOP_ASSERT(align, 0 == (size_t(p) & (align - 1)));
+            std::memset(p, 0xcc, 10);
+        }
+
+        // A request that does not fit starts a new range.
+        char *big = static_cast<char*>(ar.allocate(100 * huge, 16));
+        LOOP_ASSERT(ar.reserved(), ar.reserved() > 164 * huge);
+        std::memset(big, 0xcc, 100 * huge);
+        ASSERT(p2[0] == char(0xcc));  // Earlier ranges remain mapped
+
+        ar.release();
+        ASSERT(0 == ar.reserved());
+        ASSERT(0 == ar.committed());
+
+        // Usable after release
+        char *p4 = static_cast<char*>(ar.allocate(10, 8));
+        ASSERT(p4);
+        std::memset(p4, 0xcc, 10);
+        ASSERT(huge == ar.committed());
+    }
+
+    std::cout << "Testing explicit huge pages\n";
+    {
+        // Without a huge page pool, the arena falls back to
+        // transparent huge pages.
+        mmap_arena_resource ar(huge, true);
+        char *p = static_cast<char*>(ar.allocate(huge / 2));
+        ASSERT(p);
+        std::memset(p, 0xcc, huge / 2);
+        p = static_cast<char*>(ar.allocate(huge));
+        std::memset(p, 0xcc, huge);
+        ASSERT(2 * huge <= ar.reserved());
+    }
+
+    std::cout << "Testing mmap_arena_resource as upstream\n";
+    {
+        mmap_arena_resource ar(8 * huge);
+        {
+            unsynchronized_pool_resource pool(&ar);
+            slist<int> lst(&pool);
+            for (int i = 0; i < 10000; ++i)
+                lst.push_back(i);
+            int i = 0;
+            for (int v : lst)
+                LOOP_ASSERT(i, v == i++);
+            ASSERT(ar.committed() > 0);
+        }
+        {
+            monotonic_buffer_resource mr(&ar);
+            slist<int> lst(&mr);
+            lst.insert(lst.end(), 10000, 7);
+            ASSERT(10000 == lst.size());
+        }
+        ASSERT(8 * huge == ar.reserved());
+    }
+
+    std::cout << (0 == testStatus ? "PASSED" : "FAILED") << std::endl;
+
+    return testStatus;
+}
+
+/* End mmap_arena_resource.t.cpp */
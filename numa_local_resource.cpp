@@ -0,0 +1,298 @@
+/* numa_local_resource.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include "numa_local_resource.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <utility>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+constexpr size_t numa_local_resource::default_node_bytes;
+
+namespace {
+
+// Memory policy from <linux/mempolicy.h>: prefer the given node,
+// but fall back to others when it is out of memory.
+const int mpol_preferred = 1;
+
+inline std::uintptr_t align_up(std::uintptr_t n,
+                               size_t         alignment) {
+  return (n + alignment - 1) & ~std::uintptr_t(alignment - 1);
+}
+
+// Bind the pages of `p` to `node`.  Failure (e.g., in a container
+// that forbids it) leaves the memory unbound, which is harmless.
+void bind(void *p, size_t bytes, unsigned node) {
+  unsigned long mask = 1;
+  if (node >= 8 * sizeof(mask))
+    return;
+  mask <<= node;
+  ::syscall(SYS_mbind, p, bytes, mpol_preferred, &mask,
+            8 * sizeof(mask) + 1, 0);
+}
+
+unsigned node_zero() {
+  return 0;
+}
+
+unsigned getcpu_node() {
+  unsigned cpu, node;
+  if (0 != ::getcpu(&cpu, &node))
+    return 0;
+  return node;
+}
+
+size_t page_size() {
+  static const size_t size = size_t(::sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+// Upstream of one node's pool: allocates by bumping a pointer
+// through the node's window, committing the window in steps of
+// `commit_bytes` as it goes.  Its pool serializes the calls.
+class node_arena : public pmr::memory_resource
+{
+public:
+  static constexpr size_t commit_bytes = size_t(2) << 20;
+
+  node_arena(char *window, size_t bytes)
+    : m_next(window), m_committed_end(window)
+    , m_end(window + bytes), m_committed(0) { }
+
+  size_t committed() const {
+    return m_committed.load(std::memory_order_relaxed);
+  }
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    std::uintptr_t p   = align_up(std::uintptr_t(m_next),
+                                  alignment ? alignment : 1);
+    std::uintptr_t end = std::uintptr_t(m_end);
+    if (p > end || end - p < bytes)
+      throw std::bad_alloc();
+    char *block_end = reinterpret_cast<char*>(p + bytes);
+    if (block_end > m_committed_end)
+      commit(block_end);
+    m_next = block_end;
+    return reinterpret_cast<void*>(p);
+  }
+
+  void do_deallocate(void *, size_t, size_t) override {
+    // The window is unmapped by `numa_local_resource`.
+  }
+
+  bool do_is_equal(const pmr::memory_resource& other)
+                                       const noexcept override {
+    return this == &other;
+  }
+
+private:
+  // Make the window usable up to at least `end`.
+  void commit(char *end) {
+    char *new_end = reinterpret_cast<char*>(
+      align_up(std::uintptr_t(end), commit_bytes));
+    if (new_end > m_end)
+      new_end = m_end;
+    if (0 != ::mprotect(m_committed_end, new_end - m_committed_end,
+                        PROT_READ | PROT_WRITE))
+      throw std::bad_alloc();
+    m_committed.fetch_add(new_end - m_committed_end,
+                          std::memory_order_relaxed);
+    m_committed_end = new_end;
+  }
+
+  char                *m_next;
+  char                *m_committed_end;
+  char                *m_end;
+  std::atomic<size_t>  m_committed;  // Read by any thread
+};
+
+constexpr size_t node_arena::commit_bytes;
+
+}
+
+struct numa_local_resource::node {
+  node_arena                      m_arena;
+  pmr::synchronized_pool_resource m_pool;
+
+  node(char *window, size_t bytes)
+    : m_arena(window, bytes)
+    , m_pool(pmr::pool_options(0, size_t(1) << 16), &m_arena) { }
+};
+
+numa_topology numa_topology::system() {
+  // The online nodes are listed as ranges, such as "0-1,3", so
+  // the last number is the highest node.
+  unsigned num_nodes = 1;
+  if (std::FILE *f =
+        std::fopen("/sys/devices/system/node/online", "r")) {
+    unsigned n;
+    char     sep;
+    while (1 == std::fscanf(f, "%u", &n)) {
+      if (n >= num_nodes)
+        num_nodes = n + 1;
+      if (1 != std::fscanf(f, "%c", &sep))
+        break;
+    }
+    std::fclose(f);
+  }
+
+  numa_topology ret = { num_nodes,
+                        num_nodes > 1 ? getcpu_node : node_zero,
+                        num_nodes > 1 };
+  return ret;
+}
+
+numa_topology numa_topology::fake(unsigned   num_nodes,
+                                  unsigned (*current_node)()) {
+  numa_topology ret = { num_nodes, current_node, false };
+  return ret;
+}
+
+numa_local_resource::numa_local_resource(
+  const numa_topology& topology,
+  size_t               node_bytes)
+  : m_topology(topology)
+  , m_node_bytes(align_up(node_bytes ? node_bytes : 1, page_size()))
+  , m_base(nullptr)
+  , m_largest_pooled(0)
+{
+  if (0 == m_topology.m_num_nodes)
+    m_topology.m_num_nodes = 1;
+  if (! m_topology.m_current_node)
+    m_topology.m_current_node = node_zero;
+  if (m_node_bytes > ~size_t(0) / m_topology.m_num_nodes)
+    throw std::bad_alloc();
+
+  // Reserve every node's window without access, so that it is
+  // not charged against the commit limit even under strict
+  // overcommit.  Each node's arena commits its window as it
+  // grows.
+  size_t total = m_node_bytes * m_topology.m_num_nodes;
+  void  *base  = ::mmap(nullptr, total, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS |
+                        MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED)
+    throw std::bad_alloc();
+  m_base = static_cast<char*>(base);
+
+  try {
+    m_nodes.reserve(m_topology.m_num_nodes);
+    for (unsigned i = 0; i < m_topology.m_num_nodes; ++i) {
+      char *window = m_base + i * m_node_bytes;
+      if (m_topology.m_bind)
+        bind(window, m_node_bytes, i);
+      std::unique_ptr<node> n(new node(window, m_node_bytes));
+      m_nodes.push_back(std::move(n));
+    }
+  }
+  catch (...) {
+    m_nodes.clear();
+    ::munmap(m_base, total);
+    throw;
+  }
+  m_largest_pooled =
+    m_nodes[0]->m_pool.options().largest_required_pool_block;
+}
+
+numa_local_resource::~numa_local_resource() {
+  m_nodes.clear();
+  ::munmap(m_base, m_node_bytes * m_topology.m_num_nodes);
+}
+
+unsigned numa_local_resource::num_nodes() const {
+  return m_topology.m_num_nodes;
+}
+
+size_t numa_local_resource::committed() const {
+  size_t ret = 0;
+  for (const std::unique_ptr<node>& n : m_nodes)
+    ret += n->m_arena.committed();
+  return ret;
+}
+
+unsigned numa_local_resource::current_node() const {
+  unsigned ret = m_topology.m_current_node();
+  return ret < m_topology.m_num_nodes ?
+         ret : ret % m_topology.m_num_nodes;
+}
+
+unsigned numa_local_resource::node_of(const void *p) const {
+  std::uintptr_t offset = std::uintptr_t(p) -
+                          std::uintptr_t(m_base);
+  if (p < m_base ||
+      offset >= m_node_bytes * m_topology.m_num_nodes)
+    return m_topology.m_num_nodes;
+  return unsigned(offset / m_node_bytes);
+}
+
+bool numa_local_resource::pooled(size_t bytes,
+                                 size_t alignment) const {
+  return bytes <= m_largest_pooled &&
+         alignment <= alignof(cpp17::max_align_t);
+}
+
+void *numa_local_resource::do_allocate(size_t bytes,
+                                       size_t alignment) {
+  if (pooled(bytes, alignment))
+    return m_nodes[current_node()]->m_pool.allocate(bytes,
+                                                    alignment);
+
+  // Map a large block by itself, over-reserving and trimming if
+  // it is aligned beyond a page.
+  size_t size  = align_up(bytes ? bytes : 1, page_size());
+  size_t extra = alignment > page_size() ? alignment : 0;
+  if (size < bytes || size + extra < size)
+    throw std::bad_alloc();
+  void *raw = ::mmap(nullptr, size + extra, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED)
+    throw std::bad_alloc();
+  char *first = static_cast<char*>(raw);
+  char *ret   = first;
+  if (extra) {
+    ret = reinterpret_cast<char*>(
+      align_up(std::uintptr_t(first), alignment));
+    if (ret != first)
+      ::munmap(first, ret - first);
+    if (ret + size != first + size + extra)
+      ::munmap(ret + size, first + extra - ret);
+  }
+  if (m_topology.m_bind)
+    bind(ret, size, current_node());
+  return ret;
+}
+
+void numa_local_resource::do_deallocate(void *p, size_t bytes,
+                                        size_t alignment) {
+  if (pooled(bytes, alignment))
+    m_nodes[node_of(p)]->m_pool.deallocate(p, bytes, alignment);
+  else
+    ::munmap(p, align_up(bytes ? bytes : 1, page_size()));
+}
+
+bool numa_local_resource::do_is_equal(
+  const pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
+
+/* End numa_local_resource.cpp */
+
+// For best result when pasting into PowerPoint, set indent to 2
+// and right-most column to 64.
+//
+// Local Variables:
+// c-basic-offset: 2
+// fill-column: 64
+// End:
@@ -0,0 +1,106 @@
+/* numa_local_resource.h                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#ifndef INCLUDED_NUMA_LOCAL_RESOURCE_DOT_H
+#define INCLUDED_NUMA_LOCAL_RESOURCE_DOT_H
+
+#include <polymorphic_allocator.h>
+#include <pool_resource.h>
+#include <memory>
+#include <vector>
+
+using std::size_t;
+namespace pmr = cpp17::pmr;
+
+// The NUMA nodes of a machine, as seen by `numa_local_resource`.
+// `system()` describes the machine it runs on, finding the
+// calling thread's node with `getcpu`; without NUMA, it has a
+// single node.  `fake()` describes a made-up machine, for
+// testing on any box: `current_node` says which node the calling
+// thread is on, and memory is not bound to nodes.
+struct numa_topology {
+  unsigned   m_num_nodes;
+  unsigned (*m_current_node)();  // Node of the calling thread
+  bool       m_bind;             // Bind memory to nodes
+
+  static numa_topology system();
+  static numa_topology fake(unsigned   num_nodes,
+                            unsigned (*current_node)());
+};
+
+// Thread-safe resource that allocates from memory on the NUMA node
+// of the calling thread.  Each node has a
+// `synchronized_pool_resource` whose upstream is an arena in a
+// window of `node_bytes` bytes of address space reserved for that
+// node and bound to it with `mbind`.  The window is reserved
+// without access and committed 2 MiB at a time as the arena
+// grows, so that only memory in use counts against the commit
+// limit; the kernel supplies it when first touched.  A small
+// block is returned to the pool of the node that owns it, found
+// from its address, whichever thread frees it.  Blocks too big or
+// too aligned for the pools are mapped individually, bound to the
+// calling thread's node, and unmapped when freed.  Allocation
+// throws `bad_alloc` if a node's window is full.  If binding is
+// not permitted, memory is used unbound.
+class numa_local_resource : public pmr::memory_resource
+{
+public:
+  static constexpr size_t default_node_bytes = size_t(16) << 30;
+
+  explicit numa_local_resource(const numa_topology& topology =
+                                 numa_topology::system(),
+                               size_t node_bytes =
+                                 default_node_bytes);
+  numa_local_resource(const numa_local_resource&) = delete;
+  numa_local_resource& operator=(const numa_local_resource&)
+                                                       = delete;
+  ~numa_local_resource();
+
+  unsigned num_nodes() const;
+
+  // Bytes of the nodes' windows committed so far.
+  size_t committed() const;
+
+  // Return the node of the calling thread.
+  unsigned current_node() const;
+
+  // Return the node whose window holds `p`, or `num_nodes()` if
+  // none does (`p` is a large block).
+  unsigned node_of(const void *p) const;
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes,
+                     size_t alignment) override;
+  bool do_is_equal(const pmr::memory_resource& other)
+                                        const noexcept override;
+
+  template <class, class>
+  friend class cpp17::pmr::static_polymorphic_allocator;
+
+private:
+  struct node;
+
+  bool pooled(size_t bytes, size_t alignment) const;
+
+  numa_topology                       m_topology;
+  size_t                              m_node_bytes;
+  char                               *m_base;   // Windows
+  std::vector<std::unique_ptr<node> > m_nodes;
+  size_t                              m_largest_pooled;
+};
+
+#endif // ! defined(INCLUDED_NUMA_LOCAL_RESOURCE_DOT_H)
+
+// For best result when pasting into PowerPoint, set indent to 2
+// and right-most column to 64.
+//
+// Local Variables:
+// c-basic-offset: 2
+// fill-column: 64
+// End:
@@ -0,0 +1,225 @@
+/* numa_local_resource.t.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <numa_local_resource.h>
+#include <slist.h>
+
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+//==========================================================================
+//                  ASSERT TEST MACRO
+//--------------------------------------------------------------------------
+static int testStatus = 0;
+
+static void aSsErT(int c, const char *s, int i) {
+    if (c) {
+        std::cout << __FILE__ << ":" << i << ": error: " << s
+                  << "    (failed)" << std::endl;
+        if (testStatus >= 0 && testStatus <= 100) ++testStatus;
+    }
+}
+
+# define ASSERT(X) { aSsErT(!(X), #X, __LINE__); }
+//--------------------------------------------------------------------------
+#define LOOP_ASSERT(I,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\n"; \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP2_ASSERT(I,J,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " \
+                          << J << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP3_ASSERT(I,J,K,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\n";           \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP4_ASSERT(I,J,K,L,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP5_ASSERT(I,J,K,L,M,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J    \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\t" << #M << ": " << M << "\n";         \
+               aSsErT(1, #X, __LINE__); } }
+
+#define LOOP6_ASSERT(I,J,K,L,M,N,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J     \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": "  \
+
+// Fake topology in which each thread says which node it is on.
+thread_local unsigned t_node = 0;
+
+unsigned fake_current_node()
+{
+    return t_node;
+}
+
+// Force instantiation of whole classes
+template class cpp17::pmr::static_polymorphic_allocator<
+    double, numa_local_resource>;
+
+int main(int argc, char *argv[])
+{
+    using namespace cpp17::pmr;
+
+    const size_t window = size_t(64) << 20;
+
+    std::cout << "Testing system topology\n";
+    {
+        numa_topology topo = numa_topology::system();
+        ASSERT(topo.m_num_nodes >= 1);
+        ASSERT(topo.m_current_node() < topo.m_num_nodes);
+
+        numa_local_resource r(topo, window);
+        ASSERT(topo.m_num_nodes == r.num_nodes());
+        ASSERT(r == r);
+        void *p = r.allocate(40);
+        LOOP_ASSERT(r.node_of(p), r.node_of(p) < r.num_nodes());
+        std::memset(p, 0xcc, 40);
+        r.deallocate(p, 40);
+    }
+
+    std::cout << "Testing lazy commit\n";
+    {
+        // The default windows are reserved without access, so nothing
+        // is committed until the pools need it, and then only a little.
+        numa_local_resource r(numa_topology::fake(2, fake_current_node));
+        ASSERT(0 == r.committed());
+
+        t_node = 0;
+        char *p = static_cast<char*>(r.allocate(1000));
+        std::memset(p, 0xcc, 1000);
+        size_t committed = r.committed();
+        ASSERT(0 < committed);
+        ASSERT(committed <= size_t(4) << 20);
+
+        // Allocating more on the other node commits its window, too.
+        t_node = 1;
+        void *q = r.allocate(1000);
+        ASSERT(1 == r.node_of(q));
+        ASSERT(committed < r.committed());
+
+        // Filling a node's pools commits more of its window.
+        t_node = 0;
+        std::vector<void*> blocks;
+        for (int i = 0; i < 200; ++i)
+            blocks.push_back(r.allocate(60000));
+        for (void *b : blocks)
+            std::memset(b, 0xcc, 60000);
+        ASSERT(size_t(12) << 20 <= r.committed());
+        for (void *b : blocks)
+            r.deallocate(b, 60000);
+        r.deallocate(q, 1000);
+        r.deallocate(p, 1000);
+    }
+
+    std::cout << "Testing routing by node\n";
+    {
+        numa_local_resource r(numa_topology::fake(2, fake_current_node),
+                              window);
+        ASSERT(2 == r.num_nodes());
+        numa_local_resource other(numa_topology::fake(2,
+                                                      fake_current_node),
+                                  window);
+        ASSERT(r != other);
+
+        t_node = 0;
+        ASSERT(0 == r.current_node());
+        void *p0 = r.allocate(40);
+        ASSERT(0 == r.node_of(p0));
+
+        t_node = 1;
+        void *p1 = r.allocate(40);
+        ASSERT(1 == r.node_of(p1));
+
+        // Nodes beyond the topology wrap around.
+        t_node = 3;
+        ASSERT(1 == r.current_node());
+
+        // A block freed on another node goes back to its own node.
+        t_node = 1;
+        r.deallocate(p0, 40);
+        void *p2 = r.allocate(40);
+        ASSERT(1 == r.node_of(p2));
+        ASSERT(p0 != p2);
+        t_node = 0;
+        ASSERT(p0 == r.allocate(40));
+        r.deallocate(p0, 40);
+        r.deallocate(p1, 40);
+        r.deallocate(p2, 40);
+
+        // Large and over-aligned blocks are mapped by themselves.
+        const size_t aligns[] = { 8, 64, 4096, size_t(2) << 20 };
+        for (size_t align : aligns) {
+            char *big = static_cast<char*>(r.allocate(1000000, align));
+            LOOP_ASSERT(align, 0 == (size_t(big) & (align - 1)));
+            LOOP_ASSERT(align, 2 == r.node_of(big));
+            std::memset(big, 0xcc, 1000000);
+            r.deallocate(big, 1000000, align);
+        }
+        void *small = r.allocate(1, 256);
+        ASSERT(0 == (size_t(small) & 255));
+        ASSERT(2 == r.node_of(small));
+        r.deallocate(small, 1, 256);
+    }
+
+    std::cout << "Testing numa_local_resource with threads\n";
+    {
+        numa_local_resource r(numa_topology::fake(2, fake_current_node),
+                              window);
+        const int num_threads = 4, nodes_per_list = 10000;
+        std::vector<slist<int> > lists;
+        lists.reserve(num_threads);  // Copies would use the default
+        for (int t = 0; t < num_threads; ++t)
+            lists.emplace_back(&r);
+
+        // Each thread builds a list on its own node.
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t)
+            threads.emplace_back([&lists, t]{
+                t_node = t % 2;
+                for (int i = 0; i < nodes_per_list; ++i)
+                    lists[t].push_back(i);
+            });
+        for (std::thread& th : threads)
+            th.join();
+
+        for (int t = 0; t < num_threads; ++t) {
+            LOOP_ASSERT(t, nodes_per_list == int(lists[t].size()));
+            int i = 0;
+            for (const int& v : lists[t]) {
+                LOOP2_ASSERT(t, i, v == i);
+                LOOP3_ASSERT(t, i, r.node_of(&v),
+                             unsigned(t % 2) == r.node_of(&v));
+                ++i;
+            }
+        }
+
+        // The lists are freed by threads on other nodes.
+        threads.clear();
+        for (int t = 0; t < num_threads; ++t)
+            threads.emplace_back([&lists, t]{
+                t_node = (t + 1) % 2;
+                lists[t].resize(0);
+            });
+        for (std::thread& th : threads)
+            th.join();
+    }
+
+    std::cout << (0 == testStatus ? "PASSED" : "FAILED") << std::endl;
+
+    return testStatus;
+}
+
+/* End numa_local_resource.t.cpp */
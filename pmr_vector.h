@@ -9,17 +9,648 @@
 #ifndef INCLUDED_PMR_VECTOR_DOT_H
 #define INCLUDED_PMR_VECTOR_DOT_H
 
-#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
 #include <polymorphic_allocator.h>
 
 namespace cpp17 {
 namespace pmr {
 
-    // C++17 vector container that uses a polymorphic allocator
+    // C++17 vector container that uses a polymorphic allocator.  It has the
+    // interface of `std::vector<Tp, polymorphic_allocator<Tp>>`, but it
+    // manages its own buffer so that, as an extension, it can grow and
+    // shrink the buffer in place.  Before moving its elements to a new
+    // buffer, it asks the memory resource to resize the current one (see
+    // `memory_resource::try_expand`), so that a vector at the top of an
+    // arena grows without copying, and when it does move, it takes the
+    // whole block the resource provides (see
+    // `memory_resource::allocate_at_least`), so that a resource that rounds
+    // requests up causes fewer reallocations.  `shrink_to_fit` likewise
+    // tries to shrink in place.  Iterators are pointers.
     template <class Tp>
-    using vector = std::vector<Tp, polymorphic_allocator<Tp>>;
+    class vector
+    {
+      public:
+        using value_type             = Tp;
+        using allocator_type         = polymorphic_allocator<Tp>;
+        using size_type              = size_t;
+        using difference_type        = ptrdiff_t;
+        using reference              = Tp&;
+        using const_reference        = Tp const&;
+        using pointer                = Tp*;
+        using const_pointer          = Tp const*;
+        using iterator               = Tp*;
+        using const_iterator         = Tp const*;
+        using reverse_iterator       = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
+        vector() noexcept : vector(allocator_type()) { }
+        explicit vector(const allocator_type& a) noexcept
+            : m_begin(nullptr), m_end(nullptr), m_end_of_storage(nullptr)
+            , m_allocator(a) { }
+        explicit vector(size_type n, const allocator_type& a = {});
+        vector(size_type n, const Tp& v, const allocator_type& a = {});
+        template <class InputIt, class = typename
+                      enable_if<! is_integral<InputIt>::value>::type>
+            vector(InputIt first, InputIt last,
+                   const allocator_type& a = {});
+        vector(std::initializer_list<Tp> il, const allocator_type& a = {});
+        vector(const vector& other, const allocator_type& a = {});
+        vector(vector&& other) noexcept;
+        vector(vector&& other, const allocator_type& a);
+        ~vector();
+
+        vector& operator=(const vector& other);
+        vector& operator=(vector&& other);
+        vector& operator=(std::initializer_list<Tp> il)
+            { assign(il); return *this; }
+        void swap(vector& other) noexcept;
+
+        // Replace the contents, assigning over existing elements and
+        // inserting or erasing only the difference.
+        template <class InputIt, class = typename
+                      enable_if<! is_integral<InputIt>::value>::type>
+            void assign(InputIt first, InputIt last);
+        void assign(size_type n, const Tp& v);
+        void assign(std::initializer_list<Tp> il)
+            { assign(il.begin(), il.end()); }
+
+        allocator_type get_allocator() const noexcept { return m_allocator; }
+
+        iterator       begin()         noexcept { return m_begin; }
+        iterator       end()           noexcept { return m_end; }
+        const_iterator begin()   const noexcept { return m_begin; }
+        const_iterator end()     const noexcept { return m_end; }
+        const_iterator cbegin()  const noexcept { return m_begin; }
+        const_iterator cend()    const noexcept { return m_end; }
+
+        reverse_iterator       rbegin()        noexcept
+            { return reverse_iterator(end()); }
+        reverse_iterator       rend()          noexcept
+            { return reverse_iterator(begin()); }
+        const_reverse_iterator rbegin()  const noexcept
+            { return const_reverse_iterator(end()); }
+        const_reverse_iterator rend()    const noexcept
+            { return const_reverse_iterator(begin()); }
+        const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+        const_reverse_iterator crend()   const noexcept { return rend(); }
+
+        bool      empty()    const noexcept { return m_begin == m_end; }
+        size_type size()     const noexcept { return m_end - m_begin; }
+        size_type capacity() const noexcept
+            { return m_end_of_storage - m_begin; }
+        size_type max_size() const noexcept
+            { return numeric_limits<difference_type>::max() / sizeof(Tp); }
+
+        // Make room for at least `n` elements, growing the buffer in place
+        // if the resource allows it.
+        void reserve(size_type n);
+
+        // Reduce the capacity to the size, shrinking the buffer in place if
+        // the resource allows it.
+        void shrink_to_fit();
+
+        void resize(size_type n);
+        void resize(size_type n, const Tp& v);
+
+        reference       operator[](size_type i)       { return m_begin[i]; }
+        const_reference operator[](size_type i) const { return m_begin[i]; }
+        reference       at(size_type i);
+        const_reference at(size_type i) const;
+
+        reference       front()       { return *m_begin; }
+        const_reference front() const { return *m_begin; }
+        reference       back()        { return m_end[-1]; }
+        const_reference back()  const { return m_end[-1]; }
+
+        Tp       *data()       noexcept { return m_begin; }
+        Tp const *data() const noexcept { return m_begin; }
+
+        template <class... Args>
+            void emplace_back(Args&&... args);
+        void push_back(const Tp& v) { emplace_back(v); }
+        void push_back(Tp&& v)      { emplace_back(std::move(v)); }
+        void pop_back() { m_allocator.destroy(--m_end); }
+
+        template <class... Args>
+            iterator emplace(const_iterator i, Args&&... args);
+        iterator insert(const_iterator i, const Tp& v)
+            { return emplace(i, v); }
+        iterator insert(const_iterator i, Tp&& v)
+            { return emplace(i, std::move(v)); }
+        iterator insert(const_iterator i, size_type n, const Tp& v);
+        template <class InputIt, class = typename
+                      enable_if<! is_integral<InputIt>::value>::type>
+            iterator insert(const_iterator i, InputIt first, InputIt last);
+        iterator insert(const_iterator i, std::initializer_list<Tp> il)
+            { return insert(i, il.begin(), il.end()); }
+
+        iterator erase(const_iterator b, const_iterator e);
+        iterator erase(const_iterator i) { return erase(i, i + 1); }
+        void clear() noexcept { erase(m_begin, m_end); }
+
+      private:
+        template <class InputIt>
+            void append_range(InputIt first, InputIt last,
+                              std::input_iterator_tag);
+        template <class FwdIt>
+            void append_range(FwdIt first, FwdIt last,
+                              std::forward_iterator_tag);
+
+        // Append `n` elements, constructing each in turn by calling
+        // `construct` with its address.  If they do not fit, the buffer is
+        // first grown in place or, failing that, replaced; the new elements
+        // are then constructed before the old ones are moved, so
+        // `construct` may copy existing elements.  If an exception is
+        // thrown, the vector is unchanged.
+        template <class Construct>
+            void append_n(size_type n, Construct construct);
+
+        // Return the capacity to grow to for `n` more elements: at least
+        // twice the size.  Throw `length_error` if the result would exceed
+        // `max_size()`.
+        size_type grown_capacity(size_type n) const;
+
+        // Try to change the capacity to at least `n`, but no less than the
+        // size, without moving the elements.
+        bool resize_in_place(size_type n);
+
+        // Move the elements to a new buffer with room for at least `n`
+        // elements, constructing `k` more after them by calling `construct`
+        // as for `append_n`.
+        template <class Construct>
+            void reallocate(size_type n, size_type k, Construct construct);
+
+        void destroy_range(Tp *first, Tp *last) noexcept;
+        void deallocate_buffer() noexcept;
+
+        Tp             *m_begin;
+        Tp             *m_end;
+        Tp             *m_end_of_storage;
+        allocator_type  m_allocator;
+    };
+
+    template <class Tp>
+    inline void swap(vector<Tp>& a, vector<Tp>& b) noexcept { a.swap(b); }
+
+    template <class Tp>
+    bool operator==(const vector<Tp>& a, const vector<Tp>& b);
+    template <class Tp>
+    bool operator!=(const vector<Tp>& a, const vector<Tp>& b);
+    template <class Tp>
+    bool operator<(const vector<Tp>& a, const vector<Tp>& b);
+    template <class Tp>
+    bool operator>(const vector<Tp>& a, const vector<Tp>& b);
+    template <class Tp>
+    bool operator<=(const vector<Tp>& a, const vector<Tp>& b);
+    template <class Tp>
+    bool operator>=(const vector<Tp>& a, const vector<Tp>& b);
+
+}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// INLINE AND TEMPLATE FUNCTION IMPLEMENTATIONS
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Tp>
+cpp17::pmr::vector<Tp>::vector(size_type n, const allocator_type& a)
+    : vector(a)
+{
+    resize(n);
+}
+
+template <class Tp>
+cpp17::pmr::vector<Tp>::vector(size_type n, const Tp& v,
+                               const allocator_type& a)
+    : vector(a)
+{
+    resize(n, v);
+}
+
+template <class Tp>
+template <class InputIt, class>
+cpp17::pmr::vector<Tp>::vector(InputIt first, InputIt last,
+                               const allocator_type& a)
+    : vector(a)
+{
+    // The destructor does not run if a constructor throws.
+    try {
+        append_range(first, last,
+            typename std::iterator_traits<InputIt>::iterator_category());
+    }
+    catch (...) {
+        clear();
+        deallocate_buffer();
+        throw;
+    }
+}
+
+template <class Tp>
+cpp17::pmr::vector<Tp>::vector(std::initializer_list<Tp> il,
+                               const allocator_type& a)
+    : vector(il.begin(), il.end(), a)
+{
+}
+
+template <class Tp>
+cpp17::pmr::vector<Tp>::vector(const vector& other, const allocator_type& a)
+    : vector(other.begin(), other.end(), a)
+{
+}
+
+template <class Tp>
+cpp17::pmr::vector<Tp>::vector(vector&& other) noexcept
+    : m_begin(other.m_begin), m_end(other.m_end)
+    , m_end_of_storage(other.m_end_of_storage)
+    , m_allocator(other.m_allocator)
+{
+    other.m_begin = other.m_end = other.m_end_of_storage = nullptr;
+}
+
+template <class Tp>
+cpp17::pmr::vector<Tp>::vector(vector&& other, const allocator_type& a)
+    : vector(a)
+{
+    operator=(std::move(other));
+}
+
+template <class Tp>
+cpp17::pmr::vector<Tp>::~vector()
+{
+    destroy_range(m_begin, m_end);
+    deallocate_buffer();
+}
+
+template <class Tp>
+cpp17::pmr::vector<Tp>&
+cpp17::pmr::vector<Tp>::operator=(const vector& other)
+{
+    if (&other != this)
+        assign(other.begin(), other.end());
+    return *this;
+}
+
+template <class Tp>
+cpp17::pmr::vector<Tp>&
+cpp17::pmr::vector<Tp>::operator=(vector&& other)
+{
+    if (&other == this)
+        return *this;
+    if (m_allocator == other.m_allocator) {
+        clear();
+        swap(other);
+    }
+    else {
+        // The buffer cannot change allocators, so move each element.
+        assign(std::make_move_iterator(other.begin()),
+               std::make_move_iterator(other.end()));
+        other.clear();
+    }
+    return *this;
+}
+
+template <class Tp>
+void cpp17::pmr::vector<Tp>::swap(vector& other) noexcept
+{
+    assert(m_allocator == other.m_allocator);
+    std::swap(m_begin, other.m_begin);
+    std::swap(m_end, other.m_end);
+    std::swap(m_end_of_storage, other.m_end_of_storage);
+}
+
+template <class Tp>
+template <class InputIt, class>
+void cpp17::pmr::vector<Tp>::assign(InputIt first, InputIt last)
+{
+    Tp *p = m_begin;
+    for (; p != m_end && first != last; ++p, ++first)
+        *p = *first;
+    if (first == last)
+        erase(p, m_end);
+    else
+        append_range(first, last,
+            typename std::iterator_traits<InputIt>::iterator_category());
+}
+
+template <class Tp>
+void cpp17::pmr::vector<Tp>::assign(size_type n, const Tp& v)
+{
+    Tp *p = m_begin;
+    for (; p != m_end && n > 0; ++p, --n)
+        *p = v;
+    if (0 == n)
+        erase(p, m_end);
+    else
+        append_n(n, [this, &v](Tp *q) { m_allocator.construct(q, v); });
+}
+
+template <class Tp>
+void cpp17::pmr::vector<Tp>::reserve(size_type n)
+{
+    if (n <= capacity())
+        return;
+    if (n > max_size())
+        throw std::length_error("pmr::vector::reserve");
+    if (! resize_in_place(n))
+        reallocate(n, 0, [](Tp *) { });
+}
+
+template <class Tp>
+void cpp17::pmr::vector<Tp>::shrink_to_fit()
+{
+    if (m_end == m_end_of_storage)
+        return;
+    if (empty()) {
+        deallocate_buffer();
+        m_begin = m_end = m_end_of_storage = nullptr;
+        return;
+    }
+
+    // Shrinking is only a request, so give up if the new buffer cannot be
+    // allocated.
+    try {
+        if (! resize_in_place(size()))
+            reallocate(size(), 0, [](Tp *) { });
+    }
+    catch (...) {
+    }
+}
+
+template <class Tp>
+void cpp17::pmr::vector<Tp>::resize(size_type n)
+{
+    if (n <= size())
+        erase(m_begin + n, m_end);
+    else
+        append_n(n - size(), [this](Tp *p) { m_allocator.construct(p); });
+}
+
+template <class Tp>
+void cpp17::pmr::vector<Tp>::resize(size_type n, const Tp& v)
+{
+    if (n <= size())
+        erase(m_begin + n, m_end);
+    else
+        append_n(n - size(), [this, &v](Tp *p) {
+                m_allocator.construct(p, v);
+            });
+}
+
+template <class Tp>
+typename cpp17::pmr::vector<Tp>::reference
+cpp17::pmr::vector<Tp>::at(size_type i)
+{
+    if (i >= size())
+        throw std::out_of_range("pmr::vector::at");
+    return m_begin[i];
+}
+
+template <class Tp>
+typename cpp17::pmr::vector<Tp>::const_reference
+cpp17::pmr::vector<Tp>::at(size_type i) const
+{
+    if (i >= size())
+        throw std::out_of_range("pmr::vector::at");
+    return m_begin[i];
+}
+
+template <class Tp>
+template <class... Args>
+inline
+void cpp17::pmr::vector<Tp>::emplace_back(Args&&... args)
+{
+    if (m_end != m_end_of_storage) {
+        m_allocator.construct(m_end, std::forward<Args>(args)...);
+        ++m_end;
+    }
+    else
+        append_n(1, [&](Tp *p) {
+                m_allocator.construct(p, std::forward<Args>(args)...);
+            });
+}
+
+// The insertions below append the new elements, which may then copy
+// existing ones, and rotate them into place.
+
+template <class Tp>
+template <class... Args>
+typename cpp17::pmr::vector<Tp>::iterator
+cpp17::pmr::vector<Tp>::emplace(const_iterator i, Args&&... args)
+{
+    size_type pos = i - m_begin;
+    emplace_back(std::forward<Args>(args)...);
+    std::rotate(m_begin + pos, m_end - 1, m_end);
+    return m_begin + pos;
+}
+
+template <class Tp>
+typename cpp17::pmr::vector<Tp>::iterator
+cpp17::pmr::vector<Tp>::insert(const_iterator i, size_type n, const Tp& v)
+{
+    size_type pos = i - m_begin, old_size = size();
+    append_n(n, [this, &v](Tp *p) { m_allocator.construct(p, v); });
+    std::rotate(m_begin + pos, m_begin + old_size, m_end);
+    return m_begin + pos;
+}
+
+template <class Tp>
+template <class InputIt, class>
+typename cpp17::pmr::vector<Tp>::iterator
+cpp17::pmr::vector<Tp>::insert(const_iterator i, InputIt first,
+                               InputIt last)
+{
+    size_type pos = i - m_begin, old_size = size();
+    append_range(first, last,
+        typename std::iterator_traits<InputIt>::iterator_category());
+    std::rotate(m_begin + pos, m_begin + old_size, m_end);
+    return m_begin + pos;
+}
+
+template <class Tp>
+typename cpp17::pmr::vector<Tp>::iterator
+cpp17::pmr::vector<Tp>::erase(const_iterator b, const_iterator e)
+{
+    Tp *first = m_begin + (b - m_begin);
+    Tp *last  = m_begin + (e - m_begin);
+    if (first != last) {
+        Tp *new_end = std::move(last, m_end, first);
+        destroy_range(new_end, m_end);
+        m_end = new_end;
+    }
+    return first;
+}
+
+template <class Tp>
+template <class InputIt>
+void cpp17::pmr::vector<Tp>::append_range(InputIt first, InputIt last,
+                                          std::input_iterator_tag)
+{
+    // The length of a single-pass range is unknown, so append the elements
+    // one at a time.
+    for (; first != last; ++first)
+        emplace_back(*first);
 }
+
+template <class Tp>
+template <class FwdIt>
+void cpp17::pmr::vector<Tp>::append_range(FwdIt first, FwdIt last,
+                                          std::forward_iterator_tag)
+{
+    size_type n = std::distance(first, last);
+    append_n(n, [this, &first](Tp *p) {
+            m_allocator.construct(p, *first);
+            ++first;
+        });
+}
+
+template <class Tp>
+template <class Construct>
+void cpp17::pmr::vector<Tp>::append_n(size_type n, Construct construct)
+{
+    if (n > size_type(m_end_of_storage - m_end)) {
+        size_type new_capacity = grown_capacity(n);
+        if (! resize_in_place(new_capacity)) {
+            reallocate(new_capacity, n, construct);
+            return;
+        }
+    }
+
+    Tp *old_end = m_end;
+    try {
+        for (; n > 0; --n, ++m_end)
+            construct(m_end);
+    }
+    catch (...) {
+        destroy_range(old_end, m_end);
+        m_end = old_end;
+        throw;
+    }
+}
+
+template <class Tp>
+typename cpp17::pmr::vector<Tp>::size_type
+cpp17::pmr::vector<Tp>::grown_capacity(size_type n) const
+{
+    size_type old_size = size();
+    if (n > max_size() - old_size)
+        throw std::length_error("pmr::vector: too many elements");
+    size_type doubled = old_size < max_size() / 2 ? 2 * old_size : max_size();
+    return std::max(old_size + n, doubled);
+}
+
+template <class Tp>
+bool cpp17::pmr::vector<Tp>::resize_in_place(size_type n)
+{
+    if (! m_begin)
+        return false;
+
+    // Take the whole block the resource would provide for `n` elements.
+    memory_resource *r = m_allocator.resource();
+    size_type usable = r->usable_size(n * sizeof(Tp), alignof(Tp)) /
+        sizeof(Tp);
+    if (! r->try_expand(m_begin, capacity() * sizeof(Tp),
+                        usable * sizeof(Tp), alignof(Tp)))
+        return false;
+    m_end_of_storage = m_begin + usable;
+    return true;
+}
+
+template <class Tp>
+template <class Construct>
+void cpp17::pmr::vector<Tp>::reallocate(size_type  n,
+                                        size_type  k,
+                                        Construct  construct)
+{
+    allocation_result<Tp*> r = m_allocator.allocate_at_least(n);
+    Tp *new_begin = r.ptr;
+    Tp *tail      = new_begin + size();
+    Tp *tail_end  = tail;
+    Tp *moved_end = new_begin;
+    try {
+        for (; k > 0; --k, ++tail_end)
+            construct(tail_end);
+        for (Tp *p = m_begin; p != m_end; ++p, ++moved_end)
+            m_allocator.construct(moved_end, std::move_if_noexcept(*p));
+    }
+    catch (...) {
+        // Recover resources if exception on constructor call.
+        destroy_range(tail, tail_end);
+        destroy_range(new_begin, moved_end);
+        m_allocator.deallocate(new_begin, r.count);
+        throw;
+    }
+
+    destroy_range(m_begin, m_end);
+    deallocate_buffer();
+    m_begin          = new_begin;
+    m_end            = tail_end;
+    m_end_of_storage = new_begin + r.count;
+}
+
+template <class Tp>
+inline
+void cpp17::pmr::vector<Tp>::destroy_range(Tp *first, Tp *last) noexcept
+{
+    for (; first != last; ++first)
+        m_allocator.destroy(first);
+}
+
+template <class Tp>
+inline
+void cpp17::pmr::vector<Tp>::deallocate_buffer() noexcept
+{
+    if (m_begin)
+        m_allocator.deallocate(m_begin, capacity());
+}
+
+template <class Tp>
+inline
+bool cpp17::pmr::operator==(const vector<Tp>& a, const vector<Tp>& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+template <class Tp>
+inline
+bool cpp17::pmr::operator!=(const vector<Tp>& a, const vector<Tp>& b)
+{
+    return ! (a == b);
+}
+
+template <class Tp>
+inline
+bool cpp17::pmr::operator<(const vector<Tp>& a, const vector<Tp>& b)
+{
+    return std::lexicographical_compare(a.begin(), a.end(),
+                                        b.begin(), b.end());
+}
+
+template <class Tp>
+inline
+bool cpp17::pmr::operator>(const vector<Tp>& a, const vector<Tp>& b)
+{
+    return b < a;
+}
+
+template <class Tp>
+inline
+bool cpp17::pmr::operator<=(const vector<Tp>& a, const vector<Tp>& b)
+{
+    return ! (b < a);
+}
+
+template <class Tp>
+inline
+bool cpp17::pmr::operator>=(const vector<Tp>& a, const vector<Tp>& b)
+{
+    return ! (a < b);
 }
 
 #endif // ! defined(INCLUDED_PMR_VECTOR_DOT_H)
@@ -0,0 +1,68 @@
+/* polymorphic_allocator.b.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+// Microbenchmark for `polymorphic_allocator`: cost of default construction
+// (i.e., of `get_default_resource()`).
+
+#include <polymorphic_allocator.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+using namespace cpp17::pmr;
+
+// Sink that keeps the optimizer from discarding the benchmarked work.
+memory_resource *volatile sink;
+
+// Return the average time, in nanoseconds, to default-construct a
+// `polymorphic_allocator` and read its resource.
+double time_default_construction(long iterations)
+{
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point start = clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        polymorphic_allocator<int> a;
+        sink = a.resource();
+    }
+    clock::duration elapsed = clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() /
+        iterations;
+}
+
+} // close unnamed namespace
+
+int main(int argc, char *argv[])
+{
+    long iterations = argc > 1 ? std::atol(argv[1]) : 100000000L;
+
+    std::printf("default-constructed polymorphic_allocator, ns/op\n");
+
+    std::printf("  default never set:    %6.2f\n",
+                time_default_construction(iterations));
+
+    monotonic_buffer_resource mr;
+    set_default_resource(&mr);
+    std::printf("  global default set:   %6.2f\n",
+                time_default_construction(iterations));
+    set_default_resource(nullptr);
+
+    {
+        default_resource_scope scope(&mr);
+        std::printf("  thread override set:  %6.2f\n",
+                    time_default_construction(iterations));
+    }
+
+    return 0;
+}
+
+/* End polymorphic_allocator.b.cpp */
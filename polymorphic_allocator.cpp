@@ -7,18 +7,255 @@
  */
 
 #include <polymorphic_allocator.h>
+#include <cstdlib>
 
 namespace cpp17 {
 
+namespace {
+
+// Storage for the new/delete singleton.  Being a union with an empty
+// destructor, it never destroys its member, so the singleton remains usable
+// during the destruction of other static objects.  Its constructor is
+// `constexpr`, so the singleton is constant-initialized and usable during
+// the dynamic initialization of other static objects.
+union new_delete_storage {
+    pmr::new_delete_resource m_resource;
+
+    constexpr new_delete_storage() : m_resource() { }
+    ~new_delete_storage() { }
+};
+
+new_delete_storage s_new_delete;
+
+} // close unnamed namespace
+
 atomic<pmr::memory_resource *>
-pmr::memory_resource::s_default_resource(nullptr);
+pmr::memory_resource::s_default_resource(&s_new_delete.m_resource);
 
 pmr::new_delete_resource *pmr::new_delete_resource_singleton()
 {
-    // TBD: I think the standard makes this exception-safe, otherwise, we need
-    // to use 'call_once()' in '<mutex>'.
-    static new_delete_resource singleton;
-    return &singleton;
+    return &s_new_delete.m_resource;
+}
+
+void *pmr::new_delete_resource::do_allocate(size_t bytes, size_t alignment)
+{
+    if (alignment <= alignof(max_align_t))
+        return adaptor().allocate(bytes, alignment);
+
+    // Over-aligned: let the C library place the block, rather than padding
+    // a `new`ed block.  Blocks of up to 64 bytes' alignment are rounded up
+    // to `usable_size`, as `resource_adaptor` would.
+    size_t size = do_usable_size(bytes, alignment);
+    void *ret;
+    if (0 != ::posix_memalign(&ret, alignment, size ? size : 1))
+        throw std::bad_alloc();
+    return ret;
+}
+
+void pmr::new_delete_resource::do_deallocate(void   *p,
+                                             size_t  bytes,
+                                             size_t  alignment)
+{
+    if (alignment <= alignof(max_align_t))
+        adaptor().deallocate(p, bytes, alignment);
+    else
+        std::free(p);
+}
+
+void pmr::memory_resource::do_allocate_batch(void   **out,
+                                             size_t   n,
+                                             size_t   bytes,
+                                             size_t   alignment)
+{
+    size_t i = 0;
+    try {
+        for (; i < n; ++i)
+            out[i] = do_allocate(bytes, alignment);
+    }
+    catch (...) {
+        // Recover the blocks allocated before the exception.
+        while (i > 0)
+            do_deallocate(out[--i], bytes, alignment);
+        throw;
+    }
+}
+
+void pmr::memory_resource::do_deallocate_batch(void *const *blocks,
+                                               size_t       n,
+                                               size_t       bytes,
+                                               size_t       alignment)
+{
+    for (size_t i = 0; i < n; ++i)
+        do_deallocate(blocks[i], bytes, alignment);
+}
+
+pmr::allocation_result<void*>
+pmr::memory_resource::do_allocate_at_least(size_t bytes, size_t alignment)
+{
+    size_t usable = do_usable_size(bytes, alignment);
+    return { do_allocate(usable, alignment), usable };
+}
+
+constexpr size_t pmr::__details::arena_chunks::growth_factor;
+
+size_t pmr::__details::arena_chunks::min_chunk_size(size_t bytes,
+                                                    size_t alignment)
+{
+    // The header is placed at the (at least max-aligned) start of the
+    // chunk, so the worst-case padding after it is `alignment - 1`.
+    if (bytes > size_t(-1) - sizeof(chunk_header) - (alignment - 1))
+        throw bad_alloc();
+    return sizeof(chunk_header) + alignment - 1 + bytes;
+}
+
+size_t pmr::__details::arena_chunks::chunk_alignment(size_t alignment)
+{
+    return alignment > alignof(max_align_t) ?
+        alignment : alignof(max_align_t);
+}
+
+void *pmr::__details::arena_chunks::push_chunk(chunk_header *chunk,
+                                               size_t        bytes,
+                                               size_t        alignment)
+{
+    chunk->m_prev = m_chunks;
+    m_chunks      = chunk;
+
+    // Past the largest representable size, chunks stop growing.
+    if (chunk->m_size <= size_t(-1) / growth_factor)
+        m_next_buffer_size = chunk->m_size * growth_factor;
+    m_current    = reinterpret_cast<char*>(chunk + 1);
+    m_space_left = chunk->m_size - sizeof(chunk_header);
+
+    // Now that there is room, the fast path cannot fail.
+    return bump(bytes, alignment);
+}
+
+void *pmr::__details::arena_chunks::allocate_from_new_chunk(
+    memory_resource *upstream,
+    size_t           bytes,
+    size_t           alignment)
+{
+    size_t min_size   = min_chunk_size(bytes, alignment);
+    size_t chunk_size = m_next_buffer_size;
+    while (chunk_size < min_size) {
+        if (chunk_size > size_t(-1) / growth_factor)
+            throw bad_alloc();
+        chunk_size *= growth_factor;
+    }
+
+    size_t        chunk_align = chunk_alignment(alignment);
+    chunk_header *chunk       = static_cast<chunk_header*>(
+        upstream->allocate(chunk_size, chunk_align));
+    chunk->m_size      = chunk_size;
+    chunk->m_alignment = chunk_align;
+    return push_chunk(chunk, bytes, alignment);
+}
+
+void pmr::__details::arena_chunks::release_chunks(memory_resource *upstream)
+{
+    while (m_chunks) {
+        chunk_header *prev = m_chunks->m_prev;
+        upstream->deallocate(m_chunks, m_chunks->m_size,
+                             m_chunks->m_alignment);
+        m_chunks = prev;
+    }
+}
+
+constexpr size_t pmr::monotonic_buffer_resource::default_buffer_size;
+constexpr size_t pmr::monotonic_buffer_resource::growth_factor;
+
+pmr::monotonic_buffer_resource::monotonic_buffer_resource(
+    memory_resource *upstream)
+    : monotonic_buffer_resource(default_buffer_size, upstream)
+{
+}
+
+pmr::monotonic_buffer_resource::monotonic_buffer_resource(
+    size_t           initial_size,
+    memory_resource *upstream)
+    : m_upstream(upstream)
+    , m_initial_buffer(nullptr)
+    , m_initial_size(initial_size ? initial_size : 1)
+    , m_arena(nullptr, 0, m_initial_size)
+{
+}
+
+pmr::monotonic_buffer_resource::monotonic_buffer_resource(
+    void            *buffer,
+    size_t           buffer_size,
+    memory_resource *upstream)
+    : m_upstream(upstream)
+    , m_initial_buffer(buffer)
+    , m_initial_size(buffer_size)
+    , m_arena(static_cast<char*>(buffer), buffer_size,
+              buffer_size ? buffer_size * growth_factor
+                          : default_buffer_size)
+{
+}
+
+pmr::monotonic_buffer_resource::~monotonic_buffer_resource()
+{
+    release();
+}
+
+void pmr::monotonic_buffer_resource::release()
+{
+    m_arena.release_chunks(m_upstream);
+
+    // Start over from the initial buffer (if any), with the initial
+    // growth schedule.
+    m_arena.m_current    = static_cast<char*>(m_initial_buffer);
+    m_arena.m_space_left = m_initial_buffer ? m_initial_size : 0;
+    if (m_initial_buffer)
+        m_arena.m_next_buffer_size = m_initial_size ?
+            m_initial_size * growth_factor : default_buffer_size;
+    else
+        m_arena.m_next_buffer_size = m_initial_size;
+}
+
+bool pmr::monotonic_buffer_resource::do_try_expand(void   *p,
+                                                   size_t  old_bytes,
+                                                   size_t  new_bytes,
+                                                   size_t)
+{
+    if (static_cast<char*>(p) + old_bytes != m_arena.m_current)
+        return new_bytes <= old_bytes;  // The tail is simply not reused
+
+    if (new_bytes > old_bytes) {
+        size_t growth = new_bytes - old_bytes;
+        if (growth > m_arena.m_space_left)
+            return false;
+        m_arena.m_current    += growth;
+        m_arena.m_space_left -= growth;
+    }
+    else {
+        m_arena.m_current    -= old_bytes - new_bytes;
+        m_arena.m_space_left += old_bytes - new_bytes;
+    }
+    return true;
+}
+
+void pmr::monotonic_buffer_resource::do_allocate_batch(void   **out,
+                                                       size_t   n,
+                                                       size_t   bytes,
+                                                       size_t   alignment)
+{
+    if (0 == n)
+        return;
+
+    // Round each block up to a multiple of the alignment, so that every
+    // block in the single allocation is aligned.  Zero-byte blocks are
+    // given distinct addresses, too.
+    size_t stride = (bytes + alignment - 1) & ~(alignment - 1);
+    if (0 == stride)
+        stride = alignment;
+    if (n > size_t(-1) / stride)
+        throw bad_alloc();
+
+    char *p = static_cast<char*>(do_allocate(n * stride, alignment));
+    for (size_t i = 0; i < n; ++i, p += stride)
+        out[i] = p;
 }
 
 }
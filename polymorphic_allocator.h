@@ -13,6 +13,8 @@
 #include <memory>
 #include <new>
 #include <scoped_allocator>
+#include <stdexcept>
+#include <typeinfo>
 #include <cstddef>  // For max_align_t
 
 namespace cpp17 {
@@ -26,6 +28,18 @@ enum class byte : unsigned char {};
 
 namespace pmr {
 
+template <class Tp, class Resource> class static_polymorphic_allocator;
+
+// Storage obtained by `allocate_at_least`, and its size: in bytes from a
+// `memory_resource` and in objects from an allocator.  Mirrors C++23's
+// `std::allocation_result`.
+template <class Pointer>
+struct allocation_result
+{
+    Pointer ptr;
+    size_t  count;
+};
+
 // Abstract base class for allocator resources.
 // Conforms to the C++17 standard, section [mem.res.class].
 class memory_resource
@@ -53,10 +67,75 @@ class memory_resource
     bool is_equal(const memory_resource& other) const noexcept
         { return do_is_equal(other); }
 
+    // Return true if `deallocate` does nothing, i.e., memory is reclaimed
+    // only when the resource is released or destroyed.  A container can
+    // then skip deallocating (and, for trivially destructible elements,
+    // even visiting) its nodes when it is cleared or destroyed.
+    bool deallocate_is_noop() const noexcept
+        { return do_deallocate_is_noop(); }
+
+    // Allocate `n` blocks of `bytes` bytes each, storing their addresses in
+    // `out[0]` through `out[n - 1]`.  The blocks may later be deallocated
+    // singly or in batches of any grouping.  If an exception is thrown, no
+    // block remains allocated.  Node-based containers use this to pay for
+    // one call, rather than one per node, when building a range.
+    void allocate_batch(void **out, size_t n, size_t bytes,
+                        size_t alignment = max_align)
+        { do_allocate_batch(out, n, bytes, alignment); }
+
+    // Deallocate the `n` blocks of `bytes` bytes each at `blocks[0]`
+    // through `blocks[n - 1]`.
+    void deallocate_batch(void *const *blocks, size_t n, size_t bytes,
+                          size_t alignment = max_align)
+        { do_deallocate_batch(blocks, n, bytes, alignment); }
+
+    // Allocate at least `bytes` bytes and return the block with its usable
+    // size, which is `usable_size(bytes, alignment)`.  The block may be
+    // deallocated with any size from `bytes` to its usable size.  A growing
+    // container can use the whole block instead of reallocating early.
+    // This is an extension to C++17.
+    allocation_result<void*> allocate_at_least(size_t bytes,
+                                               size_t alignment = max_align)
+        { return do_allocate_at_least(bytes, alignment); }
+
+    // Return the usable size of the block that `allocate_at_least(bytes,
+    // alignment)` would return, without allocating.
+    size_t usable_size(size_t bytes,
+                       size_t alignment = max_align) const noexcept
+        { return do_usable_size(bytes, alignment); }
+
+    // Try to resize the block at `p`, allocated with `old_bytes` and
+    // `alignment`, to `new_bytes` without moving it.  On success, return
+    // true; the block must then be deallocated with `new_bytes`.  A vector
+    // at the top of an arena can thus grow without copying.  This is an
+    // extension to C++17.
+    bool try_expand(void *p, size_t old_bytes, size_t new_bytes,
+                    size_t alignment = max_align)
+        { return do_try_expand(p, old_bytes, new_bytes, alignment); }
+
   protected:
     virtual void* do_allocate(size_t bytes, size_t alignment) = 0;
     virtual void  do_deallocate(void *p, size_t bytes, size_t alignment) = 0;
     virtual bool  do_is_equal(const memory_resource& other) const noexcept = 0;
+    virtual bool  do_deallocate_is_noop() const noexcept { return false; }
+
+    // By default, call `do_allocate` or `do_deallocate` once per block.
+    virtual void  do_allocate_batch(void **out, size_t n, size_t bytes,
+                                    size_t alignment);
+    virtual void  do_deallocate_batch(void *const *blocks, size_t n,
+                                      size_t bytes, size_t alignment);
+
+    // By default, the usable size is the requested size; a resource that
+    // rounds requests up overrides `do_usable_size`, and
+    // `do_allocate_at_least` allocates that many bytes.
+    virtual allocation_result<void*> do_allocate_at_least(size_t bytes,
+                                                          size_t alignment);
+    virtual size_t do_usable_size(size_t bytes, size_t alignment)
+        const noexcept { return bytes; }
+
+    // By default, no block can be resized in place.
+    virtual bool do_try_expand(void *, size_t, size_t, size_t)
+        { return false; }
 };
 
 inline
@@ -77,6 +156,21 @@ bool operator!=(const memory_resource& a, const memory_resource& b)
 
 namespace __details {
 
+// Holder for the calling thread's override of the default resource, or null
+// if none.  Being a static member of a class template, its (constant)
+// initializer is visible in every translation unit, so that, unlike an
+// `extern thread_local` variable, it is accessed without a call to check
+// for dynamic initialization.
+template <class Dummy = void>
+struct thread_default_resource
+{
+    static thread_local memory_resource *s_resource;
+};
+
+template <class Dummy>
+thread_local memory_resource *
+thread_default_resource<Dummy>::s_resource = nullptr;
+
 // STL allocator that holds a pointer to a polymorphic allocator resource.
 // Used to implement `polymorphic_allocator`, which is a scoped allocator.
 template <class Tp>
@@ -105,6 +199,11 @@ class polymorphic_allocator_imp
     Tp *allocate(size_t n);
     void deallocate(Tp *p, size_t n);
 
+    // Allocate room for at least `n` objects and return the number that
+    // fit, which may be passed to `deallocate`.  Mirrors C++23's
+    // `allocate_at_least`.
+    allocation_result<Tp*> allocate_at_least(size_t n);
+
     // Return a default-constructed allocator
     polymorphic_allocator_imp select_on_container_copy_construction() const;
 
@@ -144,6 +243,18 @@ class resource_adaptor_imp : public memory_resource
     template <size_t Align>
     void deallocate_imp(void *p, size_t bytes);
 
+    // Return true if the allocator of `other`, a resource of this type,
+    // compares equal to this one's.  A stateless (empty) allocator is
+    // assumed to compare equal without calling `operator==`.
+    bool allocators_equal(const resource_adaptor_imp&, true_type)
+        const noexcept { return true; }
+    bool allocators_equal(const resource_adaptor_imp& other, false_type)
+        const noexcept { return m_alloc == other.m_alloc; }
+
+    // Return the size of the 64-byte aligned block from which a block of
+    // `bytes` bytes with an `alignment` greater than 64 is carved.
+    static size_t over_aligned_bytes(size_t bytes, size_t alignment);
+
   public:
     typedef Allocator allocator_type;
 
@@ -162,7 +273,60 @@ class resource_adaptor_imp : public memory_resource
 
     bool do_is_equal(const memory_resource& other) const noexcept override;
 
+    // Requests are allocated as whole chunks of the alignment.
+    size_t do_usable_size(size_t bytes, size_t alignment) const noexcept
+        override;
+
     allocator_type get_allocator() const { return m_alloc; }
+
+    template <class, class> friend class pmr::static_polymorphic_allocator;
+};
+
+// Bump-pointer state shared by the arena resources: the position within
+// the current buffer and the chunks obtained from upstream, newest first.
+// Copying it records a position that can be restored later, provided the
+// chunks it refers to have not been returned.
+struct arena_chunks
+{
+    static constexpr size_t growth_factor = 2;
+
+    // Header at the start of every chunk obtained from upstream.
+    struct chunk_header {
+        chunk_header *m_prev;
+        size_t        m_size;
+        size_t        m_alignment;
+    };
+
+    char         *m_current;
+    size_t        m_space_left;
+    size_t        m_next_buffer_size;
+    chunk_header *m_chunks;
+
+    arena_chunks(char *buffer, size_t buffer_size, size_t next_buffer_size)
+        : m_current(buffer), m_space_left(buffer_size)
+        , m_next_buffer_size(next_buffer_size), m_chunks(nullptr) { }
+
+    // Allocate `bytes` at `alignment` from the current buffer, or return
+    // null if they do not fit.
+    void *bump(size_t bytes, size_t alignment);
+
+    // Return the size of the smallest chunk that holds `bytes` at
+    // `alignment`, and the alignment to request for it.  Throw `bad_alloc`
+    // if the size is not representable.
+    static size_t min_chunk_size(size_t bytes, size_t alignment);
+    static size_t chunk_alignment(size_t alignment);
+
+    // Make `chunk`, of at least `min_chunk_size(bytes, alignment)` bytes,
+    // the current buffer and allocate `bytes` at `alignment` from it.
+    void *push_chunk(chunk_header *chunk, size_t bytes, size_t alignment);
+
+    // Get a chunk from `upstream`, growing geometrically, big enough for
+    // `bytes` at `alignment` and allocate from it.
+    void *allocate_from_new_chunk(memory_resource *upstream, size_t bytes,
+                                  size_t alignment);
+
+    // Return every chunk to `upstream`.
+    void release_chunks(memory_resource *upstream);
 };
 
 } // end namespace __details
@@ -177,18 +341,131 @@ template <class Allocator>
 using resource_adaptor = __details::resource_adaptor_imp<
     typename allocator_traits<Allocator>::template rebind_alloc<byte>>;
 
-// Memory resource that uses new and delete.
-class new_delete_resource : public resource_adaptor<allocator<byte>> { };
+// Memory resource that uses new and delete, allocating exactly as
+// `resource_adaptor<allocator<byte>>` does, except that blocks with an
+// alignment greater than `alignof(max_align_t)` come directly from
+// `posix_memalign`, sized to the request rather than padded for alignment.
+// It is stateless and has a `constexpr` constructor, so that the singleton
+// instance, and the default resource pointer that refers to it, are
+// constant-initialized.
+class new_delete_resource : public memory_resource
+{
+    typedef resource_adaptor<allocator<byte>> adaptor;
+
+  public:
+    constexpr new_delete_resource() noexcept { }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    size_t do_usable_size(size_t bytes, size_t alignment) const noexcept
+        override { return adaptor().usable_size(bytes, alignment); }
+
+    // All `new_delete_resource` objects are interchangeable.  Comparing
+    // the exact type is cheaper than a `dynamic_cast`.
+    bool  do_is_equal(const memory_resource& other) const noexcept override
+        { return this == &other || typeid(other) == typeid(*this); }
+
+    template <class, class> friend class static_polymorphic_allocator;
+};
 
 // Return a pointer to a global instance of `new_delete_resource`.
 new_delete_resource *new_delete_resource_singleton();
 
-// Get the current default resource
+// Get the current default resource: the calling thread's default resource
+// override, if any, else the global default resource.
 memory_resource *get_default_resource();
 
-// Set the default resource
+// Set the global default resource and return the previous one.
 memory_resource *set_default_resource(memory_resource *r);
 
+// Get the calling thread's default resource override, or null if none.
+// This is an extension to C++17.
+memory_resource *get_thread_default_resource();
+
+// Override the default resource for the calling thread only, or remove the
+// override if `r` is null, and return the previous override (possibly
+// null).  This is an extension to C++17.
+memory_resource *set_thread_default_resource(memory_resource *r);
+
+// RAII guard that overrides the calling thread's default resource for its
+// lifetime and then restores the previous override.  This is an extension
+// to C++17.
+class default_resource_scope
+{
+    memory_resource *m_prev;
+
+  public:
+    explicit default_resource_scope(memory_resource *r)
+        : m_prev(set_thread_default_resource(r)) { }
+
+    default_resource_scope(const default_resource_scope&) = delete;
+    default_resource_scope& operator=(const default_resource_scope&) = delete;
+
+    ~default_resource_scope() { set_thread_default_resource(m_prev); }
+};
+
+// Memory resource that hands out memory by bumping a pointer through an
+// optional initial buffer and then through successively larger chunks
+// obtained from an upstream resource.  Deallocation is a no-op; memory is
+// reclaimed all at once by `release()` or by the destructor.
+// Conforms to the C++17 standard, section [mem.res.monotonic.buffer].
+class monotonic_buffer_resource : public memory_resource
+{
+    static constexpr size_t default_buffer_size = 128 * sizeof(void*);
+    static constexpr size_t growth_factor       =
+        __details::arena_chunks::growth_factor;
+
+    memory_resource         *m_upstream;
+    void                    *m_initial_buffer;
+    size_t                   m_initial_size;
+    __details::arena_chunks  m_arena;
+
+  public:
+    explicit monotonic_buffer_resource(memory_resource *upstream);
+    monotonic_buffer_resource(size_t initial_size, memory_resource *upstream);
+    monotonic_buffer_resource(void *buffer, size_t buffer_size,
+                              memory_resource *upstream);
+
+    monotonic_buffer_resource()
+        : monotonic_buffer_resource(get_default_resource()) { }
+    explicit monotonic_buffer_resource(size_t initial_size)
+        : monotonic_buffer_resource(initial_size, get_default_resource()) { }
+    monotonic_buffer_resource(void *buffer, size_t buffer_size)
+        : monotonic_buffer_resource(buffer, buffer_size,
+                                    get_default_resource()) { }
+
+    monotonic_buffer_resource(const monotonic_buffer_resource&) = delete;
+    monotonic_buffer_resource&
+        operator=(const monotonic_buffer_resource&) = delete;
+
+    ~monotonic_buffer_resource() override;
+
+    // Return all chunks to upstream and start over from the initial buffer.
+    void release();
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const memory_resource& other) const noexcept override;
+    bool  do_deallocate_is_noop() const noexcept override { return true; }
+
+    // Carve all `n` blocks out of one allocation.
+    void  do_allocate_batch(void **out, size_t n, size_t bytes,
+                            size_t alignment) override;
+    void  do_deallocate_batch(void *const *, size_t, size_t, size_t) override
+        { }
+
+    // The most recent block can grow into the rest of the current buffer
+    // or shrink; any other block can only shrink.
+    bool  do_try_expand(void *p, size_t old_bytes, size_t new_bytes,
+                        size_t alignment) override;
+
+    template <class, class> friend class static_polymorphic_allocator;
+};
+
 template <class Tp>
 class polymorphic_allocator :
     public scoped_allocator_adaptor<__details::polymorphic_allocator_imp<Tp>>
@@ -217,6 +494,11 @@ class polymorphic_allocator :
     polymorphic_allocator select_on_container_copy_construction() const
         { return polymorphic_allocator(); }
 
+    // Allocate room for at least `n` objects; see
+    // `polymorphic_allocator_imp::allocate_at_least`.
+    allocation_result<Tp*> allocate_at_least(size_t n)
+        { return this->outer_allocator().allocate_at_least(n); }
+
     memory_resource *resource() const
         { return this->outer_allocator().resource(); }
 };
@@ -231,6 +513,55 @@ inline bool operator!=(const polymorphic_allocator<T1>& a,
                        const polymorphic_allocator<T2>& b)
     { return ! (a == b); }
 
+// A `polymorphic_allocator` whose resource is known to be of exactly type
+// `Resource`.  It is-a `polymorphic_allocator<Tp>` (same `resource()`,
+// compares equal to any `polymorphic_allocator` for an equal resource, and
+// is passed as such to the elements of a container), but its own
+// `allocate` and `deallocate` call `Resource::do_allocate` and
+// `Resource::do_deallocate` non-virtually, so that they can be inlined.
+// The `Resource` object must not be of a type derived from `Resource` that
+// overrides those functions, and must grant access to them by declaring
+// `static_polymorphic_allocator` a friend, as all resources in this library
+// do.  There is no default `Resource`, so constructing one from a null
+// pointer throws `invalid_argument`.
+template <class Tp, class Resource>
+class static_polymorphic_allocator : public polymorphic_allocator<Tp>
+{
+    typedef polymorphic_allocator<Tp> Base;
+
+    static Resource *non_null(Resource *r);
+
+  public:
+    template <typename U>
+    struct rebind { typedef static_polymorphic_allocator<U, Resource> other; };
+
+    explicit static_polymorphic_allocator(Resource *r) : Base(non_null(r)) { }
+
+    template <class U>
+    static_polymorphic_allocator(
+        const static_polymorphic_allocator<U, Resource>& other)
+        : Base(other.resource()) { }
+
+    Tp *allocate(size_t n)
+    {
+        return static_cast<Tp*>(concrete_resource()->Resource::do_allocate(
+                                    n * sizeof(Tp), alignof(Tp)));
+    }
+
+    void deallocate(Tp *p, size_t n)
+    {
+        concrete_resource()->Resource::do_deallocate(p, n * sizeof(Tp),
+                                                     alignof(Tp));
+    }
+
+    // There is no default `Resource`, so a copy uses the same resource.
+    static_polymorphic_allocator select_on_container_copy_construction()
+        const { return *this; }
+
+    Resource *concrete_resource() const
+        { return static_cast<Resource*>(this->resource()); }
+};
+
 } // end namespace pmr
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -242,14 +573,29 @@ pmr::memory_resource::~memory_resource()
 {
 }
 
+template <class Tp, class Resource>
+inline
+Resource *
+pmr::static_polymorphic_allocator<Tp, Resource>::non_null(Resource *r)
+{
+    // `polymorphic_allocator` would replace null with the default resource,
+    // which is not a `Resource`.
+    if (nullptr == r)
+        throw std::invalid_argument(
+            "static_polymorphic_allocator: null resource");
+    return r;
+}
+
 inline
 pmr::memory_resource *
 pmr::get_default_resource()
 {
-    memory_resource *ret =
-        pmr::memory_resource::s_default_resource.load();
+    // `s_default_resource` is constant-initialized to the new/delete
+    // singleton and never null, so there is no static-init guard here.
+    memory_resource *ret = __details::thread_default_resource<>::s_resource;
     if (nullptr == ret)
-        ret = new_delete_resource_singleton();
+        ret = pmr::memory_resource::s_default_resource.load(
+            memory_order_acquire);
     return ret;
 }
 
@@ -260,12 +606,67 @@ pmr::set_default_resource(pmr::memory_resource *r)
     if (nullptr == r)
         r = new_delete_resource_singleton();
 
-    // TBD, should use an atomic swap
-    pmr::memory_resource *prev = get_default_resource();
-    pmr::memory_resource::s_default_resource.store(r);
+    return pmr::memory_resource::s_default_resource.exchange(
+        r, memory_order_acq_rel);
+}
+
+inline
+pmr::memory_resource *
+pmr::get_thread_default_resource()
+{
+    return __details::thread_default_resource<>::s_resource;
+}
+
+inline
+pmr::memory_resource *
+pmr::set_thread_default_resource(pmr::memory_resource *r)
+{
+    typedef __details::thread_default_resource<> holder;
+
+    pmr::memory_resource *prev = holder::s_resource;
+    holder::s_resource = r;
     return prev;
 }
 
+inline
+void *pmr::__details::arena_chunks::bump(size_t bytes, size_t alignment)
+{
+    // Fast path: bump the current pointer within the current buffer.  A
+    // zero-byte request with no buffer yet must still get a non-null block,
+    // so it takes the slow path.
+    size_t padding = (alignment - size_t(m_current)) & (alignment - 1);
+    if (padding > m_space_left || bytes > m_space_left - padding ||
+        ! m_current)
+        return nullptr;
+
+    char *ret     = m_current + padding;
+    m_current     = ret + bytes;
+    m_space_left -= bytes + padding;
+    return ret;
+}
+
+inline
+void *pmr::monotonic_buffer_resource::do_allocate(size_t bytes,
+                                                  size_t alignment)
+{
+    if (void *ret = m_arena.bump(bytes, alignment))
+        return ret;
+    return m_arena.allocate_from_new_chunk(m_upstream, bytes, alignment);
+}
+
+inline
+void pmr::monotonic_buffer_resource::do_deallocate(void *, size_t, size_t)
+{
+    // Memory is reclaimed only by `release()` or the destructor.
+}
+
+inline
+bool pmr::monotonic_buffer_resource::do_is_equal(
+    const memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
 template <class Allocator>
     template <class Allocator2>
 inline
@@ -305,6 +706,19 @@ pmr::__details::resource_adaptor_imp<Allocator>::deallocate_imp(void   *p,
     return chunk_traits::deallocate(rebound, static_cast<chunk*>(p), chunks);
 }
 
+template <class Allocator>
+inline
+size_t
+pmr::__details::resource_adaptor_imp<Allocator>::over_aligned_bytes(
+    size_t bytes,
+    size_t alignment)
+{
+    // Skipping the stored pointer and rounding up to `alignment` advances
+    // by at most `sizeof(void*) + alignment - 1` bytes.  Round up, not down,
+    // to whole 64-byte chunks.
+    return (bytes + sizeof(void*) + alignment - 1 + 63) & ~size_t(63);
+}
+
 template <class Allocator>
 void *
 pmr::__details::resource_adaptor_imp<Allocator>::do_allocate(size_t bytes,
@@ -328,8 +742,7 @@ pmr::__details::resource_adaptor_imp<Allocator>::do_allocate(size_t bytes,
       case 32: return allocate_imp<32>(bytes);
       case 64: return allocate_imp<64>(bytes);
       default: {
-          size_t chunks = (bytes + sizeof(void*) + alignment - 1) / 64;
-          size_t chunkbytes = chunks * 64;
+          size_t chunkbytes = over_aligned_bytes(bytes, alignment);
           void *original = allocate_imp<64>(chunkbytes);
 
           // Make room for original pointer storage
@@ -371,8 +784,7 @@ pmr::__details::resource_adaptor_imp<Allocator>::do_deallocate(void  *p,
       case 32: deallocate_imp<32>(p, bytes); break;
       case 64: deallocate_imp<64>(p, bytes); break;
       default: {
-          size_t chunks = (bytes + sizeof(void*) + alignment - 1) / 64;
-          size_t chunkbytes = chunks * 64;
+          size_t chunkbytes = over_aligned_bytes(bytes, alignment);
           void *original = reinterpret_cast<void**>(p)[-1];
 
           deallocate_imp<64>(original, chunkbytes);
@@ -384,13 +796,28 @@ template <class Allocator>
 bool pmr::__details::resource_adaptor_imp<Allocator>::do_is_equal(
     const memory_resource& other) const noexcept
 {
-    const resource_adaptor_imp *other_p =
-        dynamic_cast<const resource_adaptor_imp*>(&other);
-
-    if (other_p)
-        return this->m_alloc == other_p->m_alloc;
-    else
+    // Check the address, then the exact type, which is cheaper than a
+    // `dynamic_cast`, and only then the allocators.
+    if (this == &other)
+        return true;
+    if (typeid(other) != typeid(*this))
         return false;
+    return allocators_equal(static_cast<const resource_adaptor_imp&>(other),
+                            is_empty<Allocator>());
+}
+
+template <class Allocator>
+size_t
+pmr::__details::resource_adaptor_imp<Allocator>::do_usable_size(
+    size_t bytes,
+    size_t alignment) const noexcept
+{
+    // With an explicit alignment of up to 64, `do_allocate` allocates whole
+    // `aligned_chunk`s of that alignment.  Natural alignment depends on the
+    // size, so requests without an explicit alignment are not rounded.
+    if (0 == alignment || alignment > 64)
+        return bytes;
+    return (bytes + alignment - 1) & ~(alignment - 1);
 }
 
 
@@ -434,6 +861,16 @@ void __pmrd::polymorphic_allocator_imp<Tp>::deallocate(Tp *p, size_t n)
     m_resource->deallocate(p, n * sizeof(Tp), alignof(Tp));
 }
 
+template <class Tp>
+inline
+pmr::allocation_result<Tp*>
+__pmrd::polymorphic_allocator_imp<Tp>::allocate_at_least(size_t n)
+{
+    allocation_result<void*> r =
+        m_resource->allocate_at_least(n * sizeof(Tp), alignof(Tp));
+    return { static_cast<Tp*>(r.ptr), r.count / sizeof(Tp) };
+}
+
 template <class Tp>
 inline
 __pmrd::polymorphic_allocator_imp<Tp>
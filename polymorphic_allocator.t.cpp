@@ -7,11 +7,16 @@
  */
 
 #include <polymorphic_allocator.h>
+#include <test_resource.h>
 
 #include <iostream>
 #include <cstdlib>
 #include <climits>
 #include <cstring>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+#include <thread>
 
 //==========================================================================
 //                  ASSERT TEST MACRO
@@ -110,9 +115,10 @@ class AllocCounters
     }
 };
 
+// Keeps the counted blocks as aligned as `malloc`'s.
 union CountedAllocHeader {
-    void*       m_align;
-    std::size_t m_size;
+    std::max_align_t m_align;
+    std::size_t      m_size;
 };
 
 void *countedAllocate(std::size_t nbytes, AllocCounters *counters)
@@ -523,12 +529,66 @@ void SimpleVector<Tp, Alloc>::pop_back()
     AllocTraits::destroy(m_alloc, cpp17::addressof(m_data[--m_size]));
 }
 
+// Monotonic resource that counts calls to its (virtual) `do_allocate`, to
+// detect whether a call was dispatched virtually.
+class CountingMonotonicResource
+    : public cpp17::pmr::monotonic_buffer_resource
+{
+    int m_virtual_allocs;
+
+  public:
+    explicit CountingMonotonicResource(cpp17::pmr::memory_resource *up)
+        : monotonic_buffer_resource(up), m_virtual_allocs(0) { }
+
+    int virtual_allocs() const { return m_virtual_allocs; }
+
+  protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        ++m_virtual_allocs;
+        return monotonic_buffer_resource::do_allocate(bytes, alignment);
+    }
+};
+
+// Resource that forwards to an upstream resource but throws `bad_alloc` on
+// the allocation that brings its countdown to zero.
+class LimitedResource : public cpp17::pmr::memory_resource
+{
+    cpp17::pmr::memory_resource *m_upstream;
+    int                          m_countdown;
+
+  public:
+    LimitedResource(cpp17::pmr::memory_resource *up, int countdown)
+        : m_upstream(up), m_countdown(countdown) { }
+
+  protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (0 == --m_countdown)
+            throw std::bad_alloc();
+        return m_upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes,
+                       std::size_t alignment) override {
+        m_upstream->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
 // Force instantiation of whole classes
 template class cpp17::pmr::polymorphic_allocator<double>;
 template class SimpleVector<double,
                             cpp17::pmr::polymorphic_allocator<double> >;
 template class SimpleAllocator<double>;
 template class SimpleVector<double, SimpleAllocator<double> >;
+template class cpp17::pmr::static_polymorphic_allocator<
+    double, cpp17::pmr::monotonic_buffer_resource>;
+template class cpp17::pmr::static_polymorphic_allocator<
+    double, test_resource>;
+template class cpp17::pmr::static_polymorphic_allocator<
+    double, concurrent_test_resource>;
 
 //=============================================================================
 //                              MAIN PROGRAM
@@ -560,9 +620,20 @@ int main(int argc, char *argv[])
         r->deallocate(p, 5, 1);
         ASSERT(newDeleteCounters.blocks_outstanding() == 0);
         ASSERT(newDeleteCounters.bytes_outstanding() == 0);
+
+        // All new_delete_resource objects are interchangeable
+        new_delete_resource other;
+        ASSERT(other == *r);
+        ASSERT(*r == other);
+        p = other.allocate(5, 1);
+        r->deallocate(p, 5, 1);
+        ASSERT(newDeleteCounters.blocks_outstanding() == 0);
+        TestResource tr;
+        ASSERT(other != tr);
     }
 
-    cpp17::pmr::set_default_resource(&dfltTestRsrc);
+    ASSERT(new_delete_resource_singleton() ==
+           cpp17::pmr::set_default_resource(&dfltTestRsrc));
     ASSERT(cpp17::pmr::get_default_resource() == &dfltTestRsrc);
 
     std::cout << "Testing polymorphic allocator constructors\n";
@@ -799,6 +870,81 @@ int main(int argc, char *argv[])
     ASSERT(0 == dfltSimpleCounters.blocks_outstanding());
     ASSERT(0 == newDeleteCounters.blocks_outstanding());
 
+    std::cout << "Testing resource equality\n";
+    {
+        AllocCounters c1, c2;
+        SimpleAllocator<char> sa1(&c1), sa2(&c2);
+        resource_adaptor<SimpleAllocator<char>> r1(sa1), r1b(sa1), r2(sa2);
+
+        // Adaptors of the same type compare their allocators.
+        ASSERT(r1 == r1);
+        ASSERT(r1 == r1b);
+        ASSERT(r1 != r2);
+
+        // Adaptors of stateless allocators are all equal.
+        resource_adaptor<std::allocator<char>> s1, s2;
+        resource_adaptor<std::allocator<int>>  s3;
+        ASSERT(s1 == s2);
+        ASSERT(s1 == s3);  // Same type, by rebinding to `byte`
+
+        // Resources of different types are not equal.
+        new_delete_resource nd;
+        ASSERT(s1 != r1);
+        ASSERT(r1 != s1);
+        ASSERT(s1 != nd);
+        ASSERT(nd != s1);
+        ASSERT(nd == *new_delete_resource_singleton());
+        TestResource tr;
+        ASSERT(nd != tr);
+        ASSERT(r1 != tr);
+
+        // Polymorphic allocators compare their resources.
+        ASSERT(PMA<int>(&r1) == PMA<char>(&r1b));
+        ASSERT(PMA<int>(&r1) != PMA<int>(&r2));
+        ASSERT(PMA<int>(&s1) == PMA<int>(&s2));
+        ASSERT(0 == c1.blocks_outstanding());
+    }
+
+    std::cout << "Testing over-aligned allocation\n";
+    {
+        memory_resource *nd = new_delete_resource_singleton();
+        AllocCounters c;
+        SimpleAllocator<char> sa(&c);
+        resource_adaptor<SimpleAllocator<char>> ra(sa);
+
+        for (size_t align = 1; align <= 2 * 1024 * 1024; align *= 2) {
+            const size_t sizes[] = { 1, align, 3 * align + 5 };
+            for (size_t bytes : sizes) {
+                int ndBytes = newDeleteCounters.bytes_outstanding();
+                void *p = nd->allocate(bytes, align);
+                LOOP2_ASSERT(align, bytes, 0 == (size_t(p) & (align - 1)));
+                std::memset(p, 0xcc, bytes);
+
+                // Over-aligned blocks do not come from `operator new`.
+                LOOP2_ASSERT(align, bytes, align <= alignof(max_align_t) ||
+                             ndBytes == newDeleteCounters.bytes_outstanding());
+                nd->deallocate(p, bytes, align);
+                LOOP2_ASSERT(align, bytes,
+                             ndBytes == newDeleteCounters.bytes_outstanding());
+
+                // `SimpleAllocator` does not honor the alignment of the
+                // `aligned_chunk`s that `resource_adaptor` allocates for
+                // alignments of 32 and 64.
+                p = ra.allocate(bytes, align);
+                LOOP2_ASSERT(align, bytes, (align > 16 && align <= 64) ||
+                             0 == (size_t(p) & (align - 1)));
+                std::memset(p, 0xcc, bytes);
+
+                // Blocks aligned to more than 64 bytes are carved from a
+                // larger block with room for the worst-case padding.
+                LOOP2_ASSERT(align, bytes, align <= 64 ||
+                             c.bytes_outstanding() >= int(bytes + align));
+                ra.deallocate(p, bytes, align);
+                LOOP2_ASSERT(align, bytes, 0 == c.blocks_outstanding());
+            }
+        }
+    }
+
 // Older versions of gcc library don't support scoped_allocator construction
 // of pair.
 #if defined(__GNUC__) && (__GNUC__ > 4)
@@ -846,6 +992,381 @@ int main(int argc, char *argv[])
     ASSERT(cpp17::pmr::new_delete_resource_singleton() ==
            cpp17::pmr::get_default_resource());
 
+    std::cout << "Testing monotonic_buffer_resource\n";
+    {
+        test_resource tr;
+        {
+            monotonic_buffer_resource mr(&tr);
+            ASSERT(&tr == mr.upstream_resource());
+            ASSERT(mr == mr);
+            ASSERT(0 == tr.blocks_outstanding());  // Lazy first chunk
+
+            // Successive allocations come from one upstream chunk and are
+            // correctly aligned.
+            char *p1 = static_cast<char*>(mr.allocate(1, 1));
+            char *p2 = static_cast<char*>(mr.allocate(8, 8));
+            char *p3 = static_cast<char*>(mr.allocate(3, 2));
+            char *p4 = static_cast<char*>(mr.allocate(16, 16));
+            ASSERT(1 == tr.blocks_outstanding());
+            ASSERT(0 == (size_t(p2) & 7));
+            ASSERT(0 == (size_t(p3) & 1));
+            ASSERT(0 == (size_t(p4) & 15));
+            ASSERT(p1 < p2 && p2 < p3 && p3 < p4);
+
+            // Deallocation is a no-op, and says so
+            ASSERT(mr.deallocate_is_noop());
+            ASSERT(! tr.deallocate_is_noop());
+            ASSERT(! new_delete_resource_singleton()->deallocate_is_noop());
+            mr.deallocate(p2, 8, 8);
+            ASSERT(1 == tr.blocks_outstanding());
+            char *p5 = static_cast<char*>(mr.allocate(8, 8));
+            ASSERT(p5 > p4);
+
+            // Chunks grow geometrically
+            size_t prev_bytes = tr.bytes_allocated();
+            while (1 == tr.blocks_outstanding())
+                mr.allocate(8, 8);
+            size_t chunk1_bytes = prev_bytes;
+            size_t chunk2_bytes = tr.bytes_allocated() - prev_bytes;
+            LOOP2_ASSERT(chunk1_bytes, chunk2_bytes,
+                         chunk2_bytes > chunk1_bytes);
+
+            // Oversized and over-aligned requests get their own chunk
+            void *big = mr.allocate(100000, 4096);
+            ASSERT(3 == tr.blocks_outstanding());
+            ASSERT(0 == (size_t(big) & 4095));
+            std::memset(big, 0xcc, 100000);
+
+            mr.release();
+            ASSERT(0 == tr.blocks_outstanding());
+
+            // Resource is still usable after release
+            ASSERT(mr.allocate(10));
+            ASSERT(1 == tr.blocks_outstanding());
+
+            // Requests too big to fit in any chunk fail cleanly rather
+            // than wrapping around or growing the chunk size forever.
+            const size_t huge[] = { size_t(-1), size_t(-1) - 8,
+                                    size_t(-1) / 2 + 1 };
+            for (size_t i = 0; i < sizeof(huge) / sizeof(huge[0]); ++i) {
+                bool caught = false;
+                try {
+                    mr.allocate(huge[i], 8);
+                }
+                catch (const std::bad_alloc&) {
+                    caught = true;
+                }
+                LOOP_ASSERT(i, caught);
+            }
+            ASSERT(1 == tr.blocks_outstanding());
+            ASSERT(mr.allocate(10));
+
+            // Destructor releases remaining memory
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // A zero-byte block is not null, even before there is a buffer.
+        {
+            monotonic_buffer_resource mr(&tr);
+            void *p = mr.allocate(0, 1);
+            ASSERT(p);
+            ASSERT(mr.allocate(0, 1));
+            mr.deallocate(p, 0, 1);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // Initial buffer is used before upstream
+        alignas(16) char buffer[256];
+        {
+            monotonic_buffer_resource mr(buffer, sizeof(buffer), &tr);
+            size_t pre_bytes = tr.bytes_allocated();
+            void *p1 = mr.allocate(100, 4);
+            void *p2 = mr.allocate(100, 16);
+            ASSERT(buffer <= p1 && p1 < buffer + sizeof(buffer));
+            ASSERT(buffer <= p2 && p2 < buffer + sizeof(buffer));
+            ASSERT(0 == tr.blocks_outstanding());
+
+            void *p3 = mr.allocate(100, 4);  // Overflows to upstream
+            ASSERT(! (buffer <= p3 && p3 < buffer + sizeof(buffer)));
+            ASSERT(1 == tr.blocks_outstanding());
+            LOOP_ASSERT(tr.bytes_allocated() - pre_bytes,
+                        2 * sizeof(buffer) ==
+                        tr.bytes_allocated() - pre_bytes);
+
+            // After release, initial buffer is reused
+            mr.release();
+            ASSERT(0 == tr.blocks_outstanding());
+            ASSERT(p1 == mr.allocate(100, 4));
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // Use as resource for containers
+        {
+            typedef SimpleString<PMA<char> > String;
+            typedef PMA<String> Alloc;
+
+            monotonic_buffer_resource mr(&tr);
+            SimpleVector<String, Alloc> vx(&mr);
+            vx.push_back("hello");
+            vx.push_back("goodbye");
+            ASSERT("hello" == vx.front());
+            ASSERT("goodbye" == vx.back());
+            ASSERT(&mr == vx.front().get_allocator().resource());
+            ASSERT(1 == tr.blocks_outstanding());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing batch allocation\n";
+    {
+        test_resource tr;
+
+        // By default, each block is allocated and deallocated separately.
+        void *blocks[10];
+        tr.allocate_batch(blocks, 10, 24, 8);
+        ASSERT(10 == tr.blocks_outstanding());
+        for (int i = 0; i < 10; ++i)
+            std::memset(blocks[i], 0xcc, 24);
+        tr.deallocate_batch(blocks, 4, 24, 8);
+        ASSERT(6 == tr.blocks_outstanding());
+        tr.deallocate_batch(blocks + 4, 6, 24, 8);
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // If an allocation fails, the blocks already allocated are freed.
+        {
+            LimitedResource lr(&tr, 4);
+            bool caught = false;
+            try {
+                lr.allocate_batch(blocks, 10, 24, 8);
+            }
+            catch (const std::bad_alloc&) {
+                caught = true;
+            }
+            ASSERT(caught);
+            ASSERT(0 == tr.blocks_outstanding());
+        }
+
+        // A monotonic resource carves the blocks out of one allocation,
+        // each rounded up to the alignment.
+        {
+            CountingMonotonicResource mr(&tr);
+            mr.allocate(1, 1);
+            mr.allocate_batch(blocks, 10, 20, 8);
+            ASSERT(2 == mr.virtual_allocs());
+            for (int i = 0; i < 10; ++i) {
+                ASSERT(0 == (size_t(blocks[i]) & 7));
+                if (i > 0)
+                    ASSERT(static_cast<char*>(blocks[i - 1]) + 24 ==
+                           blocks[i]);
+            }
+            mr.allocate_batch(blocks, 3, 0, 16);
+            ASSERT(blocks[0] != blocks[1] && blocks[1] != blocks[2]);
+            mr.deallocate_batch(blocks, 3, 0, 16);
+            mr.allocate_batch(blocks, 0, 8, 8);
+            ASSERT(3 == mr.virtual_allocs());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing allocate_at_least\n";
+    {
+        test_resource tr;
+
+        // By default, exactly the requested size is usable.
+        ASSERT(10 == tr.usable_size(10, 8));
+        allocation_result<void*> r = tr.allocate_at_least(10, 8);
+        ASSERT(10 == r.count);
+        ASSERT(1 == tr.blocks_outstanding());
+        tr.deallocate(r.ptr, r.count, 8);
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // `resource_adaptor` rounds explicitly aligned requests up to whole
+        // chunks of the alignment.
+        new_delete_resource *nd = new_delete_resource_singleton();
+        ASSERT(16 == nd->usable_size(10, 8));
+        ASSERT(16 == nd->usable_size(16, 8));
+        ASSERT(64 == nd->usable_size(1, 64));
+        ASSERT(10 == nd->usable_size(10, 0));
+        ASSERT(10 == nd->usable_size(10, 128));
+        r = nd->allocate_at_least(10, 8);
+        ASSERT(16 == r.count);
+        std::memset(r.ptr, 0xcc, r.count);
+        nd->deallocate(r.ptr, 10, 8);  // Either size may be used
+
+        // `polymorphic_allocator` passes the feedback on, in objects.
+        polymorphic_allocator<char> a(nd);
+        allocation_result<char*> ra = a.allocate_at_least(10);
+        ASSERT(10 == ra.count);  // `char` has no alignment to round to
+        a.deallocate(ra.ptr, ra.count);
+    }
+
+    std::cout << "Testing try_expand\n";
+    {
+        test_resource tr;
+
+        // By default, blocks cannot be resized in place.
+        void *p = tr.allocate(16);
+        ASSERT(! tr.try_expand(p, 16, 32));
+        ASSERT(! tr.try_expand(p, 16, 8));
+        tr.deallocate(p, 16);
+
+        {
+            monotonic_buffer_resource mr(&tr);
+            char *p1 = static_cast<char*>(mr.allocate(16, 8));
+            char *p2 = static_cast<char*>(mr.allocate(16, 8));
+
+            // The most recent block grows into the current buffer...
+            ASSERT(mr.try_expand(p2, 16, 100, 8));
+            char *p3 = static_cast<char*>(mr.allocate(8, 8));
+            ASSERT(p2 + 104 == p3);
+            std::memset(p2, 0xcc, 100);
+
+            // ...but only as far as the buffer goes.
+            ASSERT(! mr.try_expand(p3, 8, 1000000, 8));
+            ASSERT(1 == tr.blocks_outstanding());
+
+            // It can also shrink, returning space to the buffer.
+            ASSERT(mr.try_expand(p3, 8, 1, 8));
+            ASSERT(p3 + 1 == mr.allocate(1, 1));
+
+            // Earlier blocks can only shrink.
+            ASSERT(! mr.try_expand(p1, 16, 17, 8));
+            ASSERT(mr.try_expand(p1, 16, 8, 8));
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing thread default resource override\n";
+    {
+        TestResource ar, br;
+        memory_resource *global = get_default_resource();
+        ASSERT(nullptr == get_thread_default_resource());
+
+        ASSERT(nullptr == set_thread_default_resource(&ar));
+        ASSERT(&ar == get_thread_default_resource());
+        ASSERT(&ar == get_default_resource());
+        ASSERT(&ar == PMA<int>().resource());
+        ASSERT(&ar == PMA<int>(nullptr).resource());
+
+        // Setting the global default does not affect the override, and
+        // returns the previous global default.
+        ASSERT(global == set_default_resource(&br));
+        ASSERT(&ar == get_default_resource());
+
+        // Other threads see only the global default.
+        memory_resource *other_dflt = nullptr;
+        std::thread t([&other_dflt]{ other_dflt = get_default_resource(); });
+        t.join();
+        ASSERT(&br == other_dflt);
+
+        ASSERT(&ar == set_thread_default_resource(nullptr));
+        ASSERT(&br == get_default_resource());
+        ASSERT(&br == set_default_resource(global));
+        ASSERT(global == get_default_resource());
+
+        // Scope guards nest and restore the previous override.
+        {
+            default_resource_scope scope1(&ar);
+            ASSERT(&ar == get_default_resource());
+            {
+                default_resource_scope scope2(&br);
+                ASSERT(&br == get_default_resource());
+
+                SimpleVector<int, PMA<int> > v;
+                ASSERT(&br == v.get_allocator().resource());
+                ASSERT(1 == br.counters().blocks_outstanding());
+            }
+            ASSERT(&ar == get_default_resource());
+        }
+        ASSERT(nullptr == get_thread_default_resource());
+        ASSERT(global == get_default_resource());
+    }
+
+    std::cout << "Testing static_polymorphic_allocator\n";
+    {
+        typedef static_polymorphic_allocator<int, monotonic_buffer_resource>
+            SAlloc;
+
+        test_resource tr;
+        {
+            monotonic_buffer_resource mr(&tr);
+            SAlloc a1(&mr);
+            ASSERT(&mr == a1.resource());
+            ASSERT(&mr == a1.concrete_resource());
+
+            // Interoperable with polymorphic_allocator
+            PMA<int> pa = a1;
+            ASSERT(&mr == pa.resource());
+            ASSERT(pa == a1);
+            ASSERT(a1 == pa);
+            ASSERT(PMA<char>(&mr) == a1);
+            ASSERT(PMA<int>(&tr) != a1);
+
+            // Rebinding and conversion
+            typedef std::allocator_traits<SAlloc>::rebind_alloc<double>
+                SAllocD;
+            ASSERT((std::is_same<SAllocD,
+                    static_polymorphic_allocator<double,
+                                         monotonic_buffer_resource> >::value));
+            SAllocD a2(a1);
+            ASSERT(&mr == a2.resource());
+            ASSERT(a2 == a1);
+            ASSERT(a1 == a1.select_on_container_copy_construction());
+
+            int *p = a1.allocate(3);
+            ASSERT(p);
+            ASSERT(0 == (size_t(p) & (alignof(int) - 1)));
+            ASSERT(1 == tr.blocks_outstanding());
+            a1.deallocate(p, 3);
+
+            // Use with a standard container; elements get a polymorphic
+            // allocator for the same resource.
+            typedef SimpleString<PMA<char> > String;
+            typedef static_polymorphic_allocator<
+                String, monotonic_buffer_resource> SAllocS;
+            SAllocS sa(&mr);
+            std::vector<String, SAllocS> v(sa);
+            v.emplace_back("hello");
+            v.emplace_back("goodbye");
+            ASSERT("hello" == v.front());
+            ASSERT("goodbye" == v.back());
+            ASSERT(&mr == v.front().get_allocator().resource());
+            ASSERT(1 == tr.blocks_outstanding());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // A resource pointer does not convert implicitly, and null is
+        // rejected rather than replaced by the default resource, which is
+        // not a `monotonic_buffer_resource`.
+        ASSERT((! std::is_convertible<monotonic_buffer_resource*,
+                                      SAlloc>::value));
+        ASSERT((std::is_constructible<SAlloc,
+                                      monotonic_buffer_resource*>::value));
+        bool caught = false;
+        try {
+            SAlloc a(nullptr);
+        }
+        catch (const std::invalid_argument&) {
+            caught = true;
+        }
+        ASSERT(caught);
+
+        // Allocation does not go through the virtual function table.
+        {
+            CountingMonotonicResource cr(&tr);
+            PMA<int> pa(&cr);
+            int *p1 = pa.allocate(1);
+            ASSERT(1 == cr.virtual_allocs());
+            SAlloc sa(&cr);
+            int *p2 = sa.allocate(1);
+            ASSERT(1 == cr.virtual_allocs());
+            ASSERT(p1 != p2);
+            sa.deallocate(p2, 1);
+            pa.deallocate(p1, 1);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
     if (testStatus > 0) {
         std::cerr << "Error, non-zero test status = " << testStatus << "."
                   << std::endl;
@@ -0,0 +1,672 @@
+/* pool_resource.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <pool_resource.h>
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+
+namespace cpp17 {
+
+namespace {
+
+// Defaults and limits for `pool_options`.
+const size_t default_max_blocks_per_chunk = 1024;
+const size_t max_max_blocks_per_chunk     = size_t(1) << 16;
+const size_t default_largest_pool_block   = 4096;
+
+// Approximate size of the first chunk of each pool, from which the initial
+// number of blocks per chunk is computed.
+const size_t initial_chunk_bytes          = 1024;
+
+// A thread moves blocks between its cache and the depot in batches of about
+// this many bytes, subject to the limits below.
+const size_t cache_batch_bytes = 4096;
+const size_t min_cache_batch   = 4;
+const size_t max_cache_batch   = 64;
+
+// Return the number of blocks of `block_size` bytes moved at a time between
+// a thread cache and the depot.  A cache holding more than twice this number
+// is drained.
+size_t cache_batch(size_t block_size)
+{
+    size_t n = cache_batch_bytes / block_size;
+    return n < min_cache_batch ? min_cache_batch :
+           n > max_cache_batch ? max_cache_batch : n;
+}
+
+// Return `opts` with zero or out-of-range values replaced.
+pmr::pool_options normalize(pmr::pool_options opts)
+{
+    typedef pmr::__details::pool_size_class size_class;
+
+    if (0 == opts.max_blocks_per_chunk)
+        opts.max_blocks_per_chunk = default_max_blocks_per_chunk;
+    else if (opts.max_blocks_per_chunk > max_max_blocks_per_chunk)
+        opts.max_blocks_per_chunk = max_max_blocks_per_chunk;
+
+    if (0 == opts.largest_required_pool_block)
+        opts.largest_required_pool_block = default_largest_pool_block;
+    else if (opts.largest_required_pool_block > size_class::largest_limit)
+        opts.largest_required_pool_block = size_class::largest_limit;
+
+    // Round up to the block size of the largest pool.
+    opts.largest_required_pool_block = size_class::block_size(
+        size_class::index(opts.largest_required_pool_block));
+
+    return opts;
+}
+
+} // close unnamed namespace
+
+constexpr size_t pmr::__details::pool_size_class::granule;
+constexpr size_t pmr::__details::pool_size_class::linear_log2;
+constexpr size_t pmr::__details::pool_size_class::linear_limit;
+constexpr size_t pmr::__details::pool_size_class::linear_pools;
+constexpr size_t pmr::__details::pool_size_class::largest_limit;
+
+pmr::__details::block_pool::block_pool(size_t block_size)
+    : m_free(nullptr)
+    , m_unused(nullptr)
+    , m_unused_end(nullptr)
+    , m_chunks(nullptr)
+    , m_block_size(block_size)
+    , m_next_blocks(block_size < initial_chunk_bytes ?
+                    initial_chunk_bytes / block_size : 1)
+{
+}
+
+void *pmr::__details::block_pool::replenish(memory_resource *upstream,
+                                            size_t           max_blocks)
+{
+    size_t blocks = m_next_blocks < max_blocks ? m_next_blocks : max_blocks;
+    size_t bytes  = sizeof(chunk_header) + blocks * m_block_size;
+
+    chunk_header *chunk = static_cast<chunk_header*>(
+        upstream->allocate(bytes, alignof(chunk_header)));
+    chunk->m_prev  = m_chunks;
+    chunk->m_bytes = bytes;
+    m_chunks       = chunk;
+
+    // Grow geometrically up to the limit.
+    if (m_next_blocks < max_blocks)
+        m_next_blocks *= 2;
+
+    char *first  = reinterpret_cast<char*>(chunk + 1);
+    m_unused     = first + m_block_size;
+    m_unused_end = first + blocks * m_block_size;
+    return first;
+}
+
+void pmr::__details::block_pool::allocate_batch(memory_resource  *upstream,
+                                                size_t            max_blocks,
+                                                void            **out,
+                                                size_t            n)
+{
+    size_t i = 0;
+    for (; i < n && m_free; ++i) {
+        out[i] = m_free;
+        m_free = m_free->m_next;
+    }
+
+    try {
+        while (i < n) {
+            if (m_unused == m_unused_end)
+                out[i++] = replenish(upstream, max_blocks);
+            for (; i < n && m_unused != m_unused_end; ++i) {
+                out[i] = m_unused;
+                m_unused += m_block_size;
+            }
+        }
+    }
+    catch (...) {
+        // Return the blocks already taken.
+        deallocate_batch(out, i);
+        throw;
+    }
+}
+
+void pmr::__details::block_pool::deallocate_batch(void *const *blocks,
+                                                  size_t       n)
+{
+    // Link the blocks in order, so that they are reallocated in order.
+    for (size_t i = n; i > 0; --i)
+        deallocate(blocks[i - 1]);
+}
+
+void pmr::__details::block_pool::release(memory_resource *upstream)
+{
+    while (m_chunks) {
+        chunk_header *prev = m_chunks->m_prev;
+        upstream->deallocate(m_chunks, m_chunks->m_bytes,
+                             alignof(chunk_header));
+        m_chunks = prev;
+    }
+
+    m_free       = nullptr;
+    m_unused     = nullptr;
+    m_unused_end = nullptr;
+}
+
+pmr::__details::oversize_list::oversize_list()
+{
+    m_sentinel.m_prev = m_sentinel.m_next = &m_sentinel;
+}
+
+size_t pmr::__details::oversize_list::header_size(size_t alignment)
+{
+    // Round header size up to the alignment so that the block that follows
+    // it is correctly aligned.
+    if (alignment < alignof(max_align_t))
+        alignment = alignof(max_align_t);
+    return (sizeof(header) + alignment - 1) & ~(alignment - 1);
+}
+
+void *pmr::__details::oversize_list::allocate(memory_resource *upstream,
+                                              size_t           bytes,
+                                              size_t           alignment)
+{
+    size_t hsize = header_size(alignment);
+    size_t align = alignment > alignof(max_align_t) ?
+        alignment : alignof(max_align_t);
+    char *raw = static_cast<char*>(upstream->allocate(bytes + hsize, align));
+
+    header *h = reinterpret_cast<header*>(raw + hsize) - 1;
+    h->m_bytes     = bytes;
+    h->m_alignment = alignment;
+    h->m_prev      = &m_sentinel;
+    h->m_next      = m_sentinel.m_next;
+    h->m_next->m_prev = h;
+    m_sentinel.m_next = h;
+
+    return raw + hsize;
+}
+
+void pmr::__details::oversize_list::deallocate(memory_resource *upstream,
+                                               void            *p,
+                                               size_t           bytes,
+                                               size_t           alignment)
+{
+    size_t hsize = header_size(alignment);
+    size_t align = alignment > alignof(max_align_t) ?
+        alignment : alignof(max_align_t);
+    char *raw = static_cast<char*>(p) - hsize;
+
+    header *h = static_cast<header*>(p) - 1;
+    h->m_prev->m_next = h->m_next;
+    h->m_next->m_prev = h->m_prev;
+
+    upstream->deallocate(raw, bytes + hsize, align);
+}
+
+void pmr::__details::oversize_list::release(memory_resource *upstream)
+{
+    while (m_sentinel.m_next != &m_sentinel) {
+        header *h = m_sentinel.m_next;
+        deallocate(upstream, h + 1, h->m_bytes, h->m_alignment);
+    }
+}
+
+pmr::__details::block_pool *
+pmr::__details::create_pools(memory_resource *upstream, size_t num_pools)
+{
+    void *raw = upstream->allocate(num_pools * sizeof(block_pool),
+                                   alignof(block_pool));
+    block_pool *pools = static_cast<block_pool*>(raw);
+    for (size_t i = 0; i < num_pools; ++i)
+        ::new(pools + i) block_pool(pool_size_class::block_size(i));
+    return pools;
+}
+
+void pmr::__details::destroy_pools(memory_resource *upstream,
+                                   block_pool      *pools,
+                                   size_t           num_pools)
+{
+    for (size_t i = 0; i < num_pools; ++i) {
+        pools[i].release(upstream);
+        pools[i].~block_pool();
+    }
+    upstream->deallocate(pools, num_pools * sizeof(block_pool),
+                         alignof(block_pool));
+}
+
+pmr::unsynchronized_pool_resource::unsynchronized_pool_resource(
+    const pool_options& opts,
+    memory_resource    *upstream)
+    : m_upstream(upstream)
+    , m_options(normalize(opts))
+    , m_num_pools(__details::pool_size_class::index(
+                      m_options.largest_required_pool_block) + 1)
+    , m_pools(nullptr)
+{
+}
+
+pmr::unsynchronized_pool_resource::~unsynchronized_pool_resource()
+{
+    release();
+}
+
+void pmr::unsynchronized_pool_resource::create_pools()
+{
+    m_pools = __details::create_pools(m_upstream, m_num_pools);
+}
+
+void pmr::unsynchronized_pool_resource::release()
+{
+    m_oversize.release(m_upstream);
+
+    if (m_pools)
+        __details::destroy_pools(m_upstream, m_pools, m_num_pools);
+    m_pools = nullptr;
+}
+
+void pmr::unsynchronized_pool_resource::do_allocate_batch(void   **out,
+                                                          size_t   n,
+                                                          size_t   bytes,
+                                                          size_t   alignment)
+{
+    if (bytes <= m_options.largest_required_pool_block &&
+        alignment <= alignof(max_align_t)) {
+        if (! m_pools)
+            create_pools();
+        m_pools[__details::pool_size_class::index(bytes)].allocate_batch(
+            m_upstream, m_options.max_blocks_per_chunk, out, n);
+    }
+    else
+        memory_resource::do_allocate_batch(out, n, bytes, alignment);
+}
+
+void pmr::unsynchronized_pool_resource::do_deallocate_batch(
+    void *const *blocks,
+    size_t       n,
+    size_t       bytes,
+    size_t       alignment)
+{
+    if (bytes <= m_options.largest_required_pool_block &&
+        alignment <= alignof(max_align_t))
+        m_pools[__details::pool_size_class::index(bytes)].deallocate_batch(
+            blocks, n);
+    else
+        memory_resource::do_deallocate_batch(blocks, n, bytes, alignment);
+}
+
+struct pmr::__details::thread_cache
+{
+    struct block { block *m_next; };
+    struct list {
+        block  *m_head;
+        size_t  m_count;
+    };
+
+    thread_cache *m_prev;
+    thread_cache *m_next;
+    list         *m_lists;   // One per size class
+
+    static size_t bytes(size_t num_pools)
+        { return sizeof(thread_cache) + num_pools * sizeof(list); }
+};
+
+struct pmr::__details::thread_cache_map
+{
+    typedef synchronized_pool_resource::id_type id_type;
+
+    struct entry {
+        id_type                     m_id;
+        synchronized_pool_resource *m_owner;
+        thread_cache               *m_cache;
+    };
+
+    vector<entry> m_entries;
+
+    // On thread exit, return the caches of all live resources.
+    ~thread_cache_map();
+};
+
+namespace {
+
+typedef pmr::__details::thread_cache_map::id_type id_type;
+
+// Source of unique `synchronized_pool_resource` ids.  Zero is never used.
+atomic<id_type> next_resource_id(1);
+
+// Ids of the `synchronized_pool_resource`s that have not been destroyed.
+// Exiting threads consult this set (under its mutex) before touching a
+// resource, so a thread that outlives a resource never touches its memory.
+struct live_resource_registry {
+    mutex                   m_mutex;
+    unordered_set<id_type>  m_ids;
+};
+
+live_resource_registry& live_resources()
+{
+    static live_resource_registry registry;
+    return registry;
+}
+
+// The calling thread's caches, plus a one-entry lookup cache for the most
+// recently used resource.
+thread_local pmr::__details::thread_cache_map  t_caches;
+thread_local id_type                           t_last_id    = 0;
+thread_local pmr::__details::thread_cache     *t_last_cache = nullptr;
+
+} // close unnamed namespace
+
+pmr::__details::thread_cache_map::~thread_cache_map()
+{
+    live_resource_registry& registry = live_resources();
+    lock_guard<mutex> guard(registry.m_mutex);
+    for (entry& e : m_entries)
+        if (registry.m_ids.count(e.m_id))
+            e.m_owner->retire_cache(e.m_cache);
+}
+
+pmr::synchronized_pool_resource::synchronized_pool_resource(
+    const pool_options& opts,
+    memory_resource    *upstream)
+    : m_id(next_resource_id++)
+    , m_upstream(upstream)
+    , m_options(normalize(opts))
+    , m_num_pools(__details::pool_size_class::index(
+                      m_options.largest_required_pool_block) + 1)
+    , m_pools(nullptr)
+    , m_caches(nullptr)
+{
+    live_resource_registry& registry = live_resources();
+    lock_guard<mutex> guard(registry.m_mutex);
+    registry.m_ids.insert(m_id);
+}
+
+pmr::synchronized_pool_resource::~synchronized_pool_resource()
+{
+    {
+        // After this, exiting threads will no longer touch `*this`.
+        live_resource_registry& registry = live_resources();
+        lock_guard<mutex> guard(registry.m_mutex);
+        registry.m_ids.erase(m_id);
+    }
+
+    release();
+
+    while (m_caches) {
+        __details::thread_cache *next = m_caches->m_next;
+        m_upstream->deallocate(m_caches,
+                               __details::thread_cache::bytes(m_num_pools),
+                               alignof(max_align_t));
+        m_caches = next;
+    }
+}
+
+void pmr::synchronized_pool_resource::release()
+{
+    lock_guard<mutex> guard(m_mutex);
+
+    // Cached blocks belong to the chunks being released.
+    for (__details::thread_cache *c = m_caches; c; c = c->m_next)
+        for (size_t i = 0; i < m_num_pools; ++i) {
+            c->m_lists[i].m_head  = nullptr;
+            c->m_lists[i].m_count = 0;
+        }
+
+    m_oversize.release(m_upstream);
+
+    if (m_pools)
+        __details::destroy_pools(m_upstream, m_pools, m_num_pools);
+    m_pools = nullptr;
+}
+
+pmr::__details::thread_cache *pmr::synchronized_pool_resource::local_cache()
+{
+    using __details::thread_cache_map;
+
+    if (t_last_id == m_id)
+        return t_last_cache;
+
+    for (thread_cache_map::entry& e : t_caches.m_entries)
+        if (e.m_id == m_id) {
+            t_last_id    = m_id;
+            t_last_cache = e.m_cache;
+            return e.m_cache;
+        }
+
+    // First use of this resource by this thread.
+    __details::thread_cache *cache = create_cache();
+
+    {
+        // Forget about resources that have since been destroyed.
+        live_resource_registry& registry = live_resources();
+        lock_guard<mutex> guard(registry.m_mutex);
+        vector<thread_cache_map::entry>& entries = t_caches.m_entries;
+        entries.erase(remove_if(entries.begin(), entries.end(),
+                                [&registry](thread_cache_map::entry& e) {
+                                    return ! registry.m_ids.count(e.m_id);
+                                }),
+                      entries.end());
+    }
+
+    t_caches.m_entries.push_back(
+        thread_cache_map::entry{ m_id, this, cache });
+    t_last_id    = m_id;
+    t_last_cache = cache;
+    return cache;
+}
+
+pmr::__details::thread_cache *pmr::synchronized_pool_resource::create_cache()
+{
+    using __details::thread_cache;
+
+    lock_guard<mutex> guard(m_mutex);
+
+    void *raw = m_upstream->allocate(thread_cache::bytes(m_num_pools),
+                                     alignof(max_align_t));
+    thread_cache *cache = static_cast<thread_cache*>(raw);
+    cache->m_lists = reinterpret_cast<thread_cache::list*>(cache + 1);
+    for (size_t i = 0; i < m_num_pools; ++i) {
+        cache->m_lists[i].m_head  = nullptr;
+        cache->m_lists[i].m_count = 0;
+    }
+
+    cache->m_prev = nullptr;
+    cache->m_next = m_caches;
+    if (m_caches)
+        m_caches->m_prev = cache;
+    m_caches = cache;
+
+    return cache;
+}
+
+void pmr::synchronized_pool_resource::retire_cache(
+    __details::thread_cache *cache)
+{
+    using __details::thread_cache;
+
+    lock_guard<mutex> guard(m_mutex);
+
+    for (size_t i = 0; i < m_num_pools; ++i)
+        for (thread_cache::block *b = cache->m_lists[i].m_head; b; ) {
+            thread_cache::block *next = b->m_next;
+            m_pools[i].deallocate(b);
+            b = next;
+        }
+
+    if (cache->m_prev)
+        cache->m_prev->m_next = cache->m_next;
+    else
+        m_caches = cache->m_next;
+    if (cache->m_next)
+        cache->m_next->m_prev = cache->m_prev;
+
+    m_upstream->deallocate(cache, thread_cache::bytes(m_num_pools),
+                           alignof(max_align_t));
+}
+
+void *pmr::synchronized_pool_resource::refill(__details::thread_cache *cache,
+                                              size_t                   index)
+{
+    using __details::thread_cache;
+
+    lock_guard<mutex> guard(m_mutex);
+
+    if (! m_pools)
+        m_pools = __details::create_pools(m_upstream, m_num_pools);
+
+    __details::block_pool& pool = m_pools[index];
+    size_t max_blocks = m_options.max_blocks_per_chunk;
+    size_t batch      = cache_batch(pool.block_size());
+
+    thread_cache::list& lst = cache->m_lists[index];
+    for (size_t n = 1; n < batch; ++n) {
+        thread_cache::block *b =
+            static_cast<thread_cache::block*>(pool.allocate(m_upstream,
+                                                            max_blocks));
+        b->m_next = lst.m_head;
+        lst.m_head = b;
+        ++lst.m_count;
+    }
+
+    return pool.allocate(m_upstream, max_blocks);
+}
+
+void pmr::synchronized_pool_resource::drain(__details::thread_cache *cache,
+                                            size_t                   index)
+{
+    using __details::thread_cache;
+
+    lock_guard<mutex> guard(m_mutex);
+
+    __details::block_pool& pool = m_pools[index];
+    size_t batch = cache_batch(pool.block_size());
+
+    thread_cache::list& lst = cache->m_lists[index];
+    for (; lst.m_count > batch; --lst.m_count) {
+        thread_cache::block *b = lst.m_head;
+        lst.m_head = b->m_next;
+        pool.deallocate(b);
+    }
+}
+
+void *pmr::synchronized_pool_resource::do_allocate(size_t bytes,
+                                                   size_t alignment)
+{
+    using __details::thread_cache;
+
+    if (bytes <= m_options.largest_required_pool_block &&
+        alignment <= alignof(max_align_t)) {
+        size_t              index = __details::pool_size_class::index(bytes);
+        thread_cache       *cache = local_cache();
+        thread_cache::list& lst   = cache->m_lists[index];
+        if (lst.m_head) {
+            thread_cache::block *ret = lst.m_head;
+            lst.m_head = ret->m_next;
+            --lst.m_count;
+            return ret;
+        }
+        return refill(cache, index);
+    }
+    else {
+        lock_guard<mutex> guard(m_mutex);
+        return m_oversize.allocate(m_upstream, bytes, alignment);
+    }
+}
+
+void pmr::synchronized_pool_resource::do_deallocate(void   *p,
+                                                    size_t  bytes,
+                                                    size_t  alignment)
+{
+    using __details::thread_cache;
+
+    if (bytes <= m_options.largest_required_pool_block &&
+        alignment <= alignof(max_align_t)) {
+        size_t              index = __details::pool_size_class::index(bytes);
+        thread_cache       *cache = local_cache();
+        thread_cache::list& lst   = cache->m_lists[index];
+        thread_cache::block *b    = static_cast<thread_cache::block*>(p);
+        b->m_next  = lst.m_head;
+        lst.m_head = b;
+        if (++lst.m_count >
+            2 * cache_batch(__details::pool_size_class::block_size(index)))
+            drain(cache, index);
+    }
+    else {
+        lock_guard<mutex> guard(m_mutex);
+        m_oversize.deallocate(m_upstream, p, bytes, alignment);
+    }
+}
+
+void pmr::synchronized_pool_resource::do_allocate_batch(void   **out,
+                                                        size_t   n,
+                                                        size_t   bytes,
+                                                        size_t   alignment)
+{
+    using __details::thread_cache;
+
+    if (bytes > m_options.largest_required_pool_block ||
+        alignment > alignof(max_align_t)) {
+        memory_resource::do_allocate_batch(out, n, bytes, alignment);
+        return;
+    }
+
+    // Take what the cache holds, then the rest from the depot under a
+    // single lock.
+    size_t              index = __details::pool_size_class::index(bytes);
+    thread_cache       *cache = local_cache();
+    thread_cache::list& lst   = cache->m_lists[index];
+    size_t i = 0;
+    for (; i < n && lst.m_head; ++i) {
+        out[i] = lst.m_head;
+        lst.m_head = lst.m_head->m_next;
+        --lst.m_count;
+    }
+    if (i == n)
+        return;
+
+    lock_guard<mutex> guard(m_mutex);
+    if (! m_pools)
+        m_pools = __details::create_pools(m_upstream, m_num_pools);
+    try {
+        m_pools[index].allocate_batch(m_upstream,
+                                      m_options.max_blocks_per_chunk,
+                                      out + i, n - i);
+    }
+    catch (...) {
+        m_pools[index].deallocate_batch(out, i);
+        throw;
+    }
+}
+
+void pmr::synchronized_pool_resource::do_deallocate_batch(
+    void *const *blocks,
+    size_t       n,
+    size_t       bytes,
+    size_t       alignment)
+{
+    using __details::thread_cache;
+
+    if (bytes > m_options.largest_required_pool_block ||
+        alignment > alignof(max_align_t)) {
+        memory_resource::do_deallocate_batch(blocks, n, bytes, alignment);
+        return;
+    }
+
+    size_t              index = __details::pool_size_class::index(bytes);
+    thread_cache       *cache = local_cache();
+    thread_cache::list& lst   = cache->m_lists[index];
+    for (size_t i = n; i > 0; --i) {
+        thread_cache::block *b = static_cast<thread_cache::block*>(
+            blocks[i - 1]);
+        b->m_next  = lst.m_head;
+        lst.m_head = b;
+    }
+    lst.m_count += n;
+    if (lst.m_count >
+        2 * cache_batch(__details::pool_size_class::block_size(index)))
+        drain(cache, index);
+}
+
+} // close namespace cpp17
+
+// end pool_resource.cpp
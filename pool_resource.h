@@ -0,0 +1,573 @@
+/* pool_resource.h                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#ifndef INCLUDED_POOL_RESOURCE_DOT_H
+#define INCLUDED_POOL_RESOURCE_DOT_H
+
+#include <polymorphic_allocator.h>
+#include <mutex>
+
+namespace cpp17 {
+namespace pmr {
+
+// Tuning parameters for the pool resources.  A value of zero means "use the
+// implementation default".  Conforms to the C++17 standard, section
+// [mem.res.pool.options], except that it has a constructor because C++11
+// aggregates cannot have default member initializers.
+struct pool_options
+{
+    size_t max_blocks_per_chunk;
+    size_t largest_required_pool_block;
+
+    pool_options(size_t max_blocks = 0, size_t largest_block = 0)
+        : max_blocks_per_chunk(max_blocks)
+        , largest_required_pool_block(largest_block) { }
+};
+
+namespace __details {
+
+// Mapping between block sizes and pool indexes.  Blocks up to 128 bytes are
+// pooled in 16-byte steps (to fit small nodes tightly), and larger blocks in
+// powers of two.  Every block size is a multiple of `alignof(max_align_t)`.
+struct pool_size_class
+{
+    static constexpr size_t granule       = 16;
+    static constexpr size_t linear_log2   = 7;
+    static constexpr size_t linear_limit  = size_t(1) << linear_log2;
+    static constexpr size_t linear_pools  = linear_limit / granule;
+    static constexpr size_t largest_limit = size_t(1) << 16;
+
+    static_assert(granule % alignof(max_align_t) == 0,
+                  "Pool granule must preserve maximal alignment");
+
+    // Return the index of the smallest pool whose blocks hold `bytes`.
+    static size_t index(size_t bytes);
+
+    // Return the size of the blocks in the pool at `index`.
+    static size_t block_size(size_t index);
+};
+
+// Pool of same-sized blocks carved out of chunks obtained from an upstream
+// resource.  Freed blocks are kept on an intrusive free list; fresh chunks
+// are handed out by bumping a pointer so that untouched memory is not
+// written until needed, and consecutive allocations are adjacent.
+class block_pool
+{
+    struct free_block { free_block *m_next; };
+
+    struct alignas(max_align_t) chunk_header {
+        chunk_header *m_prev;
+        size_t        m_bytes;
+    };
+
+    free_block   *m_free;
+    char         *m_unused;        // Never-used tail of the newest chunk
+    char         *m_unused_end;
+    chunk_header *m_chunks;
+    size_t        m_block_size;
+    size_t        m_next_blocks;   // Blocks in the next chunk
+
+    // Get a new chunk from `upstream` and allocate the first block from it.
+    void *replenish(memory_resource *upstream, size_t max_blocks);
+
+  public:
+    explicit block_pool(size_t block_size);
+
+    block_pool(const block_pool&) = delete;
+    block_pool& operator=(const block_pool&) = delete;
+
+    size_t block_size() const { return m_block_size; }
+
+    void *allocate(memory_resource *upstream, size_t max_blocks);
+    void  deallocate(void *p);
+
+    // Allocate `n` blocks into `out`, free blocks first and then
+    // consecutive fresh ones, or deallocate the `n` blocks in `blocks` so
+    // that they are reused in the same order.
+    void allocate_batch(memory_resource *upstream, size_t max_blocks,
+                        void **out, size_t n);
+    void deallocate_batch(void *const *blocks, size_t n);
+
+    // Return all chunks to `upstream`.
+    void release(memory_resource *upstream);
+};
+
+// List of blocks that are too big or too aligned to pool and are obtained
+// directly from upstream.  Each block is preceded by a header so that all
+// of them can be returned by `release()`, and any one of them can be
+// unlinked in constant time.
+class oversize_list
+{
+    struct header {
+        header *m_prev;
+        header *m_next;
+        size_t  m_bytes;
+        size_t  m_alignment;
+    };
+
+    header m_sentinel;
+
+    static size_t header_size(size_t alignment);
+
+  public:
+    oversize_list();
+
+    oversize_list(const oversize_list&) = delete;
+    oversize_list& operator=(const oversize_list&) = delete;
+
+    void *allocate(memory_resource *upstream, size_t bytes, size_t alignment);
+    void  deallocate(memory_resource *upstream, void *p,
+                     size_t bytes, size_t alignment);
+    void  release(memory_resource *upstream);
+};
+
+// Allocate from `upstream` and construct an array of `num_pools` pools, one
+// per size class.
+block_pool *create_pools(memory_resource *upstream, size_t num_pools);
+
+// Release and destroy the `num_pools` pools in `pools` and return the array
+// itself to `upstream`.
+void destroy_pools(memory_resource *upstream,
+                   block_pool      *pools,
+                   size_t           num_pools);
+
+// Per-thread cache of free blocks for one `synchronized_pool_resource`.
+struct thread_cache;
+
+// Per-thread map from `synchronized_pool_resource`s to their caches.
+struct thread_cache_map;
+
+} // end namespace __details
+
+// Memory resource that services small requests from pools of same-sized
+// blocks, each pool being replenished from an upstream resource in chunks of
+// geometrically increasing size.  Requests bigger than the largest pool
+// block, or with greater than maximal alignment, go directly to upstream.
+// Not thread safe.
+// Conforms to the C++17 standard, section [mem.res.pool].
+class unsynchronized_pool_resource : public memory_resource
+{
+    memory_resource           *m_upstream;
+    pool_options               m_options;
+    size_t                     m_num_pools;
+    __details::block_pool     *m_pools;   // Lazily allocated from upstream
+    __details::oversize_list   m_oversize;
+
+    void create_pools();
+
+  public:
+    unsynchronized_pool_resource(const pool_options& opts,
+                                 memory_resource    *upstream);
+
+    unsynchronized_pool_resource()
+        : unsynchronized_pool_resource(pool_options(),
+                                       get_default_resource()) { }
+    explicit unsynchronized_pool_resource(memory_resource *upstream)
+        : unsynchronized_pool_resource(pool_options(), upstream) { }
+    explicit unsynchronized_pool_resource(const pool_options& opts)
+        : unsynchronized_pool_resource(opts, get_default_resource()) { }
+
+    unsynchronized_pool_resource(const unsynchronized_pool_resource&) =
+        delete;
+    unsynchronized_pool_resource&
+        operator=(const unsynchronized_pool_resource&) = delete;
+
+    ~unsynchronized_pool_resource() override;
+
+    // Return all memory to upstream, even blocks not yet deallocated.
+    void release();
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+    pool_options     options() const { return m_options; }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const memory_resource& other) const noexcept override;
+
+    void  do_allocate_batch(void **out, size_t n, size_t bytes,
+                            size_t alignment) override;
+    void  do_deallocate_batch(void *const *blocks, size_t n, size_t bytes,
+                              size_t alignment) override;
+
+    // Pooled requests get a whole block of their size class.
+    size_t do_usable_size(size_t bytes, size_t alignment) const noexcept
+        override;
+
+    // A pooled block can be resized within its size class.
+    bool  do_try_expand(void *p, size_t old_bytes, size_t new_bytes,
+                        size_t alignment) override;
+
+    template <class, class> friend class static_polymorphic_allocator;
+};
+
+// Memory resource that services small requests from pools of same-sized
+// blocks and is safe to use from multiple threads concurrently.  Each thread
+// that uses the resource gets its own cache of free blocks for every size
+// class, so most allocations and deallocations take no lock.  A thread
+// refills an empty cache from, and drains an over-full cache to, a shared
+// depot (pools and upstream guarded by a mutex) a batch at a time.  A block
+// may be deallocated by a different thread than allocated it; it simply
+// joins the deallocating thread's cache.  When a thread exits, its caches
+// are returned to the depot.
+// Conforms to the C++17 standard, section [mem.res.pool].
+class synchronized_pool_resource : public memory_resource
+{
+    typedef unsigned long long id_type;
+
+    mutex                      m_mutex;     // Guards all members below
+    id_type                    m_id;        // Unique, never reused
+    memory_resource           *m_upstream;
+    pool_options               m_options;
+    size_t                     m_num_pools;
+    __details::block_pool     *m_pools;     // Lazily allocated from upstream
+    __details::oversize_list   m_oversize;
+    __details::thread_cache   *m_caches;    // One per thread using `*this`
+
+    friend struct __details::thread_cache_map;
+
+    // Return the calling thread's cache for this resource, creating it if
+    // needed.
+    __details::thread_cache *local_cache();
+    __details::thread_cache *create_cache();
+
+    // Return the blocks in `cache` to the depot and free `cache` itself.
+    void retire_cache(__details::thread_cache *cache);
+
+    // Move a batch of blocks between the depot and cache list `index`.
+    // `drain` leaves one batch in the list.
+    void *refill(__details::thread_cache *cache, size_t index);
+    void  drain(__details::thread_cache *cache, size_t index);
+
+  public:
+    synchronized_pool_resource(const pool_options& opts,
+                               memory_resource    *upstream);
+
+    synchronized_pool_resource()
+        : synchronized_pool_resource(pool_options(),
+                                     get_default_resource()) { }
+    explicit synchronized_pool_resource(memory_resource *upstream)
+        : synchronized_pool_resource(pool_options(), upstream) { }
+    explicit synchronized_pool_resource(const pool_options& opts)
+        : synchronized_pool_resource(opts, get_default_resource()) { }
+
+    synchronized_pool_resource(const synchronized_pool_resource&) = delete;
+    synchronized_pool_resource&
+        operator=(const synchronized_pool_resource&) = delete;
+
+    ~synchronized_pool_resource() override;
+
+    // Return all memory to upstream, even blocks not yet deallocated.  Must
+    // not be called concurrently with any other use of the resource.
+    void release();
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+    pool_options     options() const { return m_options; }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const memory_resource& other) const noexcept override;
+
+    void  do_allocate_batch(void **out, size_t n, size_t bytes,
+                            size_t alignment) override;
+    void  do_deallocate_batch(void *const *blocks, size_t n, size_t bytes,
+                              size_t alignment) override;
+
+    // Pooled requests get a whole block of their size class.
+    size_t do_usable_size(size_t bytes, size_t alignment) const noexcept
+        override;
+
+    // A pooled block can be resized within its size class.
+    bool  do_try_expand(void *p, size_t old_bytes, size_t new_bytes,
+                        size_t alignment) override;
+
+    template <class, class> friend class static_polymorphic_allocator;
+};
+
+// Memory resource that pools blocks of exactly one size and alignment, such
+// as the nodes of a node-based container.  Unlike the general pool
+// resources, there is no size-class lookup: a request for `Size` bytes at no
+// more than `Align` alignment is served straight from a single free list,
+// and fresh blocks are carved consecutively from contiguous slabs, so nodes
+// allocated together are adjacent in memory.  Requests of any other size go
+// directly to upstream.  Not thread safe.
+template <size_t Size, size_t Align = alignof(max_align_t)>
+class node_pool_resource : public memory_resource
+{
+    static_assert(Align <= alignof(max_align_t),
+                  "node_pool_resource does not support over-alignment");
+
+    static constexpr size_t default_max_blocks_per_chunk = 4096;
+
+  public:
+    // Size of each pooled block: `Size` rounded up to hold a free-list
+    // link and to keep consecutive blocks aligned for both `Align` and the
+    // link.
+    static constexpr size_t block_align =
+        Align < alignof(void*) ? alignof(void*) : Align;
+    static constexpr size_t block_size =
+        ((Size < sizeof(void*) ? sizeof(void*) : Size) + block_align - 1) &
+        ~(block_align - 1);
+
+  private:
+    memory_resource           *m_upstream;
+    size_t                     m_max_blocks_per_chunk;
+    __details::block_pool      m_pool;
+    __details::oversize_list   m_oversize;
+
+  public:
+    explicit node_pool_resource(memory_resource *upstream =
+                                    get_default_resource(),
+                                size_t max_blocks_per_chunk = 0)
+        : m_upstream(upstream)
+        , m_max_blocks_per_chunk(max_blocks_per_chunk ?
+                                 max_blocks_per_chunk :
+                                 default_max_blocks_per_chunk)
+        , m_pool(block_size) { }
+
+    node_pool_resource(const node_pool_resource&) = delete;
+    node_pool_resource& operator=(const node_pool_resource&) = delete;
+
+    ~node_pool_resource() override { release(); }
+
+    // Return all memory to upstream, even blocks not yet deallocated.
+    void release()
+    {
+        m_pool.release(m_upstream);
+        m_oversize.release(m_upstream);
+    }
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+    size_t max_blocks_per_chunk() const { return m_max_blocks_per_chunk; }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const memory_resource& other) const noexcept override
+        { return this == &other; }
+
+    void  do_allocate_batch(void **out, size_t n, size_t bytes,
+                            size_t alignment) override;
+    void  do_deallocate_batch(void *const *blocks, size_t n, size_t bytes,
+                              size_t alignment) override;
+
+    template <class, class> friend class static_polymorphic_allocator;
+};
+
+} // end namespace pmr
+
+///////////////////////////////////////////////////////////////////////////////
+// INLINE AND TEMPLATE FUNCTION IMPLEMENTATIONS
+///////////////////////////////////////////////////////////////////////////////
+
+inline
+size_t pmr::__details::pool_size_class::index(size_t bytes)
+{
+    if (bytes <= linear_limit)
+        return bytes ? (bytes - 1) / granule : 0;
+
+    // Index of the smallest power of two not less than `bytes`, counting
+    // from the last linear pool (`linear_limit` itself).
+    size_t log2 = 8 * sizeof(unsigned long) -
+        __builtin_clzl((unsigned long) (bytes - 1));
+    return linear_pools - 1 + log2 - linear_log2;
+}
+
+inline
+size_t pmr::__details::pool_size_class::block_size(size_t index)
+{
+    if (index < linear_pools)
+        return (index + 1) * granule;
+    else
+        return linear_limit << (index - linear_pools + 1);
+}
+
+inline
+void *pmr::__details::block_pool::allocate(memory_resource *upstream,
+                                           size_t           max_blocks)
+{
+    if (m_free) {
+        free_block *ret = m_free;
+        m_free = ret->m_next;
+        return ret;
+    }
+    else if (m_unused != m_unused_end) {
+        void *ret = m_unused;
+        m_unused += m_block_size;
+        return ret;
+    }
+    else
+        return replenish(upstream, max_blocks);
+}
+
+inline
+void pmr::__details::block_pool::deallocate(void *p)
+{
+    free_block *b = static_cast<free_block*>(p);
+    b->m_next = m_free;
+    m_free = b;
+}
+
+inline
+void *pmr::unsynchronized_pool_resource::do_allocate(size_t bytes,
+                                                     size_t alignment)
+{
+    if (bytes <= m_options.largest_required_pool_block &&
+        alignment <= alignof(max_align_t)) {
+        if (! m_pools)
+            create_pools();
+        return m_pools[__details::pool_size_class::index(bytes)].allocate(
+            m_upstream, m_options.max_blocks_per_chunk);
+    }
+    else
+        return m_oversize.allocate(m_upstream, bytes, alignment);
+}
+
+inline
+void pmr::unsynchronized_pool_resource::do_deallocate(void   *p,
+                                                      size_t  bytes,
+                                                      size_t  alignment)
+{
+    if (bytes <= m_options.largest_required_pool_block &&
+        alignment <= alignof(max_align_t))
+        m_pools[__details::pool_size_class::index(bytes)].deallocate(p);
+    else
+        m_oversize.deallocate(m_upstream, p, bytes, alignment);
+}
+
+inline
+bool pmr::unsynchronized_pool_resource::do_is_equal(
+    const memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+inline
+bool pmr::synchronized_pool_resource::do_is_equal(
+    const memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+inline
+size_t pmr::unsynchronized_pool_resource::do_usable_size(
+    size_t bytes,
+    size_t alignment) const noexcept
+{
+    if (bytes <= m_options.largest_required_pool_block &&
+        alignment <= alignof(max_align_t))
+        return __details::pool_size_class::block_size(
+            __details::pool_size_class::index(bytes));
+    else
+        return bytes;
+}
+
+inline
+bool pmr::unsynchronized_pool_resource::do_try_expand(void   *,
+                                                       size_t  old_bytes,
+                                                       size_t  new_bytes,
+                                                       size_t  alignment)
+{
+    typedef __details::pool_size_class size_class;
+
+    size_t largest = m_options.largest_required_pool_block;
+    return old_bytes <= largest && new_bytes <= largest &&
+        alignment <= alignof(max_align_t) &&
+        size_class::index(old_bytes) == size_class::index(new_bytes);
+}
+
+inline
+size_t pmr::synchronized_pool_resource::do_usable_size(
+    size_t bytes,
+    size_t alignment) const noexcept
+{
+    if (bytes <= m_options.largest_required_pool_block &&
+        alignment <= alignof(max_align_t))
+        return __details::pool_size_class::block_size(
+            __details::pool_size_class::index(bytes));
+    else
+        return bytes;
+}
+
+inline
+bool pmr::synchronized_pool_resource::do_try_expand(void   *,
+                                                     size_t  old_bytes,
+                                                     size_t  new_bytes,
+                                                     size_t  alignment)
+{
+    typedef __details::pool_size_class size_class;
+
+    size_t largest = m_options.largest_required_pool_block;
+    return old_bytes <= largest && new_bytes <= largest &&
+        alignment <= alignof(max_align_t) &&
+        size_class::index(old_bytes) == size_class::index(new_bytes);
+}
+
+template <size_t Size, size_t Align>
+constexpr size_t pmr::node_pool_resource<Size, Align>::block_align;
+
+template <size_t Size, size_t Align>
+constexpr size_t pmr::node_pool_resource<Size, Align>::block_size;
+
+template <size_t Size, size_t Align>
+constexpr size_t
+pmr::node_pool_resource<Size, Align>::default_max_blocks_per_chunk;
+
+template <size_t Size, size_t Align>
+inline
+void *pmr::node_pool_resource<Size, Align>::do_allocate(size_t bytes,
+                                                        size_t alignment)
+{
+    if (bytes == Size && alignment <= Align)
+        return m_pool.allocate(m_upstream, m_max_blocks_per_chunk);
+    else
+        return m_oversize.allocate(m_upstream, bytes, alignment);
+}
+
+template <size_t Size, size_t Align>
+inline
+void pmr::node_pool_resource<Size, Align>::do_deallocate(void   *p,
+                                                         size_t  bytes,
+                                                         size_t  alignment)
+{
+    if (bytes == Size && alignment <= Align)
+        m_pool.deallocate(p);
+    else
+        m_oversize.deallocate(m_upstream, p, bytes, alignment);
+}
+
+template <size_t Size, size_t Align>
+void pmr::node_pool_resource<Size, Align>::do_allocate_batch(
+    void   **out,
+    size_t   n,
+    size_t   bytes,
+    size_t   alignment)
+{
+    if (bytes == Size && alignment <= Align)
+        m_pool.allocate_batch(m_upstream, m_max_blocks_per_chunk, out, n);
+    else
+        memory_resource::do_allocate_batch(out, n, bytes, alignment);
+}
+
+template <size_t Size, size_t Align>
+void pmr::node_pool_resource<Size, Align>::do_deallocate_batch(
+    void *const *blocks,
+    size_t       n,
+    size_t       bytes,
+    size_t       alignment)
+{
+    if (bytes == Size && alignment <= Align)
+        m_pool.deallocate_batch(blocks, n);
+    else
+        memory_resource::do_deallocate_batch(blocks, n, bytes, alignment);
+}
+
+} // close namespace cpp17
+
+#endif // ! defined(INCLUDED_POOL_RESOURCE_DOT_H)
@@ -0,0 +1,731 @@
+/* pool_resource.t.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <pool_resource.h>
+#include <test_resource.h>
+#include <slist.h>
+#include <pmr_vector.h>
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+
+//==========================================================================
+//                  ASSERT TEST MACRO
+//--------------------------------------------------------------------------
+static int testStatus = 0;
+
+static void aSsErT(int c, const char *s, int i) {
+    if (c) {
+        std::cout << __FILE__ << ":" << i << ": error: " << s
+                  << "    (failed)" << std::endl;
+        if (testStatus >= 0 && testStatus <= 100) ++testStatus;
+    }
+}
+
+# define ASSERT(X) { aSsErT(!(X), #X, __LINE__); }
+//--------------------------------------------------------------------------
+#define LOOP_ASSERT(I,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\n"; \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP2_ASSERT(I,J,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " \
+                          << J << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP3_ASSERT(I,J,K,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\n";           \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP4_ASSERT(I,J,K,L,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP5_ASSERT(I,J,K,L,M,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J    \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\t" << #M << ": " << M << "\n";         \
+               aSsErT(1, #X, __LINE__); } }
+
+#define LOOP6_ASSERT(I,J,K,L,M,N,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J     \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": "  \
+                         << L << "\t" << #M << ": " << M << "\t" << #N     \
+                         << ": " << N << "\n"; aSsErT(1, #X, __LINE__); } }
+
+// Force instantiation of whole classes
+template class cpp17::pmr::vector<int>;
+
+int main(int argc, char *argv[])
+{
+    using namespace cpp17::pmr;
+    typedef __details::pool_size_class size_class;
+
+    std::cout << "Testing pool size classes\n";
+    {
+        ASSERT(0  == size_class::index(0));
+        ASSERT(0  == size_class::index(1));
+        ASSERT(0  == size_class::index(16));
+        ASSERT(1  == size_class::index(17));
+        ASSERT(7  == size_class::index(128));
+        ASSERT(8  == size_class::index(129));
+        ASSERT(8  == size_class::index(256));
+        ASSERT(9  == size_class::index(257));
+        for (size_t bytes = 1; bytes <= size_class::largest_limit; ++bytes) {
+            size_t i = size_class::index(bytes);
+            LOOP2_ASSERT(bytes, i, bytes <= size_class::block_size(i));
+            LOOP2_ASSERT(bytes, i,
+                         0 == i || bytes > size_class::block_size(i - 1));
+            LOOP2_ASSERT(bytes, i,
+                0 == size_class::block_size(i) % alignof(max_align_t));
+        }
+    }
+
+    std::cout << "Testing pool_options\n";
+    {
+        test_resource tr;
+        unsynchronized_pool_resource dflt(&tr);
+        ASSERT(&tr == dflt.upstream_resource());
+        ASSERT(0 < dflt.options().max_blocks_per_chunk);
+        ASSERT(0 < dflt.options().largest_required_pool_block);
+
+        unsynchronized_pool_resource custom(pool_options(8, 100), &tr);
+        ASSERT(8   == custom.options().max_blocks_per_chunk);
+        ASSERT(112 == custom.options().largest_required_pool_block);
+
+        unsynchronized_pool_resource huge(pool_options(size_t(-1),
+                                                       size_t(-1)), &tr);
+        ASSERT(size_t(-1) > huge.options().max_blocks_per_chunk);
+        ASSERT(size_class::largest_limit ==
+               huge.options().largest_required_pool_block);
+        ASSERT(0 == tr.blocks_outstanding());  // Nothing allocated yet
+    }
+
+    std::cout << "Testing unsynchronized_pool_resource\n";
+    {
+        test_resource tr;
+        {
+            unsynchronized_pool_resource pr(pool_options(4, 256), &tr);
+            ASSERT(pr == pr);
+
+            // First allocation allocates the pool array and a chunk.
+            void *p1 = pr.allocate(24, 8);
+            ASSERT(2 == tr.blocks_outstanding());
+
+            // Blocks of the same size class come from the same chunk and
+            // are adjacent.
+            void *p2 = pr.allocate(32, 8);
+            ASSERT(2 == tr.blocks_outstanding());
+            ASSERT(static_cast<char*>(p1) + 32 == p2);
+            void *p3 = pr.allocate(20, 4);
+            void *p4 = pr.allocate(32, 16);
+            ASSERT(2 == tr.blocks_outstanding());
+            ASSERT(0 == (size_t(p4) & 15));
+
+            // Fifth block needs a new chunk (max_blocks_per_chunk == 4)
+            void *p5 = pr.allocate(32);
+            ASSERT(3 == tr.blocks_outstanding());
+
+            // Freed blocks are reused, last in first out
+            pr.deallocate(p2, 32, 8);
+            pr.deallocate(p3, 20, 4);
+            ASSERT(p3 == pr.allocate(32));
+            ASSERT(p2 == pr.allocate(17));
+            ASSERT(3 == tr.blocks_outstanding());
+
+            // Different size class uses a different chunk
+            void *p6 = pr.allocate(200, 8);
+            ASSERT(4 == tr.blocks_outstanding());
+            std::memset(p6, 0xcc, 200);
+            pr.deallocate(p6, 200, 8);
+            ASSERT(4 == tr.blocks_outstanding());
+
+            // Oversize and over-aligned blocks pass through to upstream
+            void *p7 = pr.allocate(1000, 8);
+            ASSERT(5 == tr.blocks_outstanding());
+            void *p8 = pr.allocate(16, 128);
+            ASSERT(6 == tr.blocks_outstanding());
+            ASSERT(0 == (size_t(p8) & 127));
+            void *p9 = pr.allocate(4000, 256);
+            ASSERT(7 == tr.blocks_outstanding());
+            ASSERT(0 == (size_t(p9) & 255));
+            std::memset(p9, 0xcc, 4000);
+            pr.deallocate(p8, 16, 128);
+            ASSERT(6 == tr.blocks_outstanding());
+            pr.deallocate(p7, 1000, 8);
+            ASSERT(5 == tr.blocks_outstanding());
+
+            (void) p1; (void) p4; (void) p5;
+
+            // release() returns everything, even outstanding blocks.
+            pr.release();
+            ASSERT(0 == tr.blocks_outstanding());
+
+            // Still usable after release
+            void *p10 = pr.allocate(40);
+            ASSERT(2 == tr.blocks_outstanding());
+            void *p11 = pr.allocate(4000);
+            ASSERT(3 == tr.blocks_outstanding());
+            (void) p10; (void) p11;
+
+            // Destructor releases remaining memory
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // Chunk sizes grow geometrically until max_blocks_per_chunk.
+        {
+            unsynchronized_pool_resource pr(pool_options(100, 1024), &tr);
+            std::size_t prev_bytes = 0, chunk_bytes = 0, chunks = 0;
+            pr.allocate(1024);
+            size_t base_bytes = tr.bytes_allocated();
+            size_t base_blocks = tr.blocks_outstanding();
+            for (int i = 0; i < 1000; ++i) {
+                pr.allocate(1024);
+                if (tr.blocks_outstanding() != base_blocks + chunks) {
+                    ++chunks;
+                    chunk_bytes = tr.bytes_allocated() - base_bytes;
+                    base_bytes = tr.bytes_allocated();
+                    LOOP2_ASSERT(prev_bytes, chunk_bytes,
+                                 prev_bytes <= chunk_bytes);
+                    prev_bytes = chunk_bytes;
+                }
+            }
+            LOOP_ASSERT(chunk_bytes, chunk_bytes > 100 * 1024);
+            LOOP_ASSERT(chunk_bytes, chunk_bytes < 101 * 1024);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing slist with unsynchronized_pool_resource\n";
+    {
+        test_resource tr;
+        {
+            unsynchronized_pool_resource pr(&tr);
+            slist<int> lst(&pr);
+            for (int i = 0; i < 100; ++i)
+                lst.push_back(i);
+            size_t blocks = tr.blocks_outstanding();
+            ASSERT(blocks < 10);
+
+            // Node churn does not touch upstream
+            for (int i = 0; i < 1000; ++i) {
+                lst.pop_front();
+                lst.push_back(i);
+            }
+            ASSERT(blocks == tr.blocks_outstanding());
+            ASSERT(100 == lst.size());
+            ASSERT(900 == lst.front());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing node_pool_resource\n";
+    {
+        ASSERT(8  == (node_pool_resource<1, 1>::block_size));
+        ASSERT(24 == (node_pool_resource<20, 8>::block_size));
+        ASSERT(32 == (node_pool_resource<20, 16>::block_size));
+
+        test_resource tr;
+        {
+            node_pool_resource<20, 4> nr(&tr, 8);
+            ASSERT(&tr == nr.upstream_resource());
+            ASSERT(8 == nr.max_blocks_per_chunk());
+            ASSERT(nr == nr);
+
+            char *p1 = static_cast<char*>(nr.allocate(20, 4));
+            char *p2 = static_cast<char*>(nr.allocate(20, 4));
+            ASSERT(1 == tr.blocks_outstanding());
+            ASSERT(p1 + 24 == p2);
+            nr.deallocate(p1, 20, 4);
+            ASSERT(p1 == nr.allocate(20, 2));
+
+            // Other sizes and alignments pass through to upstream
+            void *p3 = nr.allocate(24, 4);
+            void *p4 = nr.allocate(20, 8);
+            ASSERT(3 == tr.blocks_outstanding());
+            nr.deallocate(p3, 24, 4);
+            ASSERT(2 == tr.blocks_outstanding());
+            (void) p4;
+
+            nr.release();
+            ASSERT(0 == tr.blocks_outstanding());
+            ASSERT(nr.allocate(20, 4));
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing synchronized_pool_resource\n";
+    {
+        test_resource tr;
+        {
+            synchronized_pool_resource pr(pool_options(16, 256), &tr);
+            ASSERT(pr == pr);
+            ASSERT(&tr == pr.upstream_resource());
+            ASSERT(16  == pr.options().max_blocks_per_chunk);
+            ASSERT(256 == pr.options().largest_required_pool_block);
+            ASSERT(0 == tr.blocks_outstanding());
+
+            // First allocation creates the thread cache, the pools, and a
+            // chunk, and fills the cache with a batch of blocks.
+            void *p1 = pr.allocate(24, 8);
+            size_t blocks = tr.blocks_outstanding();
+            LOOP_ASSERT(blocks, 3 <= blocks);
+            void *p2 = pr.allocate(30, 8);
+            ASSERT(blocks == tr.blocks_outstanding());
+            ASSERT(0 == (size_t(p2) & 7));
+
+            // Freed blocks are reused by the same thread
+            pr.deallocate(p2, 30, 8);
+            ASSERT(p2 == pr.allocate(32));
+            pr.deallocate(p1, 24, 8);
+            pr.deallocate(p2, 32);
+
+            // Oversize and over-aligned blocks pass through to upstream
+            void *p3 = pr.allocate(1000, 8);
+            void *p4 = pr.allocate(16, 128);
+            ASSERT(blocks + 2 == tr.blocks_outstanding());
+            ASSERT(0 == (size_t(p4) & 127));
+            pr.deallocate(p3, 1000, 8);
+            ASSERT(blocks + 1 == tr.blocks_outstanding());
+            (void) p4;
+
+            // Churn far beyond one batch neither leaks nor grows upstream
+            // use without bound.
+            void *ptrs[1000];
+            for (int i = 0; i < 1000; ++i)
+                ptrs[i] = pr.allocate(48);
+            for (int i = 0; i < 1000; ++i)
+                pr.deallocate(ptrs[i], 48);
+            blocks = tr.blocks_outstanding();
+            for (int i = 0; i < 1000; ++i)
+                ptrs[i] = pr.allocate(48);
+            ASSERT(blocks == tr.blocks_outstanding());
+            for (int i = 0; i < 1000; ++i)
+                pr.deallocate(ptrs[i], 48);
+
+            // release() returns everything but the thread caches.
+            pr.release();
+            ASSERT(1 == tr.blocks_outstanding());
+            ASSERT(pr.allocate(40));
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing batch allocation\n";
+    {
+        test_resource tr;
+        void *blocks[10];
+        {
+            unsynchronized_pool_resource pr(pool_options(4, 256), &tr);
+
+            // Fresh blocks are consecutive within each chunk.
+            pr.allocate_batch(blocks, 10, 32, 8);
+            ASSERT(4 == tr.blocks_outstanding());  // Pools + 3 chunks
+            ASSERT(static_cast<char*>(blocks[0]) + 32 == blocks[1]);
+            for (int i = 0; i < 10; ++i)
+                std::memset(blocks[i], 0xcc, 32);
+
+            // Deallocated blocks are reused in the same order.
+            pr.deallocate_batch(blocks, 10, 32, 8);
+            ASSERT(blocks[0] == pr.allocate(32, 8));
+            ASSERT(blocks[1] == pr.allocate(32, 8));
+            void *more[3];
+            pr.allocate_batch(more, 3, 32, 8);
+            ASSERT(blocks[2] == more[0] && blocks[4] == more[2]);
+            ASSERT(4 == tr.blocks_outstanding());
+
+            // Oversize blocks pass through to upstream
+            pr.allocate_batch(blocks, 3, 1000, 8);
+            ASSERT(7 == tr.blocks_outstanding());
+            pr.deallocate_batch(blocks, 3, 1000, 8);
+            ASSERT(4 == tr.blocks_outstanding());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+        {
+            node_pool_resource<20, 4> nr(&tr, 8);
+            nr.allocate_batch(blocks, 10, 20, 4);
+            ASSERT(2 == tr.blocks_outstanding());
+            ASSERT(static_cast<char*>(blocks[0]) + 24 == blocks[1]);
+            nr.deallocate_batch(blocks, 10, 20, 4);
+            ASSERT(blocks[0] == nr.allocate(20, 4));
+            nr.allocate_batch(blocks, 2, 24, 4);
+            ASSERT(4 == tr.blocks_outstanding());
+            nr.deallocate_batch(blocks, 2, 24, 4);
+            ASSERT(2 == tr.blocks_outstanding());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+        {
+            synchronized_pool_resource pr(pool_options(16, 256), &tr);
+            void *many[200];
+            pr.allocate_batch(many, 200, 48, 8);
+            for (int i = 0; i < 200; ++i) {
+                ASSERT(many[i]);
+                std::memset(many[i], 0xcc, 48);
+            }
+            std::sort(many, many + 200);
+            ASSERT(std::adjacent_find(many, many + 200) == many + 200);
+            size_t blocks_used = tr.blocks_outstanding();
+
+            // Blocks go back through the thread cache and are reused.
+            pr.deallocate_batch(many, 200, 48, 8);
+            pr.allocate_batch(many, 200, 48, 8);
+            ASSERT(blocks_used == tr.blocks_outstanding());
+            pr.deallocate_batch(many, 200, 48, 8);
+
+            pr.allocate_batch(blocks, 2, 16, 128);
+            ASSERT(0 == (size_t(blocks[0]) & 127));
+            ASSERT(blocks_used + 2 == tr.blocks_outstanding());
+            pr.deallocate_batch(blocks, 2, 16, 128);
+            ASSERT(blocks_used == tr.blocks_outstanding());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing allocate_at_least\n";
+    {
+        test_resource tr;
+        {
+            unsynchronized_pool_resource pr(pool_options(0, 1024), &tr);
+            synchronized_pool_resource   sr(pool_options(0, 1024), &tr);
+            node_pool_resource<20>       nr(&tr);
+
+            // Pooled requests may use their whole block.
+            ASSERT(16   == pr.usable_size(0));
+            ASSERT(32   == pr.usable_size(20));
+            ASSERT(256  == pr.usable_size(200));
+            ASSERT(1024 == pr.usable_size(1000, 8));
+            ASSERT(1025 == pr.usable_size(1025));  // Oversize
+            ASSERT(20   == pr.usable_size(20, 64));  // Over-aligned
+            ASSERT(256  == sr.usable_size(200));
+            ASSERT(20   == nr.usable_size(20));  // Exact size only
+
+            allocation_result<void*> r = pr.allocate_at_least(200);
+            ASSERT(256 == r.count);
+            std::memset(r.ptr, 0xcc, r.count);
+            pr.deallocate(r.ptr, 200);  // Either size may be used
+            ASSERT(r.ptr == pr.allocate(256));
+            pr.deallocate(r.ptr, 256);
+
+            r = sr.allocate_at_least(100);
+            ASSERT(112 == r.count);
+            std::memset(r.ptr, 0xcc, r.count);
+            sr.deallocate(r.ptr, r.count);
+
+            // The allocator reports the room in objects.
+            polymorphic_allocator<char> ac(&pr);
+            allocation_result<char*> rc = ac.allocate_at_least(10);
+            ASSERT(16 == rc.count);
+            ac.deallocate(rc.ptr, rc.count);
+            polymorphic_allocator<double> ad(&pr);
+            allocation_result<double*> rd = ad.allocate_at_least(20);
+            ASSERT(32 == rd.count);
+            ad.deallocate(rd.ptr, rd.count);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        {
+            // `pmr::vector` grows into the whole block.
+            struct triple { double m_a, m_b, m_c; };
+            unsynchronized_pool_resource pr(&tr);
+            pmr::vector<triple> v(&pr);
+            v.reserve(9);  // 216 bytes, in a 256-byte block
+            ASSERT(10 == v.capacity());
+            const triple *data = v.data();
+            for (int i = 0; i < 10; ++i)
+                v.push_back(triple{ double(i), 0, 0 });
+            ASSERT(data == v.data());
+
+            // It needs no more reallocations than `std::vector`.
+            std::vector<triple, polymorphic_allocator<triple> > sv(&pr);
+            pmr::vector<triple> pv(&pr);
+            int std_reallocs = 0, pmr_reallocs = 0;
+            for (int i = 0; i < 3000; ++i) {
+                size_t sc = sv.capacity(), pc = pv.capacity();
+                sv.push_back(triple{ double(i), 0, 0 });
+                pv.emplace_back(triple{ double(i), 0, 0 });
+                std_reallocs += sc != sv.capacity();
+                pmr_reallocs += pc != pv.capacity();
+            }
+            LOOP2_ASSERT(std_reallocs, pmr_reallocs,
+                         pmr_reallocs <= std_reallocs);
+            ASSERT(2999 == pv.back().m_a);
+
+            // Pushing an element of the vector itself is safe, even when
+            // the vector grows.
+            pmr::vector<pmr::vector<int> > vv(&pr);
+            vv.emplace_back(3, 7);
+            for (int i = 0; i < 20; ++i)
+                vv.push_back(vv.front());
+            ASSERT(21 == vv.size());
+            ASSERT(3 == vv.back().size() && 7 == vv.back()[2]);
+            ASSERT(&pr == vv.back().get_allocator().resource());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing pmr::vector\n";
+    {
+        test_resource tr;
+        {
+            unsynchronized_pool_resource pr(&tr);
+            pmr::vector<int> v({ 1, 2, 3 }, &pr);
+            v.insert(v.begin() + 1, { 7, 8 });
+            v.emplace(v.begin(), 0);
+            v.insert(v.end(), 2, 9);
+            int expected[] = { 0, 1, 7, 8, 2, 3, 9, 9 };
+            ASSERT(8 == v.size());
+            ASSERT(std::equal(v.begin(), v.end(), expected));
+            ASSERT(v.begin() + 1 == v.erase(v.begin() + 1, v.begin() + 3));
+            ASSERT(6 == v.size() && 2 == v[2] && 9 == v.back());
+            v.pop_back();
+            ASSERT(5 == v.size() && 9 == v.back());
+
+            // Copies get the default resource unless one is given; moves
+            // keep the resource.
+            pmr::vector<int> c1(v);
+            pmr::vector<int> c2(v, &pr);
+            ASSERT(v == c1 && v == c2);
+            ASSERT(get_default_resource() == c1.get_allocator().resource());
+            ASSERT(&pr == c2.get_allocator().resource());
+            const int *data = c2.data();
+            pmr::vector<int> m1(std::move(c2));
+            ASSERT(data == m1.data() && c2.empty());
+            ASSERT(&pr == m1.get_allocator().resource());
+
+            // Moving to a different resource moves each element.
+            monotonic_buffer_resource mr(&tr);
+            pmr::vector<int> m2(std::move(m1), &mr);
+            ASSERT(v == m2);
+            ASSERT(&mr == m2.get_allocator().resource());
+            m1 = m2;
+            ASSERT(v == m1 && &pr == m1.get_allocator().resource());
+
+            m2.assign(3, 4);
+            ASSERT(3 == m2.size() && 4 == m2.front() && 4 == m2.back());
+            ASSERT(v < m2 && v != m2);
+            m2.assign(v.rbegin(), v.rend());
+            ASSERT(std::equal(m2.begin(), m2.end(), v.rbegin()));
+            m2.clear();
+            m2.shrink_to_fit();
+            ASSERT(0 == m2.capacity());
+
+            bool caught = false;
+            try {
+                v.at(v.size());
+            }
+            catch (const std::out_of_range&) {
+                caught = true;
+            }
+            ASSERT(caught);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        {
+            // An element constructor that throws leaves the vector
+            // unchanged, whether or not the buffer was being replaced.
+            struct thrower {
+                int m_value;
+                thrower(int v) : m_value(v) { if (v < 0) throw v; }
+            };
+            unsynchronized_pool_resource pr(&tr);
+            pmr::vector<thrower> v(&pr);
+            for (int i = 0; i < 4; ++i)
+                v.emplace_back(i);
+            for (int k = 0; k < 2; ++k) {
+                size_t capacity = v.capacity();
+                const thrower *data = v.data();
+                bool caught = false;
+                try {
+                    if (k)
+                        v.resize(v.capacity(), thrower(0));
+                    v.emplace_back(-1);
+                }
+                catch (int) {
+                    caught = true;
+                }
+                LOOP_ASSERT(k, caught);
+                LOOP_ASSERT(k, capacity == v.capacity());
+                LOOP_ASSERT(k, data == v.data());
+                LOOP_ASSERT(k, 3 == v[3].m_value);
+            }
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing try_expand\n";
+    {
+        test_resource tr;
+        {
+            unsynchronized_pool_resource pr(pool_options(0, 1024), &tr);
+            synchronized_pool_resource   sr(pool_options(0, 1024), &tr);
+
+            // Pooled blocks are resized within their size class.
+            void *p = pr.allocate(20);
+            ASSERT(pr.try_expand(p, 20, 32));
+            ASSERT(pr.try_expand(p, 32, 17));
+            ASSERT(! pr.try_expand(p, 17, 33));
+            ASSERT(! pr.try_expand(p, 17, 16));
+            pr.deallocate(p, 17);
+            p = pr.allocate(2000);
+            ASSERT(! pr.try_expand(p, 2000, 2001));  // Oversize
+            pr.deallocate(p, 2000);
+
+            p = sr.allocate(200);
+            ASSERT(sr.try_expand(p, 200, 256));
+            ASSERT(! sr.try_expand(p, 256, 257));
+            sr.deallocate(p, 256);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        {
+            // A vector at the top of an arena grows in place.
+            monotonic_buffer_resource mr(1 << 16, &tr);
+            pmr::vector<char> log(&mr);
+            log.push_back('x');
+            const char *data = log.data();
+            for (int i = 1; i < 30000; ++i)
+                log.push_back(char('a' + i % 26));
+            ASSERT(30000 == log.size());
+            ASSERT(data == log.data());
+            ASSERT(1 == tr.blocks_outstanding());
+            ASSERT('x' == log.front() && 'a' + 29999 % 26 == log.back());
+
+            // Another allocation stops the growth in place.
+            mr.allocate(1, 1);
+            log.resize(log.capacity());
+            log.push_back('y');
+            ASSERT(data != log.data());
+            ASSERT('y' == log.back());
+            ASSERT('x' == log.front());
+
+            // Shrinking at the top returns the space to the arena.
+            pmr::vector<int> v(&mr);
+            v.reserve(1000);
+            v.push_back(5);
+            v.shrink_to_fit();
+            ASSERT(1 == v.capacity());
+            ASSERT(5 == v.front());
+            ASSERT(static_cast<void*>(v.data() + 1) == mr.allocate(4, 4));
+
+            // The block at the top of the arena can also be resized
+            // directly.
+            void *p = mr.allocate(16, 8);
+            ASSERT(mr.try_expand(p, 16, 1000, 8));
+            ASSERT(mr.try_expand(p, 1000, 8, 8));
+            ASSERT(static_cast<char*>(p) + 8 == mr.allocate(1, 1));
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing synchronized_pool_resource with threads\n";
+    {
+        test_resource tr;
+        {
+            // Upstream `test_resource` is not thread-safe; the pool
+            // serializes its access to upstream.
+            synchronized_pool_resource pr(&tr);
+
+            const int num_threads = 4;
+            std::thread threads[num_threads];
+            int         sums[num_threads];
+            for (int t = 0; t < num_threads; ++t)
+                threads[t] = std::thread([&pr, &sums, t]{
+                    slist<int> lst(&pr);
+                    for (int i = 0; i < 1000; ++i)
+                        lst.push_back(i);
+                    for (int i = 0; i < 10000; ++i) {
+                        lst.pop_front();
+                        lst.push_back(i);
+                    }
+                    int sum = 0;
+                    for (int v : lst)
+                        sum += v;
+                    sums[t] = sum;
+                });
+            for (int t = 0; t < num_threads; ++t) {
+                threads[t].join();
+                LOOP2_ASSERT(t, sums[t], (9000 + 9999) * 500 == sums[t]);
+            }
+
+            // Blocks allocated in one thread and freed in another
+            const int num_ptrs = 1000;
+            void *ptrs[num_ptrs];
+            std::thread producer([&pr, &ptrs]{
+                for (int i = 0; i < num_ptrs; ++i)
+                    ptrs[i] = pr.allocate(64);
+            });
+            producer.join();
+            std::thread consumer([&pr, &ptrs]{
+                for (int i = 0; i < num_ptrs; ++i)
+                    pr.deallocate(ptrs[i], 64);
+            });
+            consumer.join();
+
+            // Exited threads returned their caches to the depot, so the
+            // main thread can reuse those blocks without new chunks.
+            size_t blocks = tr.blocks_outstanding();
+            for (int i = 0; i < num_ptrs; ++i)
+                ptrs[i] = pr.allocate(64);
+            LOOP2_ASSERT(blocks, tr.blocks_outstanding(),
+                         blocks + 1 >= tr.blocks_outstanding());
+            for (int i = 0; i < num_ptrs; ++i)
+                pr.deallocate(ptrs[i], 64);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // A thread that outlives a resource does not touch it on exit.
+        std::atomic<int> stage(0);
+        std::thread survivor;
+        {
+            synchronized_pool_resource pr(&tr);
+            survivor = std::thread([&pr, &stage]{
+                pr.deallocate(pr.allocate(16), 16);
+                stage = 1;
+                while (2 != stage)
+                    std::this_thread::yield();
+            });
+            while (1 != stage)
+                std::this_thread::yield();
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+        stage = 2;
+        survivor.join();
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing synchronized_pool_resource as default resource\n";
+    {
+        test_resource tr;
+        {
+            synchronized_pool_resource pr(&tr);
+            memory_resource *prev = set_default_resource(&pr);
+            {
+                pmr::vector<int> v;
+                ASSERT(&pr == v.get_allocator().resource());
+                for (int i = 0; i < 100; ++i)
+                    v.push_back(i);
+                ASSERT(99 == v.back());
+                ASSERT(0 < tr.blocks_outstanding());
+            }
+            set_default_resource(prev);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << (0 == testStatus ? "PASSED" : "FAILED") << std::endl;
+
+    return testStatus;
+}
+
+/* End pool_resource.t.cpp */
@@ -0,0 +1,159 @@
+/* rewindable_arena_resource.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include "rewindable_arena_resource.h"
+#include <stdexcept>
+#include <utility>
+
+namespace cpp17 {
+
+constexpr size_t pmr::rewindable_arena_resource::default_buffer_size;
+
+pmr::rewindable_arena_resource::rewindable_arena_resource(
+    memory_resource *upstream,
+    bool             tracking)
+    : rewindable_arena_resource(0, upstream, tracking)
+{
+}
+
+pmr::rewindable_arena_resource::rewindable_arena_resource(
+    size_t           initial_size,
+    memory_resource *upstream,
+    bool             tracking)
+    : m_upstream(upstream)
+    , m_initial_size(initial_size ? initial_size : default_buffer_size)
+    , m_arena(nullptr, 0, m_initial_size)
+    , m_spare(nullptr)
+    , m_tracking(tracking)
+    , m_level(nullptr)
+    , m_base_live(0)
+{
+}
+
+pmr::rewindable_arena_resource::~rewindable_arena_resource()
+{
+    release();
+}
+
+pmr::rewindable_arena_resource::mark_type
+pmr::rewindable_arena_resource::mark()
+{
+    mark_type ret(m_arena, nullptr);
+
+    if (m_tracking) {
+        level *lvl = static_cast<level*>(bump(sizeof(level),
+                                              alignof(level)));
+        lvl->m_prev    = m_level;
+        lvl->m_chunk   = ret.m_position.m_chunks;
+        lvl->m_current = ret.m_position.m_current;
+        lvl->m_live    = 0;
+        m_level        = lvl;
+        ret.m_level    = lvl;
+    }
+    return ret;
+}
+
+void pmr::rewindable_arena_resource::rewind(const mark_type& m)
+{
+    if (m_tracking) {
+        // Check before changing anything, so that the caller can recover.
+        size_t live = 0;
+        level *lvl  = m_level;
+        for (; lvl && lvl != m.m_level; lvl = lvl->m_prev)
+            live += lvl->m_live;
+        if (! lvl)
+            throw std::logic_error("rewindable_arena_resource::rewind: "
+                                   "mark was already discarded");
+        if (live + lvl->m_live)
+            throw std::logic_error("rewindable_arena_resource::rewind: "
+                                   "blocks allocated since mark are live");
+        m_level = lvl->m_prev;
+    }
+
+    // Return the chunks obtained since the mark, keeping the first of them
+    // (or the spare, if bigger) as the spare.
+    chunk_header *mark_chunk = m.m_position.m_chunks;
+    while (m_arena.m_chunks && m_arena.m_chunks != mark_chunk) {
+        chunk_header *chunk = m_arena.m_chunks;
+        m_arena.m_chunks = chunk->m_prev;
+        if (m_arena.m_chunks == mark_chunk &&
+            ! (m_spare && m_spare->m_size >= chunk->m_size)) {
+            std::swap(chunk, m_spare);
+            if (! chunk)
+                break;
+        }
+        m_upstream->deallocate(chunk, chunk->m_size, chunk->m_alignment);
+    }
+
+    m_arena = m.m_position;
+}
+
+void pmr::rewindable_arena_resource::release()
+{
+    m_arena.release_chunks(m_upstream);
+    if (m_spare) {
+        m_upstream->deallocate(m_spare, m_spare->m_size,
+                               m_spare->m_alignment);
+        m_spare = nullptr;
+    }
+
+    m_arena     = __details::arena_chunks(nullptr, 0, m_initial_size);
+    m_level     = nullptr;
+    m_base_live = 0;
+}
+
+void *pmr::rewindable_arena_resource::allocate_from_new_chunk(
+    size_t bytes,
+    size_t alignment)
+{
+    // Reuse the spare if it is big enough.
+    if (m_spare &&
+        m_spare->m_size >=
+            __details::arena_chunks::min_chunk_size(bytes, alignment) &&
+        m_spare->m_alignment >=
+            __details::arena_chunks::chunk_alignment(alignment)) {
+        chunk_header *chunk = m_spare;
+        m_spare = nullptr;
+        return m_arena.push_chunk(chunk, bytes, alignment);
+    }
+    return m_arena.allocate_from_new_chunk(m_upstream, bytes, alignment);
+}
+
+bool pmr::rewindable_arena_resource::allocated_after(
+    const void   *p,
+    chunk_header *chunk,
+    char         *current) const
+{
+    // Compare addresses as integers, since `p` may be in any chunk.
+    uintptr_t addr = uintptr_t(p);
+    for (chunk_header *c = m_arena.m_chunks; c && c != chunk; c = c->m_prev)
+        if (addr >= uintptr_t(c + 1) && addr <= uintptr_t(c) + c->m_size)
+            return true;
+    return chunk && addr >= uintptr_t(current) &&
+        addr <= uintptr_t(chunk) + chunk->m_size;
+}
+
+void pmr::rewindable_arena_resource::do_deallocate(void   *p,
+                                                   size_t  ,
+                                                   size_t  )
+{
+    if (! m_tracking)
+        return;  // Memory is reclaimed by `rewind` or `release`
+
+    // Count the block against the innermost mark it was allocated after.
+    for (level *lvl = m_level; lvl; lvl = lvl->m_prev)
+        if (allocated_after(p, lvl->m_chunk, lvl->m_current)) {
+            if (lvl->m_live)
+                --lvl->m_live;
+            return;
+        }
+    if (m_base_live)
+        --m_base_live;
+}
+
+} // close namespace cpp17
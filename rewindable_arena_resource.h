@@ -0,0 +1,148 @@
+/* rewindable_arena_resource.h                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#ifndef INCLUDED_REWINDABLE_ARENA_RESOURCE_DOT_H
+#define INCLUDED_REWINDABLE_ARENA_RESOURCE_DOT_H
+
+#include <polymorphic_allocator.h>
+
+namespace cpp17 {
+namespace pmr {
+
+// Arena resource, like `monotonic_buffer_resource`, that can also be rewound
+// to a checkpoint: `mark()` records the current position and `rewind(m)`
+// frees everything allocated since `m` in constant time, plus the time to
+// return the chunks obtained since then to upstream.  Marks nest and must
+// be rewound in last-in, first-out order; rewinding to a mark discards
+// every mark taken after it.  The chunk obtained first after a mark is kept
+// for reuse, so that repeatedly backtracking across a chunk boundary does
+// not return and reallocate it each time.
+//
+// In tracking mode, meant for debugging, the resource counts live blocks
+// per mark, and `rewind` throws `logic_error`, leaving the resource
+// unchanged, if a block allocated since the mark has not been deallocated
+// (e.g., a container still refers to it) or if the mark has already been
+// discarded.  Tracking makes deallocation take time proportional to the
+// number of marks and chunks, and `deallocate_is_noop()` is then false, so
+// that containers deallocate their blocks.  Not thread safe.
+class rewindable_arena_resource : public memory_resource
+{
+    static constexpr size_t default_buffer_size = 128 * sizeof(void*);
+
+    typedef __details::arena_chunks::chunk_header chunk_header;
+
+    // Live block count for a mark, in tracking mode.  Allocated from the
+    // arena itself, just after the mark, so that rewinding frees it.
+    struct level {
+        level        *m_prev;
+        chunk_header *m_chunk;      // Position of the mark
+        char         *m_current;
+        size_t        m_live;       // Live blocks allocated since the mark
+    };
+
+  public:
+    // A checkpoint returned by `mark()`.
+    class mark_type
+    {
+        __details::arena_chunks  m_position;
+        level                   *m_level;
+
+        mark_type(const __details::arena_chunks& position, level *lvl)
+            : m_position(position), m_level(lvl) { }
+
+        friend class rewindable_arena_resource;
+    };
+
+  private:
+    memory_resource         *m_upstream;
+    size_t                   m_initial_size;
+    __details::arena_chunks  m_arena;
+    chunk_header            *m_spare;      // Rewound chunk kept for reuse
+    bool                     m_tracking;
+    level                   *m_level;      // Innermost mark, if tracking
+    size_t                   m_base_live;  // Live blocks from before marks
+
+    // Allocate `bytes` at `alignment` without tracking.
+    void *bump(size_t bytes, size_t alignment);
+
+    // Get a new chunk (the spare or one from upstream) big enough for
+    // `bytes` at `alignment` and allocate from it.
+    void *allocate_from_new_chunk(size_t bytes, size_t alignment);
+
+    // Return true if `p` was allocated after position `current` of
+    // `chunk`.
+    bool allocated_after(const void   *p,
+                         chunk_header *chunk,
+                         char         *current) const;
+
+  public:
+    explicit rewindable_arena_resource(memory_resource *upstream,
+                                       bool             tracking = false);
+    rewindable_arena_resource(size_t           initial_size,
+                              memory_resource *upstream,
+                              bool             tracking = false);
+
+    rewindable_arena_resource()
+        : rewindable_arena_resource(get_default_resource()) { }
+
+    rewindable_arena_resource(const rewindable_arena_resource&) = delete;
+    rewindable_arena_resource&
+        operator=(const rewindable_arena_resource&) = delete;
+
+    ~rewindable_arena_resource() override;
+
+    // Return a checkpoint of the current position.
+    mark_type mark();
+
+    // Free everything allocated since `m` was taken.
+    void rewind(const mark_type& m);
+
+    // Return all chunks to upstream and discard every mark.
+    void release();
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+    bool tracking() const { return m_tracking; }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const memory_resource& other) const noexcept override
+        { return this == &other; }
+    bool  do_deallocate_is_noop() const noexcept override
+        { return ! m_tracking; }
+
+    template <class, class> friend class static_polymorphic_allocator;
+};
+
+}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// INLINE AND TEMPLATE FUNCTION IMPLEMENTATIONS
+///////////////////////////////////////////////////////////////////////////////
+
+inline
+void *cpp17::pmr::rewindable_arena_resource::bump(size_t bytes,
+                                                  size_t alignment)
+{
+    if (void *ret = m_arena.bump(bytes, alignment))
+        return ret;
+    return allocate_from_new_chunk(bytes, alignment);
+}
+
+inline
+void *cpp17::pmr::rewindable_arena_resource::do_allocate(size_t bytes,
+                                                         size_t alignment)
+{
+    void *ret = bump(bytes, alignment);
+    if (m_tracking)
+        ++(m_level ? m_level->m_live : m_base_live);
+    return ret;
+}
+
+#endif // ! defined(INCLUDED_REWINDABLE_ARENA_RESOURCE_DOT_H)
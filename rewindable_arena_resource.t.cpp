@@ -0,0 +1,309 @@
+/* rewindable_arena_resource.t.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <rewindable_arena_resource.h>
+#include <test_resource.h>
+#include <slist.h>
+#include <pmr_vector.h>
+
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+//==========================================================================
+//                  ASSERT TEST MACRO
+//--------------------------------------------------------------------------
+static int testStatus = 0;
+
+static void aSsErT(int c, const char *s, int i) {
+    if (c) {
+        std::cout << __FILE__ << ":" << i << ": error: " << s
+                  << "    (failed)" << std::endl;
+        if (testStatus >= 0 && testStatus <= 100) ++testStatus;
+    }
+}
+
+# define ASSERT(X) { aSsErT(!(X), #X, __LINE__); }
+//--------------------------------------------------------------------------
+#define LOOP_ASSERT(I,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\n"; \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP2_ASSERT(I,J,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " \
+                          << J << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP3_ASSERT(I,J,K,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\n";           \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP4_ASSERT(I,J,K,L,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP5_ASSERT(I,J,K,L,M,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J    \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\t" << #M << ": " << M << "\n";         \
+               aSsErT(1, #X, __LINE__); } }
+
+#define LOOP6_ASSERT(I,J,K,L,M,N,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J     \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": "  \
+                         << L << "\t" << #M << ": " << M << "\t" << #N     \
+                         << ": " << N << "\n"; aSsErT(1, #X, __LINE__); } }
+
+
+int main(int argc, char *argv[])
+{
+    using namespace cpp17::pmr;
+
+    std::cout << "Testing mark and rewind\n";
+    {
+        test_resource tr;
+        rewindable_arena_resource ar(&tr);
+        ASSERT(&tr == ar.upstream_resource());
+        ASSERT(! ar.tracking());
+        ASSERT(ar.deallocate_is_noop());
+        ASSERT(ar == ar);
+        rewindable_arena_resource other(&tr);
+        ASSERT(ar != other);
+
+        void *p1 = ar.allocate(100, 8);
+        rewindable_arena_resource::mark_type m = ar.mark();
+        void *p2 = ar.allocate(50, 8);
+        ASSERT(p1 != p2);
+        ar.rewind(m);
+        void *p3 = ar.allocate(50, 8);
+        ASSERT(p2 == p3);
+        ASSERT(1 == tr.blocks_outstanding());
+
+        // Marks nest.
+        ar.rewind(m);
+        rewindable_arena_resource::mark_type m1 = ar.mark();
+        void *a = ar.allocate(10, 1);
+        rewindable_arena_resource::mark_type m2 = ar.mark();
+        void *b = ar.allocate(20, 4);
+        ar.rewind(m2);
+        ASSERT(b == ar.allocate(20, 4));
+        ar.rewind(m1);
+        ASSERT(a == ar.allocate(10, 1));
+
+        // Deallocation does nothing.
+        ar.deallocate(a, 10, 1);
+        ASSERT(ar.allocate(10, 1) != a);
+
+        // A zero-byte block is not null, even before there is a chunk.
+        rewindable_arena_resource empty(&tr);
+        ASSERT(empty.allocate(0, 1));
+
+        // A request too big for any chunk throws rather than overflowing.
+        bool caught = false;
+        try {
+            ar.allocate(size_t(-1) / 2 + 1, 8);
+        }
+        catch (const std::bad_alloc&) {
+            caught = true;
+        }
+        ASSERT(caught);
+    }
+
+    std::cout << "Testing chunk returns\n";
+    {
+        test_resource tr;
+        rewindable_arena_resource ar(256, &tr);
+        void *first = ar.allocate(100, 8);
+        ASSERT(1 == tr.blocks_outstanding());
+
+        rewindable_arena_resource::mark_type m = ar.mark();
+        for (int i = 0; i < 10; ++i)
+            ar.allocate(1000, 8);
+        size_t chunks = tr.blocks_outstanding();
+        ASSERT(chunks > 2);
+
+        // Every chunk since the mark but one is returned; the first one is
+        // kept as a spare.
+        ar.rewind(m);
+        ASSERT(2 == tr.blocks_outstanding());
+        size_t bytes = tr.bytes_allocated();
+        ar.allocate(1000, 8);
+        ASSERT(2 == tr.blocks_outstanding());
+        ASSERT(bytes == tr.bytes_allocated());
+
+        // Backtracking across a chunk boundary reuses the spare.
+        ar.rewind(m);
+        for (int i = 0; i < 100; ++i) {
+            LOOP_ASSERT(i, first != ar.allocate(200, 8));
+            ar.rewind(m);
+        }
+        ASSERT(2 == tr.blocks_outstanding());
+        ASSERT(bytes == tr.bytes_allocated());
+
+        // Rewinding to a mark taken before any allocation keeps one chunk.
+        rewindable_arena_resource ar2(&tr);
+        rewindable_arena_resource::mark_type m0 = ar2.mark();
+        ar2.allocate(10000, 8);
+        ar2.allocate(10000, 8);
+        ASSERT(4 == tr.blocks_outstanding());
+        ar2.rewind(m0);
+        ASSERT(3 == tr.blocks_outstanding());
+        ar2.allocate(5000, 8);
+        ASSERT(3 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing release\n";
+    {
+        test_resource tr;
+        {
+            rewindable_arena_resource ar(256, &tr);
+            ar.allocate(100, 8);
+            rewindable_arena_resource::mark_type m = ar.mark();
+            ar.allocate(1000, 8);
+            ar.rewind(m);
+            ASSERT(2 == tr.blocks_outstanding());
+            ar.release();
+            ASSERT(0 == tr.blocks_outstanding());
+
+            // The arena is usable after `release`.
+            void *p = ar.allocate(100, 64);
+            ASSERT(0 == (size_t(p) & 63));
+            ASSERT(1 == tr.blocks_outstanding());
+        }
+        // The destructor releases everything.
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing tracking mode\n";
+    {
+        test_resource tr;
+        rewindable_arena_resource ar(&tr, true);
+        ASSERT(ar.tracking());
+        ASSERT(! ar.deallocate_is_noop());
+
+        rewindable_arena_resource::mark_type m = ar.mark();
+        {
+            vector<int> v(&ar);
+            for (int i = 0; i < 100; ++i)
+                v.push_back(i);
+
+            bool caught = false;
+            try {
+                ar.rewind(m);
+            }
+            catch (const std::logic_error&) {
+                caught = true;
+            }
+            ASSERT(caught);
+
+            // A failed rewind leaves the arena unchanged.
+            v.push_back(100);
+            for (int i = 0; i <= 100; ++i)
+                LOOP_ASSERT(i, i == v[i]);
+        }
+        ar.rewind(m);
+
+        // Nested marks: the rewind to the inner mark succeeds, but the
+        // outer one is blocked by a list allocated between them.
+        rewindable_arena_resource::mark_type m1 = ar.mark();
+        {
+            slist<int> lst(&ar);
+            for (int i = 0; i < 10; ++i)
+                lst.push_back(i);
+
+            rewindable_arena_resource::mark_type m2 = ar.mark();
+            {
+                vector<int> v(100, 1, &ar);
+                slist<int>  lst2(&ar);
+                lst2.push_back(1);
+            }
+            ar.rewind(m2);
+
+            bool caught = false;
+            try {
+                ar.rewind(m1);
+            }
+            catch (const std::logic_error&) {
+                caught = true;
+            }
+            ASSERT(caught);
+            ASSERT(10 == lst.size());
+            ASSERT(0 == lst.front());
+        }
+        ar.rewind(m1);
+
+        // Blocks allocated before a mark do not block rewinding to it,
+        // even if freed after it.
+        void *x = ar.allocate(100, 8);
+        rewindable_arena_resource::mark_type m3 = ar.mark();
+        void *y = ar.allocate(100, 8);
+        ar.deallocate(x, 100, 8);
+        bool caught = false;
+        try {
+            ar.rewind(m3);
+        }
+        catch (const std::logic_error&) {
+            caught = true;
+        }
+        ASSERT(caught);
+        ar.deallocate(y, 100, 8);
+        ar.rewind(m3);
+
+        // Blocks in chunks obtained after the mark are tracked, too.
+        rewindable_arena_resource::mark_type m4 = ar.mark();
+        void *big = ar.allocate(100000, 8);
+        caught = false;
+        try {
+            ar.rewind(m4);
+        }
+        catch (const std::logic_error&) {
+            caught = true;
+        }
+        ASSERT(caught);
+        ar.deallocate(big, 100000, 8);
+        ar.rewind(m4);
+    }
+
+    std::cout << "Testing stale marks\n";
+    {
+        test_resource tr;
+        rewindable_arena_resource ar(&tr, true);
+        rewindable_arena_resource::mark_type m1 = ar.mark();
+        rewindable_arena_resource::mark_type m2 = ar.mark();
+        ar.rewind(m1);
+
+        // Rewinding to `m1` discarded `m2`.
+        bool caught = false;
+        try {
+            ar.rewind(m2);
+        }
+        catch (const std::logic_error&) {
+            caught = true;
+        }
+        ASSERT(caught);
+
+        // So did `release`.
+        rewindable_arena_resource::mark_type m3 = ar.mark();
+        ar.release();
+        caught = false;
+        try {
+            ar.rewind(m3);
+        }
+        catch (const std::logic_error&) {
+            caught = true;
+        }
+        ASSERT(caught);
+    }
+
+    std::cout << (0 == testStatus ? "PASSED" : "FAILED") << std::endl;
+
+    return testStatus;
+}
+
+/* End rewindable_arena_resource.t.cpp */
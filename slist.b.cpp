@@ -0,0 +1,354 @@
+/* slist.b.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+// Memory-diffusion benchmark for `slist`: build many lists with their
+// nodes interleaved, measure traversal, then age the heap with random
+// inserts and erases across the lists and measure again.  Each memory
+// strategy is reported with traversal time per node and with measures of
+// how far apart successive nodes of a list lie, which stand in for cache
+// and TLB behavior without needing hardware counters:
+//
+//  - same line:  successive nodes within one 64-byte cache line
+//  - same page:  successive nodes within one 4 KiB page
+//  - near:       next node at most 256 bytes ahead (prefetcher-friendly)
+//  - median:     median distance, in bytes, between successive nodes
+//
+// Usage: slist.b [LISTS [NODES_PER_LIST [CHURN]]]
+//
+// CHURN is the number of insert/erase pairs during aging, as a multiple
+// of the total number of nodes.
+//
+// It then times tearing down a list and loading a list from a range,
+// element by element and in bulk, reporting the calls made to the
+// list's resource per element.
+
+#include <slist.h>
+#include <pool_resource.h>
+#include <mmap_arena_resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace {
+
+using namespace cpp17::pmr;
+
+typedef slist<long> list_type;
+
+// Deterministic pseudo-random numbers, so every strategy sees the same
+// sequence of operations.
+class random_source
+{
+    unsigned long long m_state;
+
+  public:
+    explicit random_source(unsigned long long seed) : m_state(seed) { }
+
+    std::size_t operator()(std::size_t n)
+    {
+        m_state = m_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return std::size_t(m_state >> 33) % n;
+    }
+};
+
+enum strategy {
+    global_heap,       // Every list uses `new_delete_resource`
+    shared_pool,       // Every list uses one `unsynchronized_pool_resource`
+    list_pool,         // Each list has its own `unsynchronized_pool_resource`
+    list_node_pool,    // Each list has its own `slist_node_resource`
+    list_monotonic,    // Each list has its own `monotonic_buffer_resource`
+    shared_arena,      // Every list uses one `mmap_arena_resource`
+    arena_pool,        // Shared pool whose upstream is an `mmap_arena_resource`
+    num_strategies
+};
+
+const char *const strategy_names[] = {
+    "global heap", "shared pool", "per-list pool", "per-list node pool",
+    "per-list monotonic", "shared mmap arena", "pool on mmap arena"
+};
+
+// Sink that keeps the optimizer from discarding the benchmarked work.
+volatile long sink;
+
+// Return the average time, in nanoseconds, to visit one node when
+// traversing every list.
+double time_traversal(const std::vector<list_type>& lists,
+                      std::size_t total_nodes)
+{
+    typedef std::chrono::steady_clock clock;
+
+    const int passes = 5;
+    long sum = 0;
+    clock::time_point start = clock::now();
+    for (int pass = 0; pass < passes; ++pass)
+        for (const list_type& list : lists)
+            for (long v : list)
+                sum += v;
+    clock::duration elapsed = clock::now() - start;
+    sink = sum;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() /
+        (double(passes) * total_nodes);
+}
+
+void report(const char                   *name,
+            const char                   *phase,
+            const std::vector<list_type>& lists,
+            std::size_t                   total_nodes)
+{
+    double ns = time_traversal(lists, total_nodes);
+
+    std::vector<std::size_t> distances;
+    distances.reserve(total_nodes);
+    std::size_t same_line = 0, same_page = 0, near = 0;
+    for (const list_type& list : lists) {
+        const long *prev = nullptr;
+        for (const long& v : list) {
+            if (prev) {
+                std::uintptr_t a = std::uintptr_t(prev);
+                std::uintptr_t b = std::uintptr_t(&v);
+                same_line += (a >> 6)  == (b >> 6);
+                same_page += (a >> 12) == (b >> 12);
+                near      += b > a && b - a <= 256;
+                distances.push_back(b > a ? b - a : a - b);
+            }
+            prev = &v;
+        }
+    }
+
+    std::size_t median = 0;
+    if (! distances.empty()) {
+        auto mid = distances.begin() + distances.size() / 2;
+        std::nth_element(distances.begin(), mid, distances.end());
+        median = *mid;
+    }
+    double pairs = distances.empty() ? 1.0 : double(distances.size());
+    std::printf("  %-20s %-6s %8.2f %9.1f%% %9.1f%% %7.1f%% %12zu\n",
+                name, phase, ns, 100.0 * same_line / pairs,
+                100.0 * same_page / pairs, 100.0 * near / pairs, median);
+    std::fflush(stdout);
+}
+
+void run(strategy s, std::size_t num_lists, std::size_t nodes_per_list,
+         std::size_t churn)
+{
+    // Resources are declared before, so destroyed after, the lists.
+    std::unique_ptr<mmap_arena_resource> arena;
+    std::unique_ptr<memory_resource> shared;
+    std::vector<std::unique_ptr<memory_resource> > per_list;
+    if (s == shared_arena || s == arena_pool)
+        arena.reset(new mmap_arena_resource());
+    if (s == shared_pool)
+        shared.reset(new unsynchronized_pool_resource());
+    else if (s == arena_pool)
+        shared.reset(new unsynchronized_pool_resource(arena.get()));
+    else if (s != global_heap && s != shared_arena)
+        for (std::size_t i = 0; i < num_lists; ++i)
+            per_list.emplace_back(
+                s == list_pool ?
+                    static_cast<memory_resource*>(
+                        new unsynchronized_pool_resource()) :
+                s == list_node_pool ?
+                    static_cast<memory_resource*>(
+                        new slist_node_resource<long>()) :
+                    static_cast<memory_resource*>(
+                        new monotonic_buffer_resource()));
+
+    std::vector<list_type> lists;
+    lists.reserve(num_lists);
+    for (std::size_t i = 0; i < num_lists; ++i) {
+        memory_resource *r = s == global_heap ?
+                                 new_delete_resource_singleton() :
+                             s == shared_arena ? arena.get() :
+                             s == shared_pool || s == arena_pool ?
+                                 shared.get() :
+                                 per_list[i].get();
+        lists.emplace_back(list_type::allocator_type(r));
+    }
+
+    // Build the lists a node at a time, round robin, so that nodes of
+    // different lists are allocated alternately.
+    const std::size_t total_nodes = num_lists * nodes_per_list;
+    for (std::size_t n = 0; n < nodes_per_list; ++n)
+        for (std::size_t i = 0; i < num_lists; ++i)
+            lists[i].push_back(long(n));
+    report(strategy_names[s], "fresh", lists, total_nodes);
+
+    // Age: erase a random node from one list and insert a node at a
+    // random position in another, keeping the total constant.
+    random_source rand(42);
+    for (std::size_t op = 0; op < churn * total_nodes; ++op) {
+        list_type& from = lists[rand(num_lists)];
+        if (from.empty())
+            continue;
+        auto it = from.begin();
+        for (std::size_t k = rand(from.size()); k > 0; --k)
+            ++it;
+        from.erase(it);
+
+        list_type& to = lists[rand(num_lists)];
+        it = to.begin();
+        for (std::size_t k = rand(to.size() + 1); k > 0; --k)
+            ++it;
+        to.emplace(it, long(op));
+    }
+    report(strategy_names[s], "aged", lists, total_nodes);
+}
+
+// Return the time, in nanoseconds, to destroy a list of `nodes` nodes
+// allocated from `r`.
+double time_teardown(memory_resource *r, std::size_t nodes)
+{
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point start;
+    {
+        list_type list(r);
+        for (std::size_t n = 0; n < nodes; ++n)
+            list.push_back(long(n));
+        start = clock::now();
+    }
+    clock::duration elapsed = clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count();
+}
+
+// Resource that forwards to `upstream` and counts calls to `allocate` and
+// `allocate_batch`.
+class counting_resource : public memory_resource
+{
+    memory_resource *m_upstream;
+    std::size_t      m_allocations;
+
+  public:
+    explicit counting_resource(memory_resource *upstream)
+        : m_upstream(upstream), m_allocations(0) { }
+
+    std::size_t allocations() const { return m_allocations; }
+
+  protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        ++m_allocations;
+        return m_upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes,
+                       std::size_t alignment) override {
+        m_upstream->deallocate(p, bytes, alignment);
+    }
+
+    void do_allocate_batch(void **out, std::size_t n, std::size_t bytes,
+                           std::size_t alignment) override {
+        ++m_allocations;
+        m_upstream->allocate_batch(out, n, bytes, alignment);
+    }
+
+    void do_deallocate_batch(void *const *blocks, std::size_t n,
+                             std::size_t bytes,
+                             std::size_t alignment) override {
+        m_upstream->deallocate_batch(blocks, n, bytes, alignment);
+    }
+
+    bool do_deallocate_is_noop() const noexcept override {
+        return m_upstream->deallocate_is_noop();
+    }
+
+    bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Load a list of `data.size()` elements from `data` into a list using
+// `upstream`, either with `push_back` or with one range `insert`, and
+// report the time and number of calls to the resource per element.
+void report_load(const char              *name,
+                 memory_resource         *upstream,
+                 const std::vector<long>& data,
+                 bool                     bulk)
+{
+    typedef std::chrono::steady_clock clock;
+
+    counting_resource counter(upstream);
+    list_type list(&counter);
+    clock::time_point start = clock::now();
+    if (bulk)
+        list.insert(list.end(), data.begin(), data.end());
+    else
+        for (long v : data)
+            list.push_back(v);
+    clock::duration elapsed = clock::now() - start;
+
+    double n = double(data.size());
+    std::printf("  %-20s %-10s %8.2f %12.4f\n", name,
+                bulk ? "range" : "push_back",
+                std::chrono::duration<double, std::nano>(elapsed).count() / n,
+                counter.allocations() / n);
+    std::fflush(stdout);
+}
+
+} // close unnamed namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t num_lists      = argc > 1 ? std::atol(argv[1]) : 1024;
+    std::size_t nodes_per_list = argc > 2 ? std::atol(argv[2]) : 256;
+    std::size_t churn          = argc > 3 ? std::atol(argv[3]) : 1;
+
+    std::printf("slist traversal after aging: %zu lists x %zu nodes, "
+                "churn %zux\n", num_lists, nodes_per_list, churn);
+    std::printf("  %-20s %-6s %8s %10s %10s %8s %12s\n", "strategy",
+                "phase", "ns/node", "same line", "same page", "near",
+                "median dist");
+
+    for (int s = 0; s < num_strategies; ++s)
+        run(strategy(s), num_lists, nodes_per_list, churn);
+
+    // A list whose resource does not deallocate is torn down without
+    // visiting its nodes ("winking out").
+    const std::size_t teardown_nodes = num_lists * nodes_per_list;
+    std::printf("\nteardown of one %zu-node list, us\n", teardown_nodes);
+    {
+        unsynchronized_pool_resource pool;
+        std::printf("  %-20s %10.1f\n", "pool",
+                    time_teardown(&pool, teardown_nodes) / 1000);
+    }
+    {
+        monotonic_buffer_resource arena;
+        std::printf("  %-20s %10.1f\n", "monotonic",
+                    time_teardown(&arena, teardown_nodes) / 1000);
+    }
+
+    // Loading from a range allocates the nodes together when the
+    // resource allows it.
+    std::vector<long> data(teardown_nodes);
+    for (std::size_t n = 0; n < data.size(); ++n)
+        data[n] = long(n);
+    std::printf("\nloading one %zu-node list\n", data.size());
+    std::printf("  %-20s %-10s %8s %12s\n", "resource", "method",
+                "ns/node", "calls/node");
+    for (int bulk = 0; bulk < 2; ++bulk) {
+        report_load("global heap", new_delete_resource_singleton(), data,
+                    bulk);
+        {
+            unsynchronized_pool_resource pool;
+            report_load("pool", &pool, data, bulk);
+        }
+        {
+            monotonic_buffer_resource arena;
+            report_load("monotonic", &arena, data, bulk);
+        }
+    }
+
+    return 0;
+}
+
+/* End slist.b.cpp */
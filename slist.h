@@ -10,8 +10,13 @@
 #define INCLUDED_SLIST_DOT_H
 
 #include <polymorphic_allocator.h>
+#include <pool_resource.h>
 #include <algorithm>
 #include <cassert>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
 
 namespace pmr = cpp17::pmr;
 
@@ -112,6 +117,12 @@ public:
 
   slist(allocator_type a = {})
     : m_head(), m_tail_p(&m_head), m_size(0), m_allocator(a) { }
+  explicit slist(size_type n, allocator_type a = {});
+  slist(size_type n, const Tp& v, allocator_type a = {});
+  template <typename InputIt, typename = typename
+              std::enable_if<! std::is_integral<InputIt>::value>::type>
+    slist(InputIt first, InputIt last, allocator_type a = {});
+  slist(std::initializer_list<Tp> il, allocator_type a = {});
   slist(const slist& other, allocator_type a = {});
   slist(slist&& other);
   slist(slist&& other, allocator_type a);
@@ -119,8 +130,22 @@ public:
 
   slist& operator=(const slist& other);
   slist& operator=(slist&& other);
+  slist& operator=(std::initializer_list<Tp> il)
+    { assign(il); return *this; }
   void swap(slist& other) noexcept;
 
+  // Replace the contents, assigning over existing elements and
+  // inserting or erasing only the difference.
+  template <typename InputIt, typename = typename
+              std::enable_if<! std::is_integral<InputIt>::value>::type>
+    void assign(InputIt first, InputIt last);
+  void assign(size_type n, const Tp& v);
+  void assign(std::initializer_list<Tp> il)
+    { assign(il.begin(), il.end()); }
+
+  void resize(size_type n);
+  void resize(size_type n, const Tp& v);
+
   size_t size() const noexcept { return m_size; }
   bool   empty() const noexcept { return 0 == m_size; }
 
@@ -142,6 +167,18 @@ public:
     { emplace(end(), std::forward<Args>(args)...); }
 
   iterator insert(iterator i, const Tp& v) { return emplace(i, v); }
+
+  // Insert several elements before `i`, returning an iterator to
+  // the first one.  When their number is known in advance, their
+  // nodes are allocated together and the elements are linked in
+  // with one splice.
+  iterator insert(iterator i, size_type n, const Tp& v);
+  template <typename InputIt, typename = typename
+              std::enable_if<! std::is_integral<InputIt>::value>::type>
+    iterator insert(iterator i, InputIt first, InputIt last);
+  iterator insert(iterator i, std::initializer_list<Tp> il)
+    { return insert(i, il.begin(), il.end()); }
+
   void push_front(const Tp& v)         { emplace(begin(), v); }
   void push_back(const Tp& v)          { emplace(end(), v); }
 
@@ -151,18 +188,48 @@ public:
   iterator erase(iterator i) { iterator e = i; return erase(i, ++e); }
   void pop_front() { erase(begin()); }
 
+  // Forget every element in O(1), without destroying it or
+  // deallocating its node.  Use only when the memory resource
+  // will reclaim the nodes, and everything the elements own, in
+  // bulk (e.g., a `monotonic_buffer_resource` about to be
+  // released) and the element destructors have no other effect.
+  void wink_out() noexcept;
+
   allocator_type get_allocator() const { return m_allocator; }
 
 private:
   using node_base = slist_details::node_base<Tp>;
   using node      = slist_details::node<Tp>;
 
+  template <typename InputIt>
+    iterator insert_range(iterator i, InputIt first, InputIt last,
+                          std::input_iterator_tag);
+  template <typename FwdIt>
+    iterator insert_range(iterator i, FwdIt first, FwdIt last,
+                          std::forward_iterator_tag);
+  template <typename Construct>
+    iterator insert_n(iterator i, size_type n, Construct construct);
+
+  // Nodes are allocated and deallocated in batches of up to
+  // this many.
+  static constexpr size_type node_batch = 64;
+
+  node *allocate_nodes(size_type n, node *&last);
+  void deallocate_nodes(node *first);
+
   node_base       m_head;
   node_base      *m_tail_p;
   size_t          m_size;
   allocator_type  m_allocator;
 };
 
+// Memory resource that pools nodes for `slist<Tp>`, for
+// lists that are built and traversed together.
+template <typename Tp>
+using slist_node_resource = pmr::node_pool_resource<
+  sizeof(slist_details::node<Tp>),
+  alignof(slist_details::node<Tp>)>;
+
 template <class Tp>
 inline void swap(slist<Tp>& a, slist<Tp>& b) noexcept { a.swap(b); }
 
@@ -181,6 +248,34 @@ inline bool operator!=(const slist<Tp>& a, const slist<Tp>& b) {
 
 ///////////// Implementation ///////////////////
 
+template <typename Tp>
+constexpr typename slist<Tp>::size_type slist<Tp>::node_batch;
+
+template <typename Tp>
+slist<Tp>::slist(size_type n, allocator_type a)
+  : slist(a) {
+  resize(n);
+}
+
+template <typename Tp>
+slist<Tp>::slist(size_type n, const Tp& v, allocator_type a)
+  : slist(a) {
+  insert(end(), n, v);
+}
+
+template <typename Tp>
+template <typename InputIt, typename>
+slist<Tp>::slist(InputIt first, InputIt last, allocator_type a)
+  : slist(a) {
+  insert(end(), first, last);
+}
+
+template <typename Tp>
+slist<Tp>::slist(std::initializer_list<Tp> il, allocator_type a)
+  : slist(a) {
+  insert(end(), il.begin(), il.end());
+}
+
 template <typename Tp>
 slist<Tp>::slist(const slist& other, allocator_type a)
   : slist(a) {
@@ -207,21 +302,23 @@ slist<Tp>::~slist() {
 template <typename Tp>
 slist<Tp>& slist<Tp>::operator=(const slist& other) {
   if (&other == this) return *this;
-  erase(begin(), end());
-  for (const Tp& v : other)
-    push_back(v);
+  assign(other.begin(), other.end());
   return *this;
 }
 
 template <typename Tp>
 slist<Tp>& slist<Tp>::operator=(slist&& other) {
   if (&other == this) return *this;
-  if (m_allocator == other.m_allocator) {
-    erase(begin(), end());
+  erase(begin(), end());
+  if (m_allocator == other.m_allocator)
     swap(other);
+  else {
+    // Nodes cannot change allocators, so move each element into
+    // a new node, then empty the source.
+    insert(end(), std::make_move_iterator(other.begin()),
+           std::make_move_iterator(other.end()));
+    other.erase(other.begin(), other.end());
   }
-  else
-    operator=(other);  // Copy assign
   return *this;
 }
 
@@ -236,6 +333,185 @@ void slist<Tp>::swap(slist& other) noexcept {
   other.m_tail_p = new_other_tail;
 }
 
+template <typename Tp>
+template <typename InputIt, typename>
+void slist<Tp>::assign(InputIt first, InputIt last) {
+  iterator i = begin();
+  for (; i != end() && first != last; ++i, ++first)
+    *i = *first;
+  if (first == last)
+    erase(i, end());
+  else
+    insert(end(), first, last);
+}
+
+template <typename Tp>
+void slist<Tp>::assign(size_type n, const Tp& v) {
+  iterator i = begin();
+  for (; i != end() && n > 0; ++i, --n)
+    *i = v;
+  if (0 == n)
+    erase(i, end());
+  else
+    insert(end(), n, v);
+}
+
+template <typename Tp>
+void slist<Tp>::resize(size_type n) {
+  if (n <= m_size)
+    erase(std::next(begin(), n), end());
+  else
+    insert_n(end(), n - m_size, [this](Tp *p) {
+        m_allocator.construct(p);
+      });
+}
+
+template <typename Tp>
+void slist<Tp>::resize(size_type n, const Tp& v) {
+  if (n <= m_size)
+    erase(std::next(begin(), n), end());
+  else
+    insert(end(), n - m_size, v);
+}
+
+template <typename Tp>
+typename slist<Tp>::iterator
+slist<Tp>::insert(iterator i, size_type n, const Tp& v) {
+  return insert_n(i, n, [this, &v](Tp *p) {
+      m_allocator.construct(p, v);
+    });
+}
+
+template <typename Tp>
+template <typename InputIt, typename>
+typename slist<Tp>::iterator
+slist<Tp>::insert(iterator i, InputIt first, InputIt last) {
+  return insert_range(i, first, last,
+    typename std::iterator_traits<InputIt>::iterator_category());
+}
+
+template <typename Tp>
+template <typename InputIt>
+typename slist<Tp>::iterator
+slist<Tp>::insert_range(iterator i, InputIt first, InputIt last,
+                        std::input_iterator_tag) {
+  // The length of a single-pass range is unknown, so insert the
+  // elements one at a time.
+  for (iterator pos = i; first != last; ++first, ++pos)
+    emplace(pos, *first);
+  return i;
+}
+
+template <typename Tp>
+template <typename FwdIt>
+typename slist<Tp>::iterator
+slist<Tp>::insert_range(iterator i, FwdIt first, FwdIt last,
+                        std::forward_iterator_tag) {
+  size_type n = std::distance(first, last);
+  return insert_n(i, n, [this, &first](Tp *p) {
+      m_allocator.construct(p, *first);
+      ++first;
+    });
+}
+
+// Insert `n` elements before `i`, constructing each in turn by
+// calling `construct` with its address.
+template <typename Tp>
+template <typename Construct>
+typename slist<Tp>::iterator
+slist<Tp>::insert_n(iterator i, size_type n, Construct construct) {
+  if (0 == n)
+    return i;
+
+  node *last;
+  node *chain = allocate_nodes(n, last);
+  node *p = chain;
+  try {
+    for (; p; p = p->m_next)
+      construct(std::addressof(p->m_value));
+  }
+  catch (...) {
+    // Recover resources if exception on constructor call.
+    for (node *q = chain; q != p; q = q->m_next)
+      m_allocator.destroy(std::addressof(q->m_value));
+    deallocate_nodes(chain);
+    throw;
+  }
+
+  last->m_next = i.m_prev->m_next;
+  i.m_prev->m_next = chain;
+  if (i.m_prev == m_tail_p)
+    m_tail_p = last;  // Added at end
+  m_size += n;
+  return i;
+}
+
+// Allocate `n > 0` nodes linked in order, returning the first and
+// setting `last` to the last.  If the resource does not
+// deallocate, one contiguous block holds all of the nodes, so
+// that a large list is obtained with one call; otherwise, the
+// nodes are requested a batch at a time.
+template <typename Tp>
+typename slist<Tp>::node *
+slist<Tp>::allocate_nodes(size_type n, node *&last) {
+  pmr::memory_resource *r = m_allocator.resource();
+  node_base chain;
+  node_base *tail = &chain;
+  if (r->deallocate_is_noop()) {
+    if (n > size_type(-1) / sizeof(node))
+      throw std::bad_alloc();
+    node *nodes = static_cast<node*>(
+      r->allocate(n * sizeof(node), alignof(node)));
+    for (node *p = nodes; p != nodes + n; ++p) {
+      tail->m_next = p;
+      tail = p;
+    }
+  }
+  else {
+    void *batch[node_batch];
+    try {
+      while (n > 0) {
+        size_type batch_size = std::min(n, node_batch);
+        r->allocate_batch(batch, batch_size, sizeof(node),
+                          alignof(node));
+        for (size_type k = 0; k < batch_size; ++k) {
+          tail->m_next = static_cast<node*>(batch[k]);
+          tail = tail->m_next;
+        }
+        n -= batch_size;
+      }
+    }
+    catch (...) {
+      tail->m_next = nullptr;
+      deallocate_nodes(chain.m_next);
+      throw;
+    }
+  }
+  tail->m_next = nullptr;
+  last = static_cast<node*>(tail);
+  return chain.m_next;
+}
+
+// Deallocate the chain of nodes starting at `first`, whose
+// elements have been destroyed.
+template <typename Tp>
+void slist<Tp>::deallocate_nodes(node *first) {
+  pmr::memory_resource *r = m_allocator.resource();
+  if (r->deallocate_is_noop())
+    return;
+  void     *batch[node_batch];
+  size_type batch_size = 0;
+  while (first) {
+    batch[batch_size++] = first;
+    first = first->m_next;
+    if (node_batch == batch_size || ! first) {
+      r->deallocate_batch(batch, batch_size, sizeof(node),
+                          alignof(node));
+      batch_size = 0;
+    }
+  }
+}
+
 template <typename Tp>
 template <typename... Args>
 typename slist<Tp>::iterator
@@ -264,23 +540,54 @@ slist<Tp>::emplace(iterator i, Args&&... args) {
 template <typename Tp>
 typename slist<Tp>::iterator
 slist<Tp>::erase(iterator b, iterator e) {
+  // If deallocation is a no-op, nodes need not be visited except
+  // to destroy their elements, so erasing a whole list of
+  // trivially destructible elements is O(1).
+  pmr::memory_resource *r = m_allocator.resource();
+  bool skip_deallocate = r->deallocate_is_noop();
+  if (std::is_trivially_destructible<Tp>::value && skip_deallocate &&
+      b.m_prev == &m_head && e.m_prev == m_tail_p) {
+    wink_out();
+    return b;
+  }
+
   node *erase_next = b.m_prev->m_next;
   node *erase_past = e.m_prev->m_next; // one past last erasure
   if (nullptr == erase_past)
     m_tail_p = b.m_prev;  // Erasing at tail
   b.m_prev->m_next = erase_past; // splice out sublist
+
+  // Deallocate the nodes a batch at a time.
+  void     *batch[node_batch];
+  size_type batch_size = 0;
   while (erase_next != erase_past) {
     node* old_node = erase_next;
     erase_next = erase_next->m_next;
     --m_size;
     m_allocator.destroy(std::addressof(old_node->m_value));
-    m_allocator.resource()->deallocate(old_node,
-                                       sizeof(node), alignof(node));
+    if (skip_deallocate)
+      continue;
+    batch[batch_size++] = old_node;
+    if (node_batch == batch_size) {
+      r->deallocate_batch(batch, batch_size, sizeof(node),
+                          alignof(node));
+      batch_size = 0;
+    }
   }
+  if (batch_size)
+    r->deallocate_batch(batch, batch_size, sizeof(node),
+                        alignof(node));
 
   return b;
 }
 
+template <typename Tp>
+void slist<Tp>::wink_out() noexcept {
+  m_head.m_next = nullptr;
+  m_tail_p      = &m_head;
+  m_size        = 0;
+}
+
 #endif // ! defined(INCLUDED_SLIST_DOT_H)
 
 // For best result when pasting into PowerPoint, set indent to 2
@@ -11,8 +11,13 @@
 #include <pmr_string.h>
 #include <test_resource.h>
 
+#include <algorithm>
 #include <iostream>
 #include <initializer_list>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
 
 //==========================================================================
 //                  ASSERT TEST MACRO
@@ -91,6 +96,71 @@ bool check(const Container& c,
         return false;
 }
 
+// Monotonic resource that counts calls to `allocate` and `deallocate`.
+class CountingMonotonicResource : public pmr::monotonic_buffer_resource
+{
+  public:
+    int m_allocations;
+    int m_deallocations;
+
+    explicit CountingMonotonicResource(pmr::memory_resource *upstream)
+        : pmr::monotonic_buffer_resource(upstream)
+        , m_allocations(0), m_deallocations(0) { }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        ++m_allocations;
+        return pmr::monotonic_buffer_resource::do_allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+        ++m_deallocations;
+        pmr::monotonic_buffer_resource::do_deallocate(p, bytes, alignment);
+    }
+};
+
+// Element type that counts its destructor calls.
+struct Counted {
+    static int s_destroyed;
+    int m_value;
+
+    Counted(int v) : m_value(v) { }
+    ~Counted() { ++s_destroyed; }
+};
+
+int Counted::s_destroyed = 0;
+
+// Element type that counts its copies.
+struct CopyCounted {
+    static int s_copies;
+    int m_value;
+
+    CopyCounted(int v) : m_value(v) { }
+    CopyCounted(const CopyCounted& other) : m_value(other.m_value)
+        { ++s_copies; }
+    CopyCounted(CopyCounted&& other) : m_value(other.m_value) { }
+};
+
+int CopyCounted::s_copies = 0;
+
+// Element type whose constructor throws on a chosen call.
+struct Throwing {
+    static int s_countdown;  // Throw when this reaches zero
+    static int s_live;
+    int m_value;
+
+    Throwing(int v) : m_value(v) {
+        if (0 == --s_countdown)
+            throw std::runtime_error("Throwing");
+        ++s_live;
+    }
+    Throwing(const Throwing& other) : Throwing(other.m_value) { }
+    ~Throwing() { --s_live; }
+};
+
+int Throwing::s_countdown = -1;
+int Throwing::s_live = 0;
+
 int main(int argc, char *argv[])
 {
     using namespace cpp17::pmr;
@@ -278,12 +348,15 @@ int main(int argc, char *argv[])
             test_resource tr2;
             pmr::polymorphic_allocator<cpp17::byte> ta2(&tr2);
 
-            // Extended move to a new allocator works just like a copy
+            // Extended move to a new allocator moves each element into a
+            // new node and empties the source.
             auto pre_move_blks = tr.blocks_outstanding();
-            slist<pmr::string> lst9(std::move(lst4), &tr2);
+            slist<pmr::string> lst4b(lst4, &tr);  // Copy
+            slist<pmr::string> lst9(std::move(lst4b), &tr2);
             ASSERT(lst9 == lst4);
+            ASSERT(lst4b.empty());
             ASSERT(check(lst4, { sixes, "7" }));
-            ASSERT(check(lst9, { sixes, "7" }));
+            ASSERT(check(lst9, { sixes, "7" }, ta2));
             ASSERT(tr.blocks_outstanding() == pre_move_blks);
             ASSERT(tr2.blocks_outstanding() == tr.blocks_outstanding());
             ASSERT(lst9.get_allocator() == ta2);
@@ -330,14 +403,17 @@ int main(int argc, char *argv[])
         {
             test_resource tr2;
 
-            // move-assign with different allocator is like copy-asign
+            // move-assign with different allocator moves the elements
+            // into new nodes and empties the source
             auto pre_move_blks = tr.blocks_outstanding();
+            slist<pmr::string> lst4b(lst4, &tr);  // Copy
             slist<pmr::string> lst12(&tr2);
             lst12.push_front("stuff");
-            lst12 = std::move(lst4);
+            lst12 = std::move(lst4b);
             ASSERT(lst12 == lst4);
+            ASSERT(lst4b.empty());
             ASSERT(check(lst4, { sixes, "7" }));
-            ASSERT(check(lst12, { sixes, "7" }));
+            ASSERT(check(lst12, { sixes, "7" }, &tr2));
             ASSERT(tr.blocks_outstanding() == pre_move_blks);
             ASSERT(tr2.blocks_outstanding() == tr.blocks_outstanding());
             lst12.front() = "5";
@@ -345,6 +421,28 @@ int main(int argc, char *argv[])
             ASSERT(check(lst4, { sixes, "7" }));
             ASSERT(check(lst12, { "5", "7" }));
         }
+        {
+            // Elements are moved, not copied, across allocators.
+            test_resource tr2;
+            slist<CopyCounted> src(&tr);
+            for (int i = 0; i < 5; ++i)
+                src.emplace_back(i);
+            CopyCounted::s_copies = 0;
+
+            slist<CopyCounted> dst(&tr2);
+            dst = std::move(src);
+            ASSERT(src.empty());
+            ASSERT(5 == dst.size());
+            ASSERT(0 == CopyCounted::s_copies);
+            ASSERT(5 == tr2.blocks_outstanding());
+
+            slist<CopyCounted> dst2(std::move(dst), &tr);
+            ASSERT(dst.empty());
+            ASSERT(5 == dst2.size());
+            ASSERT(0 == dst2.front().m_value);
+            ASSERT(0 == CopyCounted::s_copies);
+            ASSERT(0 == tr2.blocks_outstanding());
+        }
 
         std::cout << "Testing swap()\n";
         {
@@ -374,6 +472,263 @@ int main(int argc, char *argv[])
     }
     ASSERT(0 == tr.blocks_outstanding());  // No leaks
 
+    std::cout << "Testing slist_node_resource\n";
+    {
+        {
+            slist_node_resource<int> nr(&tr);
+            ASSERT(&tr == nr.upstream_resource());
+            slist<int> lst(&nr);
+            for (int i = 0; i < 50; ++i)
+                lst.push_back(i);
+            ASSERT(1 == tr.blocks_outstanding());  // One slab
+
+            // Consecutively allocated nodes are adjacent in memory.
+            const char *prev = nullptr;
+            for (const int& v : lst) {
+                const char *addr = reinterpret_cast<const char *>(&v);
+                if (prev)
+                    LOOP_ASSERT(addr - prev, slist_node_resource<int>::
+                                block_size == size_t(addr - prev));
+                prev = addr;
+            }
+
+            // Erased nodes are reused.
+            const int *first = &lst.front();
+            lst.pop_front();
+            lst.push_front(99);
+            ASSERT(first == &lst.front());
+            ASSERT(1 == tr.blocks_outstanding());
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        // Allocations of other sizes (here, string buffers) pass
+        // through to upstream.
+        {
+            slist_node_resource<pmr::string> nr(&tr);
+            slist<pmr::string> lst(&nr);
+            lst.emplace_back("a string too long for the small buffer");
+            lst.emplace_back("short");
+            ASSERT(2 == tr.blocks_outstanding());  // Slab + 1 string
+            ASSERT(check(lst, { "a string too long for the small buffer",
+                                "short" }, &nr));
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
+    std::cout << "Testing winking out\n";
+    {
+        CountingMonotonicResource mr(&tr);
+        {
+            // Trivially destructible elements: erasing the whole list
+            // neither deallocates nor visits the nodes.
+            slist<int> lst(&mr);
+            for (int i = 0; i < 100; ++i)
+                lst.push_back(i);
+            lst.erase(lst.begin(), lst.end());
+            ASSERT(lst.empty());
+            ASSERT(lst.begin() == lst.end());
+            ASSERT(0 == mr.m_deallocations);
+            lst.push_back(5);
+            lst.push_back(6);
+            ASSERT(check(lst, { 5, 6 }));
+
+            // A partial erase still unlinks the nodes.
+            lst.pop_front();
+            ASSERT(check(lst, { 6 }));
+            ASSERT(0 == mr.m_deallocations);
+        }
+        ASSERT(0 == mr.m_deallocations);
+
+        {
+            // Non-trivial elements are destroyed, but their nodes are not
+            // deallocated.
+            Counted::s_destroyed = 0;
+            slist<Counted> lst(&mr);
+            for (int i = 0; i < 10; ++i)
+                lst.emplace_back(i);
+            auto b = lst.begin();
+            ++b;
+            auto e = b;
+            ++e; ++e; ++e;
+            lst.erase(b, e);
+            ASSERT(7 == lst.size());
+            ASSERT(3 == Counted::s_destroyed);
+            ASSERT(0 == mr.m_deallocations);
+        }
+        ASSERT(10 == Counted::s_destroyed);
+        ASSERT(0  == mr.m_deallocations);
+
+        {
+            // `wink_out` skips the element destructors, too.
+            Counted::s_destroyed = 0;
+            slist<Counted> lst(&mr);
+            for (int i = 0; i < 10; ++i)
+                lst.emplace_back(i);
+            lst.wink_out();
+            ASSERT(lst.empty());
+            ASSERT(lst.begin() == lst.end());
+            ASSERT(0 == Counted::s_destroyed);
+            lst.emplace_back(42);
+            ASSERT(1 == lst.size());
+            ASSERT(42 == lst.front().m_value);
+        }
+        ASSERT(1 == Counted::s_destroyed);
+        ASSERT(0 == mr.m_deallocations);
+
+        // Memory is reclaimed in bulk.
+        ASSERT(0 < tr.blocks_outstanding());
+        mr.release();
+        ASSERT(0 == tr.blocks_outstanding());
+
+        {
+            // Resources that do deallocate still get every node back.
+            slist<int> lst(&tr);
+            for (int i = 0; i < 10; ++i)
+                lst.push_back(i);
+            ASSERT(10 == tr.blocks_outstanding());
+            lst.erase(lst.begin(), lst.end());
+            ASSERT(0 == tr.blocks_outstanding());
+        }
+    }
+
+    std::cout << "Testing range construction and insertion\n";
+    {
+        const int data[] = { 1, 2, 3, 4, 5 };
+
+        slist<int> lst1(std::begin(data), std::end(data), &tr);
+        ASSERT(check(lst1, { 1, 2, 3, 4, 5 }));
+        ASSERT(5 == tr.blocks_outstanding());
+
+        slist<int> lst2({ 7, 8, 9 }, &tr);
+        ASSERT(check(lst2, { 7, 8, 9 }));
+
+        slist<int> lst3(3, 6, &tr);  // Not a range
+        ASSERT(check(lst3, { 6, 6, 6 }));
+
+        slist<int> lst4(4, &tr);
+        ASSERT(check(lst4, { 0, 0, 0, 0 }));
+
+        // Insert at the front, in the middle and at the end.
+        auto it = lst2.insert(lst2.begin(), lst1.begin(), lst1.end());
+        ASSERT(it == lst2.begin());
+        ASSERT(check(lst2, { 1, 2, 3, 4, 5, 7, 8, 9 }));
+        it = lst2.begin();
+        std::advance(it, 5);
+        it = lst2.insert(it, 2, 6);
+        ASSERT(6 == *it);
+        ASSERT(check(lst2, { 1, 2, 3, 4, 5, 6, 6, 7, 8, 9 }));
+        lst2.insert(lst2.end(), { 10, 11 });
+        ASSERT(check(lst2, { 1, 2, 3, 4, 5, 6, 6, 7, 8, 9, 10, 11 }));
+        lst2.push_back(12);  // Tail was updated
+        ASSERT(13 == lst2.size());
+        ASSERT(12 == *std::next(lst2.begin(), 12));
+
+        // Empty ranges change nothing.
+        lst2.insert(lst2.begin(), lst1.end(), lst1.end());
+        lst2.insert(lst2.end(), 0, 5);
+        ASSERT(13 == lst2.size());
+
+        // Single-pass ranges are inserted one element at a time.
+        std::istringstream in("20 21 22");
+        lst1.insert(lst1.end(), std::istream_iterator<int>(in),
+                    std::istream_iterator<int>());
+        ASSERT(check(lst1, { 1, 2, 3, 4, 5, 20, 21, 22 }));
+
+        // Elements use the list's allocator.
+        test_resource tr2;
+        slist<pmr::string> lst5(&tr2);
+        const char *strs[] = { "one", "two",
+                               "a string too long for the small buffer" };
+        lst5.insert(lst5.end(), std::begin(strs), std::end(strs));
+        ASSERT(check(lst5, { "one", "two",
+                             "a string too long for the small buffer" },
+                     &tr2));
+        slist<pmr::string> lst6(lst5.begin(), lst5.end(), &tr);
+        ASSERT(check(lst6, { "one", "two",
+                             "a string too long for the small buffer" },
+                     &tr));
+    }
+    ASSERT(0 == tr.blocks_outstanding());
+
+    {
+        // A constructor that throws undoes the whole insertion.
+        const int data[] = { 1, 2, 3, 4, 5 };
+        slist<Throwing> lst(data, data + 2, &tr);
+        Throwing::s_countdown = 3;
+        try {
+            lst.insert(lst.end(), data, data + 5);
+            ASSERT(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        Throwing::s_countdown = -1;
+        ASSERT(2 == lst.size());
+        ASSERT(2 == Throwing::s_live);
+        ASSERT(2 == tr.blocks_outstanding());
+        lst.insert(lst.end(), data + 2, data + 4);
+        ASSERT(4 == lst.size());
+        int expected = 1;
+        for (const Throwing& v : lst)
+            ASSERT(expected++ == v.m_value);
+    }
+    ASSERT(0 == Throwing::s_live);
+    ASSERT(0 == tr.blocks_outstanding());
+
+    {
+        // When deallocation is a no-op, all of the nodes come from one
+        // allocation.
+        CountingMonotonicResource mr(&tr);
+        std::vector<int> data(1000, 3);
+        slist<int> lst(data.begin(), data.end(), &mr);
+        ASSERT(1000 == lst.size());
+        ASSERT(1 == mr.m_allocations);
+        lst.insert(lst.begin(), { 1, 2 });
+        ASSERT(2 == mr.m_allocations);
+        ASSERT(1 == lst.front());
+        ASSERT(1002 == std::count(lst.begin(), lst.end(), 3) + 2);
+        lst.resize(10);
+        ASSERT(10 == lst.size());
+        ASSERT(0 == mr.m_deallocations);
+    }
+
+    std::cout << "Testing assign and resize\n";
+    {
+        slist<pmr::string> lst(&tr);
+        lst.assign({ "a", "b", "c" });
+        ASSERT(check(lst, { "a", "b", "c" }, &tr));
+
+        // Shorter: existing elements are reused and the rest erased.
+        auto first = &lst.front();
+        lst.assign(2, "x");
+        ASSERT(check(lst, { "x", "x" }, &tr));
+        ASSERT(first == &lst.front());
+        ASSERT(2 == tr.blocks_outstanding());
+
+        // Longer: new elements are appended.
+        const char *strs[] = { "p", "q", "r", "s" };
+        lst.assign(std::begin(strs), std::end(strs));
+        ASSERT(check(lst, { "p", "q", "r", "s" }, &tr));
+        ASSERT(first == &lst.front());
+        lst.push_back("t");
+        ASSERT(check(lst, { "p", "q", "r", "s", "t" }, &tr));
+
+        lst = { "m", "n" };
+        ASSERT(check(lst, { "m", "n" }, &tr));
+
+        lst.resize(4);
+        ASSERT(check(lst, { "m", "n", "", "" }, &tr));
+        lst.resize(1);
+        ASSERT(check(lst, { "m" }, &tr));
+        lst.resize(3, "z");
+        ASSERT(check(lst, { "m", "z", "z" }, &tr));
+        lst.push_back("y");  // Tail was updated
+        ASSERT(check(lst, { "m", "z", "z", "y" }, &tr));
+        lst.resize(0);
+        ASSERT(lst.empty());
+        ASSERT(lst.begin() == lst.end());
+        ASSERT(0 == tr.blocks_outstanding());
+    }
+
     printf("%s\n", 0 == testStatus ? "PASSED" : "FAILED");
 
     return testStatus;
@@ -9,21 +9,144 @@
 #include "test_resource.h"
 #include <algorithm>
 #include <cassert>
+#include <mutex>
+#include <stdexcept>
+
+namespace test_resource_details {
+
+block_table::block_table(pmr::memory_resource *parent)
+  : m_parent(parent)
+  , m_blocks(nullptr)
+  , m_capacity(0)
+  , m_num_blocks(0)
+{
+}
+
+block_table::~block_table() {
+  if (m_blocks)
+    m_parent->deallocate(m_blocks,
+                         m_capacity * sizeof(allocation_rec),
+                         alignof(allocation_rec));
+}
+
+size_t block_table::size() const {
+  return m_num_blocks;
+}
+
+void block_table::insert(void *p, size_t bytes,
+                         size_t alignment) {
+  // Keep the load factor at or below 3/4.
+  if (4 * (m_num_blocks + 1) > 3 * m_capacity)
+    grow();
+
+  m_blocks[find_slot(p)] = allocation_rec{p, bytes, alignment};
+  ++m_num_blocks;
+}
+
+void block_table::erase(void *p, size_t bytes,
+                        size_t alignment) {
+  // Check that deallocation args exactly match allocation args.
+  size_t i = m_capacity ? find_slot(p) : 0;
+  if (! m_capacity || ! m_blocks[i].m_ptr)
+    throw std::invalid_argument("deallocate: Invalid pointer");
+  else if (m_blocks[i].m_bytes != bytes)
+    throw std::invalid_argument("deallocate: Size mismatch");
+  else if (m_blocks[i].m_alignment != alignment)
+    throw std::invalid_argument("deallocate: Alignment mismatch");
+
+  erase_slot(i);
+  --m_num_blocks;
+}
+
+size_t block_table::reclaim() {
+  size_t bytes = 0;
+  for (size_t i = 0; i < m_capacity; ++i) {
+    allocation_rec& alloc_rec = m_blocks[i];
+    if (! alloc_rec.m_ptr)
+      continue;
+    bytes += alloc_rec.m_bytes;
+    m_parent->deallocate(alloc_rec.m_ptr, alloc_rec.m_bytes,
+                         alloc_rec.m_alignment);
+    alloc_rec.m_ptr = nullptr;
+  }
+  m_num_blocks = 0;
+  return bytes;
+}
+
+size_t block_table::find_slot(void *p) const {
+  // Fibonacci hashing of the address, ignoring the low bits,
+  // which are usually zero due to alignment.
+  const size_t mask = m_capacity - 1;
+  size_t i = ((size_t(p) >> 4) * size_t(0x9e3779b97f4a7c15ULL))
+    >> (8 * sizeof(size_t) - 32);
+  for (i &= mask; m_blocks[i].m_ptr && m_blocks[i].m_ptr != p;
+       i = (i + 1) & mask)
+    ;
+  return i;
+}
+
+void block_table::grow() {
+  const size_t min_capacity = 16;
+
+  allocation_rec *old_blocks   = m_blocks;
+  size_t          old_capacity = m_capacity;
+
+  size_t new_capacity = old_capacity ? 2 * old_capacity
+                                     : min_capacity;
+  m_blocks = static_cast<allocation_rec*>(
+    m_parent->allocate(new_capacity * sizeof(allocation_rec),
+                       alignof(allocation_rec)));
+  m_capacity = new_capacity;
+  for (size_t i = 0; i < m_capacity; ++i)
+    m_blocks[i].m_ptr = nullptr;
+
+  for (size_t i = 0; i < old_capacity; ++i)
+    if (old_blocks[i].m_ptr)
+      m_blocks[find_slot(old_blocks[i].m_ptr)] = old_blocks[i];
+
+  if (old_blocks)
+    m_parent->deallocate(old_blocks,
+                         old_capacity * sizeof(allocation_rec),
+                         alignof(allocation_rec));
+}
+
+void block_table::erase_slot(size_t i) {
+  // Backward-shift deletion: move later members of the probe
+  // sequence into the hole, so that lookups never stop early and
+  // no tombstones are needed.
+  const size_t mask = m_capacity - 1;
+  size_t hole = i;
+  for (size_t j = (i + 1) & mask; m_blocks[j].m_ptr;
+       j = (j + 1) & mask) {
+    // Save the record at `j`, then see where it would go
+    // with the hole emptied.
+    allocation_rec rec = m_blocks[j];
+    m_blocks[j].m_ptr = nullptr;
+    m_blocks[hole].m_ptr = nullptr;
+    size_t home = find_slot(rec.m_ptr);
+    m_blocks[home] = rec;
+    if (home != j)
+      hole = j;  // Record moved back; `j` is the new hole
+  }
+  m_blocks[hole].m_ptr = nullptr;
+}
+
+} // close namespace test_resource_details
 
 // Keep track of number of bytes that would be leaked by
 // allocator destructor.
-size_t test_resource::s_leaked_bytes = 0;
+std::atomic<size_t> test_resource::s_leaked_bytes(0);
 
 // Keep track of number of blocks that would be leaked by
 // allocator destructor.
-size_t test_resource::s_leaked_blocks = 0;
+std::atomic<size_t> test_resource::s_leaked_blocks(0);
 
 test_resource::test_resource(pmr::memory_resource *parent)
   : m_parent(parent)
   , m_bytes_allocated(0)
   , m_bytes_outstanding(0)
   , m_bytes_highwater(0)
-  , m_blocks(parent) // Vector memory comes from parent, too
+  , m_blocks(parent)
 {
 }
 
@@ -32,11 +155,7 @@ test_resource::~test_resource() {
   s_leaked_blocks += blocks_outstanding();
 
   // Reclaim blocks that would have been leaked.
-  for (auto& alloc_rec : m_blocks) {
-    s_leaked_bytes += alloc_rec.m_bytes;
-    m_parent->deallocate(alloc_rec.m_ptr, alloc_rec.m_bytes,
-                         alloc_rec.m_alignment);
-  }
+  s_leaked_bytes += m_blocks.reclaim();
 }
 
 pmr::memory_resource *test_resource::parent() const {
@@ -78,9 +197,14 @@ void test_resource::clear_leaked() {
 
 void *test_resource::do_allocate(size_t bytes,
                                  size_t alignment) {
-
   void *ret = m_parent->allocate(bytes, alignment);
-  m_blocks.push_back(allocation_rec{ret, bytes, alignment});
+  try {
+    m_blocks.insert(ret, bytes, alignment);
+  }
+  catch (...) {
+    m_parent->deallocate(ret, bytes, alignment);
+    throw;
+  }
   m_bytes_allocated   += bytes;
   m_bytes_outstanding += bytes;
   if (m_bytes_outstanding > m_bytes_highwater)
@@ -91,19 +215,8 @@ void *test_resource::do_allocate(size_t bytes,
 
 void test_resource::do_deallocate(void *p, size_t bytes,
                                   size_t alignment) {
-  // Check that deallocation args exactly match allocation args.
-  auto i = std::find_if(m_blocks.begin(), m_blocks.end(),
-                        [p](allocation_rec& r){
-                          return r.m_ptr == p; });
-  if (i == m_blocks.end())
-    throw std::invalid_argument("deallocate: Invalid pointer");
-  else if (i->m_bytes != bytes)
-    throw std::invalid_argument("deallocate: Size mismatch");
-  else if (i->m_alignment != alignment)
-    throw std::invalid_argument("deallocate: Alignment mismatch");
-
-  m_parent->deallocate(p, i->m_bytes, i->m_alignment);
-  m_blocks.erase(i);
+  m_blocks.erase(p, bytes, alignment);
+  m_parent->deallocate(p, bytes, alignment);
   m_bytes_outstanding -= bytes;
 }
 
@@ -112,6 +225,294 @@ bool test_resource::do_is_equal(const pmr::memory_resource& other)
   return this == &other;
 }
 
+// Counters of one shard.  Each shard fills its own cache line
+// and, except for the overflow shard, is written by only one
+// thread at a time.  Byte and block counts only grow, so a
+// reader that sums the deallocation counts before the allocation
+// counts never sees more freed than allocated.
+struct alignas(64) concurrent_test_resource::shard {
+  std::atomic<size_t>         m_bytes_allocated;
+  std::atomic<size_t>         m_bytes_deallocated;
+  std::atomic<size_t>         m_blocks_allocated;
+  std::atomic<size_t>         m_blocks_deallocated;
+  std::atomic<std::ptrdiff_t> m_unpublished;  // Net bytes
+};
+
+struct alignas(64) concurrent_test_resource::stripe {
+  std::mutex                        m_mutex;
+  test_resource_details::block_table m_blocks;
+
+  explicit stripe(pmr::memory_resource *parent)
+    : m_blocks(parent) { }
+};
+
+constexpr size_t concurrent_test_resource::highwater_granularity;
+constexpr size_t concurrent_test_resource::num_shards;
+constexpr size_t concurrent_test_resource::num_stripes;
+
+namespace {
+
+// Shard index owned by the calling thread, shared by every
+// `concurrent_test_resource`.  A thread takes a free index the
+// first time it touches any such resource and gives it back when
+// it exits.  Once `num_shards` threads hold an index, further
+// threads share the overflow shard, index `num_shards`.
+const unsigned overflow_shard = 64;
+const unsigned unassigned_shard = unsigned(-1);
+
+std::mutex         s_shard_mutex;
+unsigned long long s_shards_in_use = 0;  // Bit `i`: index `i` held
+
+// Constant-initialized, so that reading it needs no TLS guard.
+thread_local unsigned t_shard = unassigned_shard;
+
+// Returns the calling thread's index to the free set on exit.
+struct shard_releaser {
+  ~shard_releaser() {
+    if (t_shard != overflow_shard) {
+      std::lock_guard<std::mutex> lock(s_shard_mutex);
+      s_shards_in_use &= ~(1ULL << t_shard);
+    }
+    t_shard = overflow_shard;
+  }
+};
+
+unsigned assign_shard() {
+  static thread_local shard_releaser releaser;
+  (void) releaser;
+
+  std::lock_guard<std::mutex> lock(s_shard_mutex);
+  if (~s_shards_in_use) {
+    t_shard = __builtin_ctzll(~s_shards_in_use);
+    s_shards_in_use |= 1ULL << t_shard;
+  }
+  else
+    t_shard = overflow_shard;
+  return t_shard;
+}
+
+inline unsigned local_shard() {
+  unsigned ret = t_shard;
+  return ret != unassigned_shard ? ret : assign_shard();
+}
+
+// Add `n` to `counter`.  Only the overflow shard has concurrent
+// writers and needs an atomic read-modify-write; a relaxed load
+// and store is enough for the others.
+template <class Tp>
+inline void add(std::atomic<Tp>& counter, Tp n, bool shared) {
+  if (shared)
+    counter.fetch_add(n, std::memory_order_relaxed);
+  else
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+}
+
+}
+
+concurrent_test_resource::concurrent_test_resource(
+  pmr::memory_resource *parent,
+  bool                  track_blocks)
+  : m_parent(parent)
+  , m_shards(nullptr)
+  , m_stripes(nullptr)
+  , m_bytes_published(0)
+  , m_bytes_highwater(0)
+{
+  static_assert(num_shards == overflow_shard,
+                "One bit of s_shards_in_use per shard");
+
+  m_shards = static_cast<shard*>(
+    m_parent->allocate((num_shards + 1) * sizeof(shard),
+                       alignof(shard)));
+  for (size_t i = 0; i <= num_shards; ++i) {
+    shard& s = m_shards[i];
+    s.m_bytes_allocated    = 0;
+    s.m_bytes_deallocated  = 0;
+    s.m_blocks_allocated   = 0;
+    s.m_blocks_deallocated = 0;
+    s.m_unpublished        = 0;
+  }
+
+  if (! track_blocks)
+    return;
+
+  try {
+    m_stripes = static_cast<stripe*>(
+      m_parent->allocate(num_stripes * sizeof(stripe),
+                         alignof(stripe)));
+  }
+  catch (...) {
+    m_parent->deallocate(m_shards,
+                         (num_shards + 1) * sizeof(shard),
+                         alignof(shard));
+    throw;
+  }
+  for (size_t i = 0; i < num_stripes; ++i)
+    ::new(&m_stripes[i]) stripe(m_parent);
+}
+
+concurrent_test_resource::~concurrent_test_resource() {
+  // If any blocks have not been released, report them as leaked.
+  // Without a registry, the blocks cannot be reclaimed.
+  test_resource::s_leaked_blocks += blocks_outstanding();
+  if (! m_stripes)
+    test_resource::s_leaked_bytes += bytes_outstanding();
+  else {
+    for (size_t i = 0; i < num_stripes; ++i) {
+      test_resource::s_leaked_bytes +=
+        m_stripes[i].m_blocks.reclaim();
+      m_stripes[i].~stripe();
+    }
+    m_parent->deallocate(m_stripes, num_stripes * sizeof(stripe),
+                         alignof(stripe));
+  }
+
+  m_parent->deallocate(m_shards, (num_shards + 1) * sizeof(shard),
+                       alignof(shard));
+}
+
+pmr::memory_resource *concurrent_test_resource::parent() const {
+  return m_parent;
+}
+
+bool concurrent_test_resource::tracks_blocks() const {
+  return m_stripes != nullptr;
+}
+
+size_t concurrent_test_resource::bytes_allocated() const {
+  size_t ret = 0;
+  for (size_t i = 0; i <= num_shards; ++i)
+    ret += m_shards[i].m_bytes_allocated.load(
+      std::memory_order_relaxed);
+  return ret;
+}
+
+size_t concurrent_test_resource::bytes_deallocated() const {
+  size_t ret = 0;
+  for (size_t i = 0; i <= num_shards; ++i)
+    ret += m_shards[i].m_bytes_deallocated.load(
+      std::memory_order_relaxed);
+  return ret;
+}
+
+size_t concurrent_test_resource::bytes_outstanding() const {
+  size_t deallocated = bytes_deallocated();
+  size_t allocated   = bytes_allocated();
+  return allocated > deallocated ? allocated - deallocated : 0;
+}
+
+size_t concurrent_test_resource::bytes_highwater() const {
+  size_t highwater = m_bytes_highwater.load(
+    std::memory_order_relaxed);
+  return std::max(highwater, bytes_outstanding());
+}
+
+size_t concurrent_test_resource::blocks_outstanding() const {
+  size_t deallocated = 0, allocated = 0;
+  for (size_t i = 0; i <= num_shards; ++i)
+    deallocated += m_shards[i].m_blocks_deallocated.load(
+      std::memory_order_relaxed);
+  for (size_t i = 0; i <= num_shards; ++i)
+    allocated += m_shards[i].m_blocks_allocated.load(
+      std::memory_order_relaxed);
+  return allocated > deallocated ? allocated - deallocated : 0;
+}
+
+concurrent_test_resource::stripe&
+concurrent_test_resource::stripe_for(void *p) const {
+  // Same hash as `block_table`, but using the top bits, which the
+  // table (unless enormous) does not.
+  size_t h = (size_t(p) >> 4) * size_t(0x9e3779b97f4a7c15ULL);
+  return m_stripes[h >> (8 * sizeof(size_t) - 6)];
+}
+
+void concurrent_test_resource::count(size_t bytes,
+                                     bool   allocating) {
+  unsigned index  = local_shard();
+  bool     shared = index == overflow_shard;
+  shard&   s      = m_shards[index];
+
+  std::ptrdiff_t delta;
+  if (allocating) {
+    add(s.m_bytes_allocated, bytes, shared);
+    add(s.m_blocks_allocated, size_t(1), shared);
+    delta = std::ptrdiff_t(bytes);
+  }
+  else {
+    add(s.m_bytes_deallocated, bytes, shared);
+    add(s.m_blocks_deallocated, size_t(1), shared);
+    delta = -std::ptrdiff_t(bytes);
+  }
+
+  std::ptrdiff_t unpublished;
+  if (shared)
+    unpublished = s.m_unpublished.fetch_add(
+      delta, std::memory_order_relaxed) + delta;
+  else {
+    unpublished = s.m_unpublished.load(
+      std::memory_order_relaxed) + delta;
+    s.m_unpublished.store(unpublished, std::memory_order_relaxed);
+  }
+  if (unpublished >= std::ptrdiff_t(highwater_granularity) ||
+      unpublished <= -std::ptrdiff_t(highwater_granularity))
+    publish(s.m_unpublished.exchange(0,
+                                     std::memory_order_relaxed));
+}
+
+void concurrent_test_resource::publish(std::ptrdiff_t delta) {
+  // The published count omits bytes not yet published by other
+  // shards, so it may even be negative.
+  std::ptrdiff_t published =
+    m_bytes_published.fetch_add(delta, std::memory_order_relaxed) +
+    delta;
+  if (delta < 0 || published < 0)
+    return;
+
+  size_t highwater = m_bytes_highwater.load(
+    std::memory_order_relaxed);
+  while (size_t(published) > highwater &&
+         ! m_bytes_highwater.compare_exchange_weak(
+           highwater, size_t(published), std::memory_order_relaxed))
+    ;
+}
+
+void *concurrent_test_resource::do_allocate(size_t bytes,
+                                            size_t alignment) {
+  void *ret = m_parent->allocate(bytes, alignment);
+  if (m_stripes) {
+    stripe& s = stripe_for(ret);
+    try {
+      std::lock_guard<std::mutex> lock(s.m_mutex);
+      s.m_blocks.insert(ret, bytes, alignment);
+    }
+    catch (...) {
+      m_parent->deallocate(ret, bytes, alignment);
+      throw;
+    }
+  }
+
+  count(bytes, true);
+  return ret;
+}
+
+void concurrent_test_resource::do_deallocate(void *p, size_t bytes,
+                                             size_t alignment) {
+  if (m_stripes) {
+    stripe& s = stripe_for(p);
+    std::lock_guard<std::mutex> lock(s.m_mutex);
+    s.m_blocks.erase(p, bytes, alignment);
+  }
+  m_parent->deallocate(p, bytes, alignment);
+
+  count(bytes, false);
+}
+
+bool concurrent_test_resource::do_is_equal(
+  const pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
+
 /* End test_resource.cpp */
 
 // For best result when pasting into PowerPoint, set indent to 2
@@ -10,16 +10,72 @@
 #define INCLUDED_TEST_RESOURCE_DOT_H
 
 #include <polymorphic_allocator.h>
-#include <pmr_vector.h>
 
 using std::size_t;
 namespace pmr = cpp17::pmr;
 
+namespace test_resource_details {
+
+// Open-addressing (linear probing) hash table of outstanding
+// allocations, keyed by address.  The table memory comes from
+// `parent`.  Not thread safe.
+class block_table
+{
+public:
+  explicit block_table(pmr::memory_resource *parent);
+  block_table(const block_table&) = delete;
+  block_table& operator=(const block_table&) = delete;
+
+  // Free the table, but not the blocks recorded in it.
+  ~block_table();
+
+  size_t size() const;
+
+  // Record a block allocated from `parent`.
+  void insert(void *p, size_t bytes, size_t alignment);
+
+  // Remove the record for `p`.  Throw `invalid_argument` if `p`
+  // is not recorded or was recorded with a different size or
+  // alignment.
+  void erase(void *p, size_t bytes, size_t alignment);
+
+  // Return every recorded block to `parent` and empty the
+  // table.  Return the total number of bytes reclaimed.
+  size_t reclaim();
+
+private:
+  // Record holding the results of an allocation
+  struct allocation_rec {
+    void   *m_ptr;
+    size_t  m_bytes;
+    size_t  m_alignment;
+  };
+
+  // Return the slot in `m_blocks` holding `p`, or else the
+  // empty slot where `p` would be inserted.
+  size_t find_slot(void *p) const;
+
+  // Double the capacity of `m_blocks`.
+  void grow();
+
+  // Empty slot `i`, closing the gap left in its probe sequence.
+  void erase_slot(size_t i);
+
+  pmr::memory_resource  *m_parent;
+  allocation_rec        *m_blocks;    // Empty slots: null `m_ptr`
+  size_t                 m_capacity;  // Zero or a power of 2
+  size_t                 m_num_blocks;
+};
+
+} // close namespace test_resource_details
+
 class test_resource : public pmr::memory_resource
 {
 public:
   explicit test_resource(pmr::memory_resource *parent =
                            pmr::get_default_resource());
+  test_resource(const test_resource&) = delete;
+  test_resource& operator=(const test_resource&) = delete;
   ~test_resource();
 
   pmr::memory_resource *parent() const;
@@ -41,22 +97,96 @@ protected:
   bool do_is_equal(const pmr::memory_resource& other)
                                         const noexcept override;
 
+  template <class, class>
+  friend class cpp17::pmr::static_polymorphic_allocator;
+
 private:
-  // Record holding the results of an allocation
-  struct allocation_rec {
-    void   *m_ptr;
-    size_t  m_bytes;
-    size_t  m_alignment;
-  };
+  friend class concurrent_test_resource;
+
+  pmr::memory_resource  *m_parent;
+  size_t                 m_bytes_allocated;
+  size_t                 m_bytes_outstanding;
+  size_t                 m_bytes_highwater;
+  test_resource_details::block_table m_blocks;
+
+  // Shared with `concurrent_test_resource`, whose destructor may
+  // run on any thread.
+  static std::atomic<size_t>   s_leaked_bytes;
+  static std::atomic<size_t>   s_leaked_blocks;
+};
+
+// A `test_resource` for resources shared by several threads.
+// Statistics are kept in per-thread shards of counters, each
+// written (without atomic read-modify-write) only by the thread
+// that owns it, and summed on read, so that concurrent
+// allocations do not contend on a single cache line.  Reads made while other
+// threads are allocating return a recent, not an exact, value.
+// `bytes_highwater()` is sampled: a thread reports its net
+// change to the global figure only after it exceeds
+// `highwater_granularity` bytes, so the high-water mark can be
+// low by up to that amount per thread.  If `track_blocks` is
+// true, each block is also recorded in a registry split into
+// independently locked stripes, allowing mismatched
+// deallocations to be detected and leaks to be reclaimed;
+// otherwise, leaks are counted but not reclaimed.  Leaks are
+// reported through `test_resource::leaked_bytes()` and
+// `test_resource::leaked_blocks()`.  The parent resource must
+// be thread safe.
+class concurrent_test_resource : public pmr::memory_resource
+{
+public:
+  static constexpr size_t highwater_granularity = 16 * 1024;
+
+  explicit concurrent_test_resource(
+    pmr::memory_resource *parent = pmr::get_default_resource(),
+    bool                  track_blocks = true);
+  concurrent_test_resource(const concurrent_test_resource&)
+                                                      = delete;
+  concurrent_test_resource& operator=(
+    const concurrent_test_resource&) = delete;
+  ~concurrent_test_resource();
+
+  pmr::memory_resource *parent() const;
+  bool tracks_blocks() const;
+
+  size_t bytes_allocated() const;
+  size_t bytes_deallocated() const;
+  size_t bytes_outstanding() const;
+  size_t bytes_highwater() const;
+  size_t blocks_outstanding() const;
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes,
+                     size_t alignment) override;
+  bool do_is_equal(const pmr::memory_resource& other)
+                                        const noexcept override;
+
+  template <class, class>
+  friend class cpp17::pmr::static_polymorphic_allocator;
+
+private:
+  static constexpr size_t num_shards  = 64;
+  static constexpr size_t num_stripes = 64;
+
+  struct shard;   // Cache-line-sized counters
+  struct stripe;  // Mutex-protected `block_table`
+
+  stripe& stripe_for(void *p) const;
+
+  // Count an allocation or deallocation of `bytes` in the
+  // calling thread's shard.
+  void count(size_t bytes, bool allocating);
 
-  pmr::memory_resource        *m_parent;
-  size_t                       m_bytes_allocated;
-  size_t                       m_bytes_outstanding;
-  size_t                       m_bytes_highwater;
-  pmr::vector<allocation_rec>  m_blocks;
+  // Add `delta` to the published byte count, raising the
+  // high-water mark if needed.
+  void publish(std::ptrdiff_t delta);
 
-  static size_t                s_leaked_bytes;
-  static size_t                s_leaked_blocks;
+  pmr::memory_resource  *m_parent;
+  shard                 *m_shards;
+  stripe                *m_stripes;  // Null if not tracking
+  std::atomic<std::ptrdiff_t> m_bytes_published;  // May lag
+  std::atomic<size_t>         m_bytes_highwater;
 };
 
 #endif // ! defined(INCLUDED_TEST_RESOURCE_DOT_H)
@@ -12,6 +12,8 @@
 #include <cstdlib>
 #include <climits>
 #include <cstring>
+#include <thread>
+#include <vector>
 
 //==========================================================================
 //                  ASSERT TEST MACRO
@@ -220,6 +222,175 @@ int main(int argc, char *argv[])
     ASSERT(0 == test_resource::leaked_bytes());
     ASSERT(0 == test_resource::leaked_blocks());
 
+    std::cout << "Testing many outstanding blocks\n";
+    {
+        test_resource tr5(&parentr);
+        const size_t num_blocks = 100000;
+        void **blocks = new void*[num_blocks];
+        for (size_t i = 0; i < num_blocks; ++i)
+            blocks[i] = tr5.allocate(i % 64 + 1, 1);
+        ASSERT(num_blocks == tr5.blocks_outstanding());
+        ASSERT(num_blocks + 1 == parentr.blocks_outstanding());
+
+        // Every block is still found after the table has grown.
+        for (size_t i = 0; i < num_blocks; i += 1000) {
+            try {
+                tr5.deallocate(blocks[i], i % 64 + 2, 1);
+                ASSERT(false && "unreachable");
+            } catch (std::invalid_argument& ex) {
+                const char *experr = "deallocate: Size mismatch";
+                LOOP_ASSERT(ex.what(), 0 == strcmp(experr, ex.what()));
+            }
+        }
+
+        // Free in an order unrelated to allocation order, leaving every
+        // seventh block to leak.
+        size_t expected_leaked_bytes = 0;
+        for (size_t i = 0; i < num_blocks; ++i) {
+            size_t j = (i * 7919) % num_blocks;
+            if (j % 7)
+                tr5.deallocate(blocks[j], j % 64 + 1, 1);
+            else
+                expected_leaked_bytes += j % 64 + 1;
+        }
+        LOOP_ASSERT(tr5.blocks_outstanding(),
+                    (num_blocks + 6) / 7 == tr5.blocks_outstanding());
+        LOOP_ASSERT(tr5.bytes_outstanding(),
+                    expected_leaked_bytes == tr5.bytes_outstanding());
+
+        // Double free is detected
+        try {
+            tr5.deallocate(blocks[1], 2, 1);
+            ASSERT(false && "unreachable");
+        } catch (std::invalid_argument& ex) {
+            const char *experr = "deallocate: Invalid pointer";
+            LOOP_ASSERT(ex.what(), 0 == strcmp(experr, ex.what()));
+        }
+
+        delete[] blocks;
+        // tr5 destructor called here, leaking every seventh block
+    }
+    LOOP_ASSERT(test_resource::leaked_blocks(),
+                (100000 + 6) / 7 == test_resource::leaked_blocks());
+    LOOP_ASSERT(parentr.blocks_outstanding(),
+                0 == parentr.blocks_outstanding());
+    test_resource::clear_leaked();
+
+    std::cout << "Testing concurrent_test_resource\n";
+    {
+        concurrent_test_resource ctr1(&parentr);
+        ASSERT(&parentr == ctr1.parent());
+        ASSERT(ctr1.tracks_blocks());
+        ASSERT(ctr1 == ctr1);
+        ASSERT(0 == ctr1.bytes_allocated());
+        ASSERT(0 == ctr1.blocks_outstanding());
+        size_t parent_blocks = parentr.blocks_outstanding();
+
+        void *p1 = ctr1.allocate(40, 8);
+        void *p2 = ctr1.allocate(24, 4);
+        ASSERT(64 == ctr1.bytes_allocated());
+        ASSERT(64 == ctr1.bytes_outstanding());
+        ASSERT(64 == ctr1.bytes_highwater());
+        ASSERT(2  == ctr1.blocks_outstanding());
+        ASSERT(parent_blocks + 2 < parentr.blocks_outstanding());
+
+        try {
+            ctr1.deallocate(p1, 40, 4);
+            ASSERT(false && "unreachable");
+        } catch (std::invalid_argument& ex) {
+            const char *experr = "deallocate: Alignment mismatch";
+            LOOP_ASSERT(ex.what(), 0 == strcmp(experr, ex.what()));
+        }
+        ctr1.deallocate(p1, 40, 8);
+        ASSERT(64 == ctr1.bytes_allocated());
+        ASSERT(40 == ctr1.bytes_deallocated());
+        ASSERT(24 == ctr1.bytes_outstanding());
+        // High-water mark is sampled in `highwater_granularity` steps.
+        ASSERT(24 <= ctr1.bytes_highwater());
+        ASSERT(ctr1.bytes_highwater() <= 64);
+        ASSERT(1  == ctr1.blocks_outstanding());
+        try {
+            ctr1.deallocate(p1, 40, 8);
+            ASSERT(false && "unreachable");
+        } catch (std::invalid_argument& ex) {
+            const char *experr = "deallocate: Invalid pointer";
+            LOOP_ASSERT(ex.what(), 0 == strcmp(experr, ex.what()));
+        }
+        (void) p2;
+        // ctr1 destructor called here, leaking (and reclaiming) p2.
+    }
+    ASSERT(24 == test_resource::leaked_bytes());
+    ASSERT(1  == test_resource::leaked_blocks());
+    ASSERT(0 == parentr.blocks_outstanding());
+    test_resource::clear_leaked();
+
+    {
+        // Counting only, without the block registry
+        concurrent_test_resource ctr2(&parentr, false);
+        ASSERT(! ctr2.tracks_blocks());
+        ASSERT(1 == parentr.blocks_outstanding());  // Shards only
+
+        void *p1 = ctr2.allocate(100);
+        void *p2 = ctr2.allocate(28);  (void) p2;
+        ASSERT(128 == ctr2.bytes_outstanding());
+        ctr2.deallocate(p1, 100);
+        ASSERT(28 == ctr2.bytes_outstanding());
+        ASSERT(1  == ctr2.blocks_outstanding());
+        ASSERT(2  == parentr.blocks_outstanding());
+        ctr2.deallocate(p2, 28);
+    }
+    ASSERT(0 == test_resource::leaked_blocks());
+    ASSERT(0 == parentr.blocks_outstanding());
+
+    std::cout << "Testing concurrent_test_resource with threads\n";
+    for (int track = 0; track < 2; ++track) {
+        concurrent_test_resource ctr3(new_delete_resource_singleton(),
+                                      track);
+        const int num_threads = 8;
+        const size_t blocks_per_thread = 20000;
+        std::vector<std::vector<void*> > kept(num_threads);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t)
+            threads.emplace_back([&ctr3, &kept, t, blocks_per_thread]{
+                std::vector<void*> blocks;
+                for (size_t i = 0; i < blocks_per_thread; ++i)
+                    blocks.push_back(ctr3.allocate(i % 32 + 1, 1));
+                // Free the odd-numbered blocks, keep the rest
+                for (size_t i = 1; i < blocks_per_thread; i += 2)
+                    ctr3.deallocate(blocks[i], i % 32 + 1, 1);
+                for (size_t i = 0; i < blocks_per_thread; i += 2)
+                    kept[t].push_back(blocks[i]);
+            });
+        for (std::thread& th : threads)
+            th.join();
+
+        // Each thread allocates 1..32 bytes 625 times over and keeps
+        // the odd sizes.
+        const size_t per_thread_bytes = (blocks_per_thread / 32) * 528;
+        const size_t kept_bytes = (blocks_per_thread / 32) * 256;
+        LOOP_ASSERT(ctr3.bytes_allocated(),
+                    num_threads * per_thread_bytes ==
+                    ctr3.bytes_allocated());
+        LOOP_ASSERT(ctr3.bytes_outstanding(),
+                    num_threads * kept_bytes == ctr3.bytes_outstanding());
+        LOOP_ASSERT(ctr3.blocks_outstanding(),
+                    num_threads * blocks_per_thread / 2 ==
+                    ctr3.blocks_outstanding());
+        LOOP_ASSERT(ctr3.bytes_highwater(),
+                    num_threads * kept_bytes <= ctr3.bytes_highwater());
+        LOOP_ASSERT(ctr3.bytes_highwater(),
+                    ctr3.bytes_highwater() <= ctr3.bytes_allocated());
+
+        // Free the rest from this thread.
+        for (int t = 0; t < num_threads; ++t)
+            for (size_t i = 0; i < kept[t].size(); ++i)
+                ctr3.deallocate(kept[t][i], 2 * i % 32 + 1, 1);
+        ASSERT(0 == ctr3.bytes_outstanding());
+        ASSERT(0 == ctr3.blocks_outstanding());
+    }
+    ASSERT(0 == test_resource::leaked_bytes());
+    ASSERT(0 == test_resource::leaked_blocks());
+
     std::cout << (0 == testStatus ? "PASSED" : "FAILED") << std::endl;
 
     return testStatus;
@@ -0,0 +1,285 @@
+/* trace_replay.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+// Replay an allocation trace recorded by `tracing_resource` against each
+// memory resource in the library and report throughput, peak footprint
+// (bytes obtained from the upstream resource) and fragmentation (the
+// fraction of the peak footprint not holding live blocks at the trace's
+// peak).  Operations are replayed in sequence order on one thread.
+//
+// Usage: trace_replay TRACE_FILE [RESOURCE...]
+//        trace_replay --record TRACE_FILE
+//
+// The second form records a synthetic trace, for trying out the tool.
+
+#include <tracing_resource.h>
+#include <pool_resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using namespace cpp17::pmr;
+
+// One trace operation, with the block's address replaced by a dense
+// index into the table of replayed blocks.
+struct replay_op {
+    std::uint32_t m_block;
+    std::uint32_t m_alignment;
+    std::size_t   m_bytes;
+    bool          m_allocate;
+};
+
+struct replay_trace {
+    std::vector<replay_op> m_ops;
+    std::size_t            m_num_blocks;
+    std::size_t            m_peak_live_bytes;
+    std::size_t            m_skipped;  // Frees of unrecorded blocks
+};
+
+replay_trace prepare(const std::vector<trace_record>& records)
+{
+    replay_trace ret = { { }, 0, 0, 0 };
+    ret.m_ops.reserve(records.size());
+
+    std::unordered_map<std::uint64_t, std::uint32_t> live;
+    std::size_t live_bytes = 0;
+    for (const trace_record& rec : records) {
+        if (rec.m_op == trace_record::allocate_op) {
+            std::uint32_t block = std::uint32_t(ret.m_num_blocks++);
+            live[rec.m_address] = block;
+            ret.m_ops.push_back(replay_op{ block,
+                                           std::uint32_t(rec.alignment()),
+                                           std::size_t(rec.m_bytes),
+                                           true });
+            live_bytes += rec.m_bytes;
+            ret.m_peak_live_bytes = std::max(ret.m_peak_live_bytes,
+                                             live_bytes);
+        }
+        else {
+            // The allocation may have been overwritten in the ring.
+            auto it = live.find(rec.m_address);
+            if (it == live.end()) {
+                ++ret.m_skipped;
+                continue;
+            }
+            ret.m_ops.push_back(replay_op{ it->second,
+                                           std::uint32_t(rec.alignment()),
+                                           std::size_t(rec.m_bytes),
+                                           false });
+            live_bytes -= rec.m_bytes;
+            live.erase(it);
+        }
+    }
+    return ret;
+}
+
+// Upstream resource that records the peak number of bytes outstanding.
+class footprint_resource : public memory_resource
+{
+    memory_resource *m_upstream;
+    std::size_t      m_outstanding;
+    std::size_t      m_peak;
+
+  public:
+    explicit footprint_resource(memory_resource *upstream)
+        : m_upstream(upstream), m_outstanding(0), m_peak(0) { }
+
+    std::size_t peak() const { return m_peak; }
+
+  protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        void *ret = m_upstream->allocate(bytes, alignment);
+        m_outstanding += bytes;
+        m_peak = std::max(m_peak, m_outstanding);
+        return ret;
+    }
+
+    void do_deallocate(void *p, std::size_t bytes,
+                       std::size_t alignment) override {
+        m_upstream->deallocate(p, bytes, alignment);
+        m_outstanding -= bytes;
+    }
+
+    bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Replay `trace` against `r`, then free the blocks still live.  Return
+// the time, in nanoseconds, taken by the replayed operations.
+double replay(const replay_trace& trace, memory_resource *r)
+{
+    typedef std::chrono::steady_clock clock;
+
+    std::vector<void*> blocks(trace.m_num_blocks, nullptr);
+
+    clock::time_point start = clock::now();
+    for (const replay_op& op : trace.m_ops) {
+        if (op.m_allocate)
+            blocks[op.m_block] = r->allocate(op.m_bytes, op.m_alignment);
+        else {
+            r->deallocate(blocks[op.m_block], op.m_bytes, op.m_alignment);
+            blocks[op.m_block] = nullptr;
+        }
+    }
+    clock::duration elapsed = clock::now() - start;
+
+    for (const replay_op& op : trace.m_ops)
+        if (op.m_allocate && blocks[op.m_block]) {
+            r->deallocate(blocks[op.m_block], op.m_bytes, op.m_alignment);
+            blocks[op.m_block] = nullptr;
+        }
+
+    return std::chrono::duration<double, std::nano>(elapsed).count();
+}
+
+void report(const char *name, const replay_trace& trace, double ns,
+            std::size_t footprint)
+{
+    double ops = double(trace.m_ops.size());
+    double fragmentation = footprint ?
+        1.0 - double(trace.m_peak_live_bytes) / footprint : 0.0;
+    std::printf("  %-14s %9.2f %9.1f %12zu %8.1f%%\n", name,
+                ns ? ops / ns * 1e3 : 0.0, ops ? ns / ops : 0.0,
+                footprint, 100.0 * fragmentation);
+}
+
+bool selected(const char *name, int argc, char *argv[])
+{
+    if (argc <= 2)
+        return true;
+    for (int i = 2; i < argc; ++i)
+        if (0 == std::strcmp(name, argv[i]))
+            return true;
+    return false;
+}
+
+// Record a synthetic trace: a churning population of mostly small blocks
+// with occasional large and over-aligned ones.
+void record_sample(const char *path)
+{
+    tracing_resource tracer(path, 1 << 18);
+
+    const std::size_t max_live = 20000;
+    struct block { void *m_p; std::size_t m_bytes, m_alignment; };
+    std::vector<block> live;
+    live.reserve(max_live);
+
+    unsigned long long rand = 12345;
+    for (int i = 0; i < 200000; ++i) {
+        rand = rand * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned r = unsigned(rand >> 33);
+        if (live.size() < max_live && (live.size() < 100 || r % 5 < 3)) {
+            std::size_t bytes = r % 100 == 0 ? 4096 + r % 60000
+                                             : 8 + (r >> 8) % 248;
+            std::size_t alignment = r % 97 == 0 ? 64 : 8;
+            live.push_back(block{ tracer.allocate(bytes, alignment),
+                                  bytes, alignment });
+        }
+        else {
+            std::size_t j = (r >> 4) % live.size();
+            tracer.deallocate(live[j].m_p, live[j].m_bytes,
+                              live[j].m_alignment);
+            live[j] = live.back();
+            live.pop_back();
+        }
+    }
+    for (const block& b : live)
+        tracer.deallocate(b.m_p, b.m_bytes, b.m_alignment);
+
+    std::printf("recorded %llu operations in %s\n",
+                (unsigned long long) tracer.records_written(), path);
+}
+
+} // close unnamed namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && 0 == std::strcmp(argv[1], "--record")) {
+        record_sample(argv[2]);
+        return 0;
+    }
+    if (argc < 2 || argv[1][0] == '-') {
+        std::fprintf(stderr,
+                     "usage: %s TRACE_FILE [RESOURCE...]\n"
+                     "       %s --record TRACE_FILE\n"
+                     "resources: new_delete unsync_pool sync_pool "
+                     "monotonic\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    replay_trace trace;
+    try {
+        trace = prepare(read_trace(argv[1]));
+    }
+    catch (const std::exception& ex) {
+        std::fprintf(stderr, "%s: %s\n", argv[1], ex.what());
+        return 1;
+    }
+
+    std::printf("%s: %zu operations, %zu blocks, peak live %zu bytes",
+                argv[1], trace.m_ops.size(), trace.m_num_blocks,
+                trace.m_peak_live_bytes);
+    if (trace.m_skipped)
+        std::printf(", %zu frees of overwritten blocks skipped",
+                    trace.m_skipped);
+    std::printf("\n  %-14s %9s %9s %12s %9s\n", "resource", "Mops/s",
+                "ns/op", "peak bytes", "frag");
+
+    memory_resource *heap = new_delete_resource_singleton();
+
+    // `new_delete_resource` has no upstream, so its footprint is the
+    // bytes requested; the heap's own overhead is not visible here.
+    if (selected("new_delete", argc, argv)) {
+        footprint_resource fr(heap);
+        double ns = replay(trace, &fr);
+        report("new_delete", trace, ns, fr.peak());
+    }
+
+    if (selected("unsync_pool", argc, argv)) {
+        footprint_resource fr(heap);
+        double ns;
+        {
+            unsynchronized_pool_resource r(&fr);
+            ns = replay(trace, &r);
+        }
+        report("unsync_pool", trace, ns, fr.peak());
+    }
+
+    if (selected("sync_pool", argc, argv)) {
+        footprint_resource fr(heap);
+        double ns;
+        {
+            synchronized_pool_resource r(&fr);
+            ns = replay(trace, &r);
+        }
+        report("sync_pool", trace, ns, fr.peak());
+    }
+
+    if (selected("monotonic", argc, argv)) {
+        footprint_resource fr(heap);
+        double ns;
+        {
+            monotonic_buffer_resource r(&fr);
+            ns = replay(trace, &r);
+        }
+        report("monotonic", trace, ns, fr.peak());
+    }
+
+    return 0;
+}
+
+/* End trace_replay.cpp */
@@ -0,0 +1,248 @@
+/* tracing_resource.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include "tracing_resource.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr std::uint64_t trace_record::busy_sequence;
+constexpr size_t tracing_resource::default_capacity;
+
+namespace {
+
+const char          trace_magic[8] = { 'P', 'M', 'R', 'T',
+                                       'R', 'A', 'C', 'E' };
+const std::uint32_t trace_version  = 1;
+
+static_assert(sizeof(trace_record) == 40, "Unexpected padding");
+static_assert(sizeof(trace_header) == 64, "Unexpected padding");
+
+[[noreturn]] void throw_errno(const char *what) {
+  throw std::system_error(errno, std::system_category(), what);
+}
+
+// Small id for the calling thread, assigned on first use.
+std::atomic<std::uint16_t> s_next_thread(0);
+thread_local unsigned      t_thread = ~0u;
+
+inline std::uint16_t thread_id() {
+  if (t_thread == ~0u)
+    t_thread = s_next_thread.fetch_add(1, std::memory_order_relaxed);
+  return std::uint16_t(t_thread);
+}
+
+// Unmaps a mapping and closes a file on scope exit.
+struct file_mapping {
+  int     m_fd;
+  void   *m_addr;
+  size_t  m_bytes;
+
+  file_mapping() : m_fd(-1), m_addr(MAP_FAILED), m_bytes(0) { }
+  ~file_mapping() {
+    if (m_addr != MAP_FAILED)
+      ::munmap(m_addr, m_bytes);
+    if (m_fd >= 0)
+      ::close(m_fd);
+  }
+};
+
+}
+
+tracing_resource::tracing_resource(const char           *path,
+                                   size_t                capacity,
+                                   pmr::memory_resource *parent)
+  : m_parent(parent)
+  , m_header(nullptr)
+  , m_records(nullptr)
+  , m_capacity(capacity ? capacity : 1)
+  , m_mapped_bytes(sizeof(trace_header) +
+                   m_capacity * sizeof(trace_record))
+{
+  int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw_errno("tracing_resource: open");
+  if (::ftruncate(fd, off_t(m_mapped_bytes)) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::system_category(),
+                            "tracing_resource: ftruncate");
+  }
+  void *addr = ::mmap(nullptr, m_mapped_bytes,
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int err = errno;
+  ::close(fd);  // The mapping keeps the file open
+  if (addr == MAP_FAILED)
+    throw std::system_error(err, std::system_category(),
+                            "tracing_resource: mmap");
+
+  // The new file is zero-filled, so every record slot is empty.
+  m_header  = static_cast<trace_header*>(addr);
+  m_records = reinterpret_cast<trace_record*>(m_header + 1);
+  std::memcpy(m_header->m_magic, trace_magic, sizeof(trace_magic));
+  m_header->m_version     = trace_version;
+  m_header->m_record_size = sizeof(trace_record);
+  m_header->m_capacity    = m_capacity;
+  m_header->m_next        = 0;
+  m_header->m_dropped     = 0;
+}
+
+tracing_resource::~tracing_resource() {
+  ::munmap(m_header, m_mapped_bytes);
+}
+
+pmr::memory_resource *tracing_resource::parent() const {
+  return m_parent;
+}
+
+size_t tracing_resource::capacity() const {
+  return m_capacity;
+}
+
+std::uint64_t tracing_resource::records_written() const {
+  return __atomic_load_n(&m_header->m_next, __ATOMIC_RELAXED);
+}
+
+std::uint64_t tracing_resource::records_dropped() const {
+  return __atomic_load_n(&m_header->m_dropped, __ATOMIC_RELAXED);
+}
+
+void tracing_resource::append(trace_record::op_code op, void *p,
+                              size_t bytes, size_t alignment) {
+  // The records live in a shared file mapping rather than in
+  // `std::atomic` objects, so the GCC atomic builtins are used on
+  // the plain fields.
+  std::uint64_t seq = __atomic_fetch_add(&m_header->m_next, 1,
+                                         __ATOMIC_RELAXED);
+  trace_record& rec = m_records[seq % m_capacity];
+
+  // Claim the slot if it holds a record from an earlier lap, or
+  // none.  The earlier record need not be from the previous lap,
+  // since that lap's writer may have dropped its record.  If
+  // another writer is filling the slot, or a later lap's writer
+  // has already filled it, only one of them may write it, so this
+  // record is dropped.
+  std::uint64_t old = __atomic_load_n(&rec.m_sequence,
+                                      __ATOMIC_RELAXED);
+  do {
+    if (old == trace_record::busy_sequence || old > seq) {
+      __atomic_fetch_add(&m_header->m_dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  } while (! __atomic_compare_exchange_n(&rec.m_sequence, &old,
+                                         trace_record::busy_sequence,
+                                         true, __ATOMIC_ACQUIRE,
+                                         __ATOMIC_RELAXED));
+
+  // Fill in the record, then publish it by storing its sequence
+  // number last.
+  std::uint64_t timestamp = std::chrono::duration_cast<
+    std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  __atomic_store_n(&rec.m_timestamp, timestamp, __ATOMIC_RELAXED);
+  __atomic_store_n(&rec.m_address, std::uint64_t(p),
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&rec.m_bytes, std::uint64_t(bytes),
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&rec.m_op, std::uint8_t(op), __ATOMIC_RELAXED);
+  // An alignment of 0, meaning natural alignment, is recorded as 1.
+  std::uint8_t alignment_log2 =
+    alignment ? std::uint8_t(__builtin_ctzl(alignment)) : 0;
+  __atomic_store_n(&rec.m_alignment_log2, alignment_log2,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&rec.m_thread, thread_id(), __ATOMIC_RELAXED);
+  __atomic_store_n(&rec.m_reserved, std::uint32_t(0),
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&rec.m_sequence, seq + 1, __ATOMIC_RELEASE);
+}
+
+void *tracing_resource::do_allocate(size_t bytes,
+                                    size_t alignment) {
+  void *ret = m_parent->allocate(bytes, alignment);
+  append(trace_record::allocate_op, ret, bytes, alignment);
+  return ret;
+}
+
+void tracing_resource::do_deallocate(void *p, size_t bytes,
+                                     size_t alignment) {
+  // Record before deallocating, so that the block's address
+  // cannot be reallocated, and its allocation recorded, first.
+  append(trace_record::deallocate_op, p, bytes, alignment);
+  m_parent->deallocate(p, bytes, alignment);
+}
+
+bool tracing_resource::do_is_equal(
+  const pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
+
+std::vector<trace_record> read_trace(const char *path) {
+  file_mapping file;
+  file.m_fd = ::open(path, O_RDONLY);
+  if (file.m_fd < 0)
+    throw_errno("read_trace: open");
+  struct stat st;
+  if (::fstat(file.m_fd, &st) != 0)
+    throw_errno("read_trace: fstat");
+  file.m_bytes = size_t(st.st_size);
+  if (file.m_bytes < sizeof(trace_header))
+    throw std::runtime_error("read_trace: Not a trace file");
+  file.m_addr = ::mmap(nullptr, file.m_bytes, PROT_READ,
+                       MAP_PRIVATE, file.m_fd, 0);
+  if (file.m_addr == MAP_FAILED)
+    throw_errno("read_trace: mmap");
+
+  const trace_header *header =
+    static_cast<const trace_header*>(file.m_addr);
+  if (std::memcmp(header->m_magic, trace_magic,
+                  sizeof(trace_magic)) != 0 ||
+      header->m_version != trace_version ||
+      header->m_record_size != sizeof(trace_record) ||
+      file.m_bytes < sizeof(trace_header) +
+                     header->m_capacity * sizeof(trace_record))
+    throw std::runtime_error("read_trace: Not a trace file");
+
+  // Keep the complete records of the last `capacity` written.
+  // Slots being written hold `busy_sequence`, so are skipped.
+  const trace_record *records =
+    reinterpret_cast<const trace_record*>(header + 1);
+  std::uint64_t next  = header->m_next;
+  std::uint64_t first = next > header->m_capacity ?
+                        next - header->m_capacity : 0;
+  std::vector<trace_record> ret;
+  ret.reserve(size_t(next - first));
+  for (std::uint64_t i = 0; i < header->m_capacity; ++i) {
+    const trace_record& rec = records[i];
+    if (rec.m_sequence > first && rec.m_sequence <= next)
+      ret.push_back(rec);
+  }
+
+  std::sort(ret.begin(), ret.end(),
+            [](const trace_record& a, const trace_record& b) {
+              return a.m_sequence < b.m_sequence;
+            });
+  return ret;
+}
+
+/* End tracing_resource.cpp */
+
+// For best result when pasting into PowerPoint, set indent to 2
+// and right-most column to 64.
+//
+// Local Variables:
+// c-basic-offset: 2
+// fill-column: 64
+// End:
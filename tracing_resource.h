@@ -0,0 +1,121 @@
+/* tracing_resource.h                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#ifndef INCLUDED_TRACING_RESOURCE_DOT_H
+#define INCLUDED_TRACING_RESOURCE_DOT_H
+
+#include <polymorphic_allocator.h>
+#include <cstdint>
+#include <vector>
+
+using std::size_t;
+namespace pmr = cpp17::pmr;
+
+// One allocation or deallocation in a trace file.  `m_sequence`
+// is one more than the operation's position in the trace; zero
+// marks a slot that was never written, and `busy_sequence` one
+// that is being written.
+// `m_address` identifies the block, pairing each deallocation
+// with its allocation.
+struct trace_record {
+  enum op_code : std::uint8_t { allocate_op = 1, deallocate_op = 2 };
+
+  static constexpr std::uint64_t busy_sequence = ~std::uint64_t(0);
+
+  std::uint64_t m_sequence;
+  std::uint64_t m_timestamp;       // `steady_clock` nanoseconds
+  std::uint64_t m_address;
+  std::uint64_t m_bytes;
+  std::uint8_t  m_op;
+  std::uint8_t  m_alignment_log2;
+  std::uint16_t m_thread;          // Small per-process thread id
+  std::uint32_t m_reserved;
+
+  size_t alignment() const { return size_t(1) << m_alignment_log2; }
+};
+
+// Header at the start of a trace file.
+struct trace_header {
+  char          m_magic[8];        // "PMRTRACE"
+  std::uint32_t m_version;
+  std::uint32_t m_record_size;
+  std::uint64_t m_capacity;        // Number of record slots
+  std::uint64_t m_next;            // Records ever written
+  std::uint64_t m_dropped;         // Records not written
+  char          m_padding[24];
+};
+
+// Resource that forwards to its parent and appends a
+// `trace_record` for every allocation and deallocation to a ring
+// of `capacity` records in a memory-mapped file, overwriting the
+// oldest records once the ring is full.  Appending is lock-free:
+// a writer claims its slot by swapping the sequence number of the
+// slot's older record, if any, for `busy_sequence`.  If another
+// writer is still filling the slot, or a writer of a later lap has
+// already filled it, the record is dropped and counted instead.
+// Since the file is mapped shared, records survive a crash of the
+// traced process.  Throws `system_error` if the file cannot be
+// created or mapped.
+class tracing_resource : public pmr::memory_resource
+{
+public:
+  static constexpr size_t default_capacity = size_t(1) << 20;
+
+  explicit tracing_resource(const char           *path,
+                            size_t                capacity =
+                                                   default_capacity,
+                            pmr::memory_resource *parent =
+                                   pmr::get_default_resource());
+  tracing_resource(const tracing_resource&) = delete;
+  tracing_resource& operator=(const tracing_resource&) = delete;
+  ~tracing_resource();
+
+  pmr::memory_resource *parent() const;
+  size_t capacity() const;
+
+  // Number of records appended, including any overwritten.
+  std::uint64_t records_written() const;
+
+  // Number of records dropped because their slot was in use.
+  std::uint64_t records_dropped() const;
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes,
+                     size_t alignment) override;
+  bool do_is_equal(const pmr::memory_resource& other)
+                                        const noexcept override;
+
+  template <class, class>
+  friend class cpp17::pmr::static_polymorphic_allocator;
+
+private:
+  void append(trace_record::op_code op, void *p, size_t bytes,
+              size_t alignment);
+
+  pmr::memory_resource  *m_parent;
+  trace_header          *m_header;   // Start of the mapping
+  trace_record          *m_records;
+  size_t                 m_capacity;
+  size_t                 m_mapped_bytes;
+};
+
+// Return the complete records in the trace file at `path`, oldest
+// first.  Throws `system_error` if the file cannot be read and
+// `runtime_error` if it is not a trace file.
+std::vector<trace_record> read_trace(const char *path);
+
+#endif // ! defined(INCLUDED_TRACING_RESOURCE_DOT_H)
+
+// For best result when pasting into PowerPoint, set indent to 2
+// and right-most column to 64.
+//
+// Local Variables:
+// c-basic-offset: 2
+// fill-column: 64
+// End:
@@ -0,0 +1,329 @@
+/* tracing_resource.t.cpp                  -*-C++-*-
+ *
+ *            Copyright 2017 Pablo Halpern.
+ * Distributed under the Boost Software License, Version 1.0.
+ *    (See accompanying file LICENSE_1_0.txt or copy at
+ *          http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <tracing_resource.h>
+#include <test_resource.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <unistd.h>
+
+//==========================================================================
+//                  ASSERT TEST MACRO
+//--------------------------------------------------------------------------
+static int testStatus = 0;
+
+static void aSsErT(int c, const char *s, int i) {
+    if (c) {
+        std::cout << __FILE__ << ":" << i << ": error: " << s
+                  << "    (failed)" << std::endl;
+        if (testStatus >= 0 && testStatus <= 100) ++testStatus;
+    }
+}
+
+# define ASSERT(X) { aSsErT(!(X), #X, __LINE__); }
+//--------------------------------------------------------------------------
+#define LOOP_ASSERT(I,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\n"; \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP2_ASSERT(I,J,X) { \
+    if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " \
+                          << J << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP3_ASSERT(I,J,K,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\n";           \
+                aSsErT(1, #X, __LINE__); } }
+
+#define LOOP4_ASSERT(I,J,K,L,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\n"; aSsErT(1, #X, __LINE__); } }
+
+#define LOOP5_ASSERT(I,J,K,L,M,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J    \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": " \
+                         << L << "\t" << #M << ": " << M << "\n";         \
+               aSsErT(1, #X, __LINE__); } }
+
+#define LOOP6_ASSERT(I,J,K,L,M,N,X) { \
+   if (!(X)) { std::cout << #I << ": " << I << "\t" << #J << ": " << J     \
+                         << "\t" << #K << ": " << K << "\t" << #L << ": "  \
+                         << L << "\t" << #M << ": " << M << "\t" << #N     \
+                         << ": " << N << "\n"; aSsErT(1, #X, __LINE__); } }
+
+// Resource that hands out fake addresses derived from the block size and
+// alignment, without allocating memory, so that every field of a trace
+// record can be checked against the others.
+class fake_address_resource : public pmr::memory_resource
+{
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override
+        { return reinterpret_cast<void*>(bytes * 4096 + alignment); }
+    void do_deallocate(void *, size_t, size_t) override { }
+    bool do_is_equal(const pmr::memory_resource& other)
+        const noexcept override { return this == &other; }
+};
+
+// Force instantiation of whole classes
+template class cpp17::pmr::static_polymorphic_allocator<
+    double, tracing_resource>;
+
+int main(int argc, char *argv[])
+{
+    const std::string path = "/tmp/tracing_resource.t." +
+        std::to_string(::getpid()) + ".trace";
+
+    std::cout << "Testing trace records\n";
+    {
+        test_resource tr;
+        std::vector<void*> blocks;
+        {
+            tracing_resource tracer(path.c_str(), 64, &tr);
+            ASSERT(&tr == tracer.parent());
+            ASSERT(64 == tracer.capacity());
+            ASSERT(0 == tracer.records_written());
+            ASSERT(tracer == tracer);
+
+            blocks.push_back(tracer.allocate(24, 8));
+            blocks.push_back(tracer.allocate(100, 64));
+            blocks.push_back(tracer.allocate(1, 1));
+            ASSERT(3 == tr.blocks_outstanding());
+            tracer.deallocate(blocks[1], 100, 64);
+            ASSERT(2 == tr.blocks_outstanding());
+            ASSERT(4 == tracer.records_written());
+
+            // Records can be read while the trace is being written.
+            ASSERT(4 == read_trace(path.c_str()).size());
+
+            tracer.deallocate(blocks[0], 24, 8);
+            tracer.deallocate(blocks[2], 1, 1);
+        }
+        ASSERT(0 == tr.blocks_outstanding());
+
+        std::vector<trace_record> recs = read_trace(path.c_str());
+        ASSERT(6 == recs.size());
+        static const struct {
+            int         d_block;
+            size_t      d_bytes;
+            size_t      d_alignment;
+            bool        d_allocate;
+        } DATA[] = {
+            { 0, 24, 8, true }, { 1, 100, 64, true }, { 2, 1, 1, true },
+            { 1, 100, 64, false }, { 0, 24, 8, false }, { 2, 1, 1, false }
+        };
+        for (size_t i = 0; i < recs.size(); ++i) {
+            const trace_record& rec = recs[i];
+            LOOP_ASSERT(i, i + 1 == rec.m_sequence);
+            LOOP_ASSERT(i, std::uint64_t(blocks[DATA[i].d_block]) ==
+                        rec.m_address);
+            LOOP_ASSERT(i, DATA[i].d_bytes == rec.m_bytes);
+            LOOP_ASSERT(i, DATA[i].d_alignment == rec.alignment());
+            LOOP_ASSERT(i, (DATA[i].d_allocate ? trace_record::allocate_op
+                                               : trace_record::deallocate_op)
+                        == rec.m_op);
+            LOOP_ASSERT(i, recs[0].m_thread == rec.m_thread);
+            LOOP_ASSERT(i, 0 == i ||
+                        recs[i - 1].m_timestamp <= rec.m_timestamp);
+        }
+    }
+
+    std::cout << "Testing natural alignment\n";
+    {
+        // An alignment of 0 asks the parent for natural alignment and is
+        // traced as 1.
+        {
+            tracing_resource tracer(path.c_str(), 8);
+            void *p = tracer.allocate(24, 0);
+            ASSERT(p);
+            tracer.deallocate(p, 24, 0);
+        }
+        std::vector<trace_record> recs = read_trace(path.c_str());
+        ASSERT(2 == recs.size());
+        for (size_t i = 0; i < recs.size(); ++i) {
+            LOOP_ASSERT(i, 0 == recs[i].m_alignment_log2);
+            LOOP_ASSERT(i, 1 == recs[i].alignment());
+            LOOP_ASSERT(i, 24 == recs[i].m_bytes);
+        }
+    }
+
+    std::cout << "Testing ring wrap-around\n";
+    {
+        {
+            tracing_resource tracer(path.c_str(), 8);
+            for (int i = 0; i < 10; ++i)
+                tracer.deallocate(tracer.allocate(i + 1), i + 1);
+            ASSERT(20 == tracer.records_written());
+        }
+        std::vector<trace_record> recs = read_trace(path.c_str());
+        ASSERT(8 == recs.size());
+        for (size_t i = 0; i < recs.size(); ++i) {
+            LOOP_ASSERT(i, 13 + i == recs[i].m_sequence);
+            LOOP_ASSERT(i, (12 + i) / 2 + 1 == recs[i].m_bytes);
+        }
+    }
+
+    std::cout << "Testing tracing_resource with threads\n";
+    {
+        const int num_threads = 4, iterations = 1000;
+        std::uint64_t dropped;
+        {
+            tracing_resource tracer(path.c_str(), 1024);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < num_threads; ++t)
+                threads.emplace_back([&tracer]{
+                    for (int i = 0; i < iterations; ++i)
+                        tracer.deallocate(tracer.allocate(i + 1), i + 1);
+                });
+            for (std::thread& th : threads)
+                th.join();
+            ASSERT(2 * num_threads * iterations == tracer.records_written());
+            dropped = tracer.records_dropped();
+        }
+
+        // Only the newest 1024 records remain, each complete, except for
+        // any dropped because a slower writer still held their slot.
+        const std::uint64_t written = 2 * num_threads * iterations;
+        std::vector<trace_record> recs = read_trace(path.c_str());
+        ASSERT(recs.size() <= 1024);
+        ASSERT(recs.size() + dropped >= 1024);
+        for (size_t i = 0; i < recs.size(); ++i) {
+            const trace_record& rec = recs[i];
+            LOOP_ASSERT(i, written - 1024 < rec.m_sequence);
+            LOOP_ASSERT(i, rec.m_sequence <= written);
+            LOOP_ASSERT(i, 0 == i || recs[i - 1].m_sequence < rec.m_sequence);
+            LOOP_ASSERT(i, 1 <= rec.m_bytes && rec.m_bytes <= iterations);
+            LOOP_ASSERT(i, 0 != rec.m_address);
+        }
+    }
+
+    std::cout << "Testing record consistency under contention\n";
+    {
+        // Many threads wrap a small ring many times.  Each record read back
+        // must hold the fields of a single operation: its address matches
+        // its size and alignment, and every record of a thread has sizes
+        // from that thread's range.
+        const int num_threads = 8, iterations = 20000;
+        fake_address_resource fake;
+        std::uint64_t dropped;
+        {
+            tracing_resource tracer(path.c_str(), 64, &fake);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < num_threads; ++t)
+                threads.emplace_back([&tracer, t]{
+                    for (int i = 0; i < iterations; ++i) {
+                        size_t bytes = size_t(t) * iterations + i + 1;
+                        size_t alignment = size_t(1) << (i % 8);
+                        tracer.deallocate(tracer.allocate(bytes, alignment),
+                                          bytes, alignment);
+                    }
+                });
+            for (std::thread& th : threads)
+                th.join();
+            ASSERT(2 * num_threads * iterations == tracer.records_written());
+            dropped = tracer.records_dropped();
+        }
+
+        std::vector<trace_record> recs = read_trace(path.c_str());
+        ASSERT(recs.size() <= 64);
+        ASSERT(recs.size() + dropped >= 64);
+        for (size_t i = 0; i < recs.size(); ++i) {
+            const trace_record& rec = recs[i];
+            LOOP_ASSERT(i, 0 == i || recs[i - 1].m_sequence < rec.m_sequence);
+            LOOP_ASSERT(i, rec.m_op == trace_record::allocate_op ||
+                        rec.m_op == trace_record::deallocate_op);
+            LOOP_ASSERT(i, 1 <= rec.m_bytes &&
+                        rec.m_bytes <= size_t(num_threads) * iterations);
+            LOOP_ASSERT(i, ((rec.m_bytes - 1) % iterations) % 8 ==
+                        rec.m_alignment_log2);
+            LOOP_ASSERT(i, rec.m_bytes * 4096 + rec.alignment() ==
+                        rec.m_address);
+            LOOP_ASSERT(i, 0 == rec.m_reserved);
+            for (size_t j = 0; j < i; ++j)
+                if (recs[j].m_thread == rec.m_thread)
+                    LOOP2_ASSERT(i, j, (recs[j].m_bytes - 1) / iterations ==
+                                 (rec.m_bytes - 1) / iterations);
+        }
+    }
+
+    std::cout << "Testing recovery from contention\n";
+    {
+        // Slots whose records were dropped under contention are claimed
+        // again later: once a single thread remains, nothing is dropped
+        // and every slot holds one of the newest records.
+        const int num_threads = 8, iterations = 20000;
+        fake_address_resource fake;
+        {
+            tracing_resource tracer(path.c_str(), 64, &fake);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < num_threads; ++t)
+                threads.emplace_back([&tracer]{
+                    for (int i = 0; i < iterations; ++i)
+                        tracer.deallocate(tracer.allocate(i + 1, 8),
+                                          i + 1, 8);
+                });
+            for (std::thread& th : threads)
+                th.join();
+            std::uint64_t dropped = tracer.records_dropped();
+
+            for (int i = 0; i < 1000; ++i)
+                tracer.deallocate(tracer.allocate(i + 1, 8), i + 1, 8);
+            LOOP2_ASSERT(dropped, tracer.records_dropped(),
+                         dropped == tracer.records_dropped());
+
+            std::uint64_t written = tracer.records_written();
+            std::vector<trace_record> recs = read_trace(path.c_str());
+            ASSERT(64 == recs.size());
+            for (size_t i = 0; i < recs.size(); ++i)
+                LOOP_ASSERT(i, written - 63 + i == recs[i].m_sequence);
+        }
+    }
+
+    std::cout << "Testing errors\n";
+    {
+        try {
+            tracing_resource tracer("/nonexistent/dir/file.trace");
+            ASSERT(false && "unreachable");
+        }
+        catch (std::system_error&) { }
+
+        try {
+            read_trace("/nonexistent/dir/file.trace");
+            ASSERT(false && "unreachable");
+        }
+        catch (std::system_error&) { }
+
+        {
+            std::ofstream junk(path.c_str());
+            junk << "This is not a trace file, though it is long enough "
+                    "to hold a trace file header.\n";
+        }
+        try {
+            read_trace(path.c_str());
+            ASSERT(false && "unreachable");
+        }
+        catch (std::runtime_error& ex) {
+            ASSERT(std::string("read_trace: Not a trace file") == ex.what());
+        }
+    }
+
+    std::remove(path.c_str());
+
+    std::cout << (0 == testStatus ? "PASSED" : "FAILED") << std::endl;
+
+    return testStatus;
+}
+
+/* End tracing_resource.t.cpp */